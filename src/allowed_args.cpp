@@ -7,6 +7,7 @@
 
 #include "allowed_args.h"
 #include "blockstorage/blockstorage.h"
+#include "blockstorage/blockwriter.h"
 #include "chainparams.h"
 #include "dosman.h"
 #include "httpserver.h"
@@ -14,6 +15,8 @@
 #include "main.h"
 #include "miner.h"
 #include "netbase.h"
+#include "plotterstats.h"
+#include "pocverify.h"
 #include "policy/policy.h"
 #include "qt/guiconstants.h"
 #include "requestManager.h"
@@ -266,6 +269,10 @@ static void addGeneralOptions(AllowedArgs &allowedArgs, HelpMessageMode mode)
             _("Execute command when the best block changes (%s in cmd is replaced by block hash)"))
         .addDebugArg("blocksonly", optionalBool,
             strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY))
+        .addArg("blockwritequeue=<n>", requiredInt,
+            strprintf(_("Queue up to <n> MiB of blocks and undo data to be written behind validation (0 = write "
+                        "synchronously, default: %u)"),
+                    DEFAULT_BLOCK_WRITE_QUEUE))
         .addArg("useblockdb", optionalBool,
             strprintf(_("Which method to store blocks on disk (default: %u) 0 = sequential files, 1 = blockdb"),
                     DEFAULT_BLOCK_DB_MODE))
@@ -308,6 +315,10 @@ static void addGeneralOptions(AllowedArgs &allowedArgs, HelpMessageMode mode)
 #ifndef WIN32
         .addArg("pid=<file>", requiredStr, strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME))
 #endif
+        .addArg("pocverifythreads=<n>", requiredInt,
+            strprintf(_("Set the number of threads verifying PoC deadlines of header and nonce batches (%u to %d, 0 = auto, "
+                        "<0 = leave that many cores free, default: %d)"),
+                    -GetNumCores(), MAX_POCVERIFY_THREADS, DEFAULT_POCVERIFY_THREADS))
         .addArg("persistmempool={true,false,0,1}", optionalBool,
             strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"),
                     DEFAULT_PERSIST_MEMPOOL))
@@ -317,6 +328,10 @@ static void addGeneralOptions(AllowedArgs &allowedArgs, HelpMessageMode mode)
                         "Warning: Reverting this setting requires re-downloading the entire blockchain. "
                         "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"),
                     MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024))
+        .addArg("pledgeindex", optionalBool,
+            strprintf(_("Maintain an index of active pledges by address, used by the getaddresspledge and liststakein "
+                        "rpc calls (default: %u)"),
+                    DEFAULT_PLEDGEINDEX))
         .addArg("reindex", optionalBool, _("Rebuild block chain index from current blk000??.dat files on startup"))
         .addArg("txindex", optionalBool,
             strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"),
@@ -507,7 +522,9 @@ static void addZmqOptions(AllowedArgs &allowedArgs)
             "zmqpubhashtx=<address>", requiredStr, _("Enable publish hash transaction in <address>"), zmqParamOptional)
         .addArg("zmqpubrawblock=<address>", requiredStr, _("Enable publish raw block in <address>"), zmqParamOptional)
         .addArg(
-            "zmqpubrawtx=<address>", requiredStr, _("Enable publish raw transaction in <address>"), zmqParamOptional);
+            "zmqpubrawtx=<address>", requiredStr, _("Enable publish raw transaction in <address>"), zmqParamOptional)
+        .addArg("zmqpubminingnotify=<address>", requiredStr,
+            _("Enable publish the mining info of every new tip in <address>"), zmqParamOptional);
 }
 
 static void addDebuggingOptions(AllowedArgs &allowedArgs, HelpMessageMode mode)
@@ -682,7 +699,14 @@ static void addBlockCreationOptions(AllowedArgs &allowedArgs)
         .addArg("blockprioritysize=<n>", requiredInt,
             strprintf(_("Set maximum size of high-priority/low-fee transactions in bytes (default: %d)"),
                     DEFAULT_BLOCK_PRIORITY_SIZE))
-        .addArg("blockversion=<n>", requiredInt, _("Generated block version number.  Value must be an integer"));
+        .addArg("blockversion=<n>", requiredInt, _("Generated block version number.  Value must be an integer"))
+        .addArg("plottershareburst=<n>", requiredInt,
+            strprintf(_("Submitted shares a plotter may have verified in one burst, a REST client %d times that, "
+                              "0 = no limit (default: %d)"),
+                    PEER_SHARE_LIMIT_FACTOR, DEFAULT_PLOTTER_SHARE_BURST))
+        .addArg("plottersharerate=<n>", requiredInt,
+            strprintf(_("Submitted shares per second a plotter may have verified on average (default: %d)"),
+                    DEFAULT_PLOTTER_SHARE_RATE));
 }
 
 static void addRpcServerOptions(AllowedArgs &allowedArgs)
@@ -834,6 +858,22 @@ BitcoinTx::BitcoinTx() : AllowedArgs(false)
         .addDebugArg("", optionalBool, "Read hex-encoded bitcoin transaction from stdin.");
 }
 
+BitcoinPlotter::BitcoinPlotter() : AllowedArgs(false)
+{
+    addHelpOptions(*this);
+
+    addHeader(_("Plotting options:"))
+        .addArg("count=<n>", requiredInt, _("Number of nonces to plot, 256 KiB each"))
+        .addArg("id=<n>", requiredStr, _("Plotter id (numeric account id) to plot for"))
+        .addArg("mem=<n>", requiredInt,
+            strprintf(_("MiB of memory for the nonces being generated and written (default: %u)"), 1024))
+        .addArg("path=<dir>", requiredStr, _("Directory to write the plot file to (default: the current directory)"))
+        .addArg("startnonce=<n>", requiredInt, _("First nonce to plot (default: 0)"))
+        .addArg("threads=<n>", requiredInt, _("Number of threads generating nonces (default: 0 = one per core)"))
+        .addArg("verify=<n>", requiredInt,
+            _("Check this many random nonces of the finished plot against the reference deadline code (default: 16)"));
+}
+
 ConfigFile::ConfigFile(CTweakMap *pTweaks) : AllowedArgs(false)
 {
     // Merges all allowed args from BitcoinCli, Bitcoind, and BitcoinQt.
@@ -143,6 +143,12 @@ public:
     BitcoinTx();
 };
 
+class BitcoinPlotter : public AllowedArgs
+{
+public:
+    BitcoinPlotter();
+};
+
 class ConfigFile : public AllowedArgs
 {
 public:
@@ -0,0 +1,79 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain.h"
+#include "chainparams.h"
+
+#include <vector>
+
+/* Long enough for CalculateBaseTarget to take its 24 block window */
+static const int CHAIN_LENGTH = 4000;
+
+/* A chain of block index entries with jittered times, like the one a node has after loading */
+class BenchChain
+{
+public:
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+
+    BenchChain(bool fMedianTimePast) : vHashes(CHAIN_LENGTH), vIndex(CHAIN_LENGTH)
+    {
+        for (int i = 0; i < CHAIN_LENGTH; i++)
+        {
+            CBlockIndex &index = vIndex[i];
+            *vHashes[i].begin() = i & 0xff;
+            *(vHashes[i].begin() + 1) = i >> 8;
+            index.phashBlock = &vHashes[i];
+            index.pprev = i > 0 ? &vIndex[i - 1] : nullptr;
+            index.nHeight = i;
+            index.nTime = 1550000000 + i * 180 + (i * 7919) % 97;
+            index.nBaseTarget = 18325193796ULL - (i * 104729) % 1000000;
+            index.BuildSkip();
+            if (fMedianTimePast)
+                index.BuildMedianTimePast();
+        }
+    }
+};
+
+static void HeaderMedianTimeWalk(benchmark::State &state)
+{
+    BenchChain chain(false);
+    int i = 0;
+    int64_t x = 0;
+    while (state.KeepRunning())
+    {
+        x += chain.vIndex[i].GetMedianTimePast();
+        i = (i + 1) % CHAIN_LENGTH;
+    }
+}
+
+static void HeaderMedianTimeCached(benchmark::State &state)
+{
+    BenchChain chain(true);
+    int i = 0;
+    int64_t x = 0;
+    while (state.KeepRunning())
+    {
+        x += chain.vIndex[i].GetMedianTimePast();
+        i = (i + 1) % CHAIN_LENGTH;
+    }
+}
+
+static void HeaderBaseTarget(benchmark::State &state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    BenchChain chain(true);
+    int i = 0;
+    uint64_t x = 0;
+    while (state.KeepRunning())
+    {
+        x += CalculateBaseTarget(&chain.vIndex[i]);
+        i = (i + 1) % CHAIN_LENGTH;
+    }
+}
+
+BENCHMARK(HeaderMedianTimeWalk);
+BENCHMARK(HeaderMedianTimeCached);
+BENCHMARK(HeaderBaseTarget);
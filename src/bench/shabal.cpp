@@ -0,0 +1,59 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "shabal/sph_shabal.h"
+
+#include <assert.h>
+#include <vector>
+
+/* Nonces per iteration, enough to fill the widest (AVX-512) kernel once */
+static const size_t NONCES = 16;
+static const unsigned long long PLOTTER_ID = 0x1122334455667788ULL;
+static const unsigned long long HEIGHT = 12345;
+
+static std::vector<unsigned char> GenSig()
+{
+    std::vector<unsigned char> sig(32);
+    for (size_t i = 0; i < sig.size(); i++)
+        sig[i] = i * 7 + 1;
+    return sig;
+}
+
+static void CalcDlScalar(benchmark::State &state)
+{
+    std::vector<unsigned char> sig = GenSig();
+    unsigned long long nonce = 0;
+    unsigned long long x = 0;
+    while (state.KeepRunning())
+    {
+        for (size_t i = 0; i < NONCES; i++)
+            x += calc_dl(HEIGHT, sig.data(), PLOTTER_ID, nonce++);
+    }
+}
+
+static void CalcDlBatch(benchmark::State &state)
+{
+    std::vector<unsigned char> sig = GenSig();
+    std::vector<unsigned long long> nonces(NONCES);
+    std::vector<unsigned long long> deadlines(NONCES);
+    unsigned long long nonce = 0;
+
+    // timing a kernel that is wrong is pointless, it has to agree with calc_dl first
+    for (size_t i = 0; i < NONCES; i++)
+        nonces[i] = i;
+    calc_dl_batch(HEIGHT, sig.data(), PLOTTER_ID, nonces.data(), deadlines.data(), NONCES);
+    for (size_t i = 0; i < NONCES; i++)
+        assert(deadlines[i] == calc_dl(HEIGHT, sig.data(), PLOTTER_ID, nonces[i]));
+
+    while (state.KeepRunning())
+    {
+        for (size_t i = 0; i < NONCES; i++)
+            nonces[i] = nonce++;
+        calc_dl_batch(HEIGHT, sig.data(), PLOTTER_ID, nonces.data(), deadlines.data(), NONCES);
+    }
+}
+
+BENCHMARK(CalcDlScalar);
+BENCHMARK(CalcDlBatch);
@@ -1,4 +1,5 @@
 // Copyright (c) 2018 The Bitcoin Unlimited developers
+// Copyright (c) 2019 The Diskcoin developers
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
@@ -8,25 +9,31 @@
 #endif
 
 #include "allowed_args.h"
-#include "arith_uint256.h"
 #include "chainparamsbase.h"
 #include "fs.h"
-#include "hash.h"
-#include "primitives/block.h"
 #include "rpc/client.h"
 #include "rpc/protocol.h"
-#include "streams.h"
+#include "shabal/calc_dl.h"
+#include "shabal/sph_shabal.h"
 #include "sync.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "utiltime.h"
 
+#include <atomic>
 #include <cstdlib>
+#include <functional>
+#include <limits>
+#include <map>
 #include <stdio.h>
 
-#include <event2/buffer.h>
-#include <event2/event.h>
-#include <event2/http.h>
-#include <event2/keyvalq_struct.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <boost/thread.hpp>
 
 #include <univalue.h>
 
@@ -41,40 +48,20 @@ std::map<std::pair<void *, void *>, LockStack> lockorders;
 boost::thread_specific_ptr<LockStack> lockstack;
 #endif
 
-// Internal miner
+// Plot scanner
 //
-// ScanHash scans nonces looking for a hash with at least some zero bits.
-// The nonce is usually preserved between calls, but periodically or if the
-// nonce is 0xffff0000 or above, the block is rebuilt and nNonce starts over at
-// zero.
-bool static ScanHash(const CBlockHeader *pblock, uint32_t &nNonce, uint256 *phash)
-{
-    // Write the first 76 bytes of the block header to a double-SHA256 state.
-    CHash256 hasher;
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << *pblock;
-    assert(ss.size() == 80);
-    hasher.Write((unsigned char *)&ss[0], 76);
-
-    while (true)
-    {
-        nNonce++;
-
-        // Write the last 4 bytes of the block header (the nonce) to a copy of
-        // the double-SHA256 state, and compute the result.
-        CHash256(hasher).Write((unsigned char *)&nNonce, 4).Finalize((unsigned char *)phash);
-
-        // Return the nonce if the hash has at least some zero bits,
-        // caller will check if it has enough to reach the target
-        if (((uint16_t *)phash)[15] == 0)
-            return true;
-
-        // If nothing found after trying for a while, return -1
-        if ((nNonce & 0xfff) == 0)
-            return false;
-    }
-}
-
+// Every round (block) the generation signature picks one scoop out of the 4096 of each nonce.  In a
+// PoC2 plot the scoops of all nonces with the same number are stored together, so a round reads one
+// contiguous 1/4096th of every plot file and hashes each 64 byte scoop with the generation signature
+// to get its deadline.  The files are cut into chunks that the scanning threads take in turn, and the
+// best deadline of every plotter id is submitted as soon as it is found, while the scan goes on.
+
+/** Nonces per chunk a scanning thread reads at once, 1 MiB of scoops */
+static const uint64_t SCAN_CHUNK_NONCES = 16384;
+/** Alignment of the read buffers, as O_DIRECT wants it */
+static const size_t SCAN_IO_ALIGN = 4096;
+/** Longest wait for a new block in one getMiningInfo call, in seconds */
+static const int MINER_LONGPOLL_TIMEOUT = 30;
 
 class BitcoinMinerArgs : public AllowedArgs::BitcoinCli
 {
@@ -82,421 +69,468 @@ public:
     BitcoinMinerArgs(CTweakMap *pTweaks = nullptr)
     {
         addHeader(_("Mining options:"))
-            .addArg("blockversion=<n>", ::AllowedArgs::requiredInt,
-                _("Set the block version number. For testing only.  Value must be an integer"))
+            .addArg("bench", ::AllowedArgs::optionalBool,
+                _("Scan the plots against made up mining info, without a node, and report the read and deadline "
+                  "throughput (default: 0)"))
+            .addArg("benchrounds=<n>", ::AllowedArgs::requiredInt,
+                _("Rounds to scan with -bench, each at another scoop (default: 10). Value must be an integer"))
             .addArg("cpus=<n>", ::AllowedArgs::requiredInt,
-                _("Number of cpus to use for mining (default: 1).  Value must be an integer"))
-            .addArg("duration=<n>", ::AllowedArgs::requiredInt,
-                _("Number of seconds to mine a particular block candidate (default: 30). Value must be an integer"))
-            .addArg("nblocks=<n>", ::AllowedArgs::requiredInt,
-                _("Number of blocks to mine (default: mine forever / -1). Value must be an integer"))
-            .addArg("coinbasesize=<n>", ::AllowedArgs::requiredInt,
-                _("Get a fixed size coinbase Tx (default: do not use / 0). Value must be an integer"));
+                _("Number of threads reading plots and computing deadlines (default: 0 = one per core). Value must "
+                  "be an integer"))
+            .addArg("plotdir=<dir>", ::AllowedArgs::requiredStr,
+                _("Directory with PoC2 plot files, named <plotterid>_<startnonce>_<nonces>. Can be specified "
+                  "multiple times"))
+            .addArg("plotio=<mode>", ::AllowedArgs::requiredStr,
+                _("How plots are read: mmap, direct (O_DIRECT, bypassing the page cache) or read (default: mmap)"))
+            .addArg("targetdeadline=<n>", ::AllowedArgs::requiredInt,
+                _("Only submit deadlines up to this many seconds (default: 0 = the target deadline of the node). "
+                  "Value must be an integer"));
     }
 };
 
+enum PlotIOMode
+{
+    PLOTIO_MMAP,
+    PLOTIO_DIRECT,
+    PLOTIO_READ
+};
 
-static CBlockHeader CpuMinerJsonToHeader(const UniValue &params)
+struct CPlotFile
 {
-    // Does not set hashMerkleRoot (Does not exist in Mining-Candidate params).
-    CBlockHeader blockheader;
+    std::string strPath;
+    uint64_t nPlotterId;
+    uint64_t nStartNonce;
+    uint64_t nNonces;
+    int fd;
+    const unsigned char *pMap; //! the whole file with -plotio=mmap
+
+    CPlotFile() : nPlotterId(0), nStartNonce(0), nNonces(0), fd(-1), pMap(nullptr) {}
+};
 
-    // nVersion
-    blockheader.nVersion = params["version"].get_int();
+struct CScanChunk
+{
+    size_t nFile;
+    uint64_t nFirst; //! first nonce of the chunk, counted from the start of the file
+    uint64_t nCount;
+};
 
-    // hashPrevBlock
-    string tmpstr = params["prevhash"].get_str();
-    std::vector<unsigned char> vec = ParseHex(tmpstr);
-    std::reverse(vec.begin(), vec.end()); // sent reversed
-    blockheader.hashPrevBlock = uint256(vec);
+/** What one round scans against */
+struct CMiningRound
+{
+    uint64_t nHeight;
+    uint64_t nBaseTarget;
+    uint64_t nTargetDeadline; //! in seconds, 0 = submit every improvement
+    unsigned char genSig[32];
+    std::string strGenSig;
+    unsigned int nScoop;
+};
 
-    // nTime:
-    blockheader.nTime = params["time"].get_int();
+struct CBestShare
+{
+    uint64_t nNonce;
+    uint64_t nDeadline; //! raw, not divided by the base target
+    bool fSubmitted;
+};
 
-    // nBits
-    {
-        std::stringstream ss;
-        ss << std::hex << params["nBits"].get_str();
-        ss >> blockheader.nBits;
-    }
+static PlotIOMode plotIOMode = PLOTIO_MMAP;
+static std::vector<CPlotFile> vPlotFiles;
+static std::vector<CScanChunk> vScanChunks;
 
-    return blockheader;
-}
+static CMiningRound currentRound;
+static std::atomic<size_t> nNextChunk{0};
+static std::atomic<bool> fAbortRound{false};
+static std::atomic<int> nScanning{0};
+static int64_t nScanStart = 0;
+static std::atomic<int64_t> nScanEnd{0}; // set by the last thread to finish, in micros
+static std::atomic<uint64_t> nBytesRead{0};
+static std::atomic<uint64_t> nNoncesScanned{0};
 
+static CCriticalSection cs_best;
+static std::map<uint64_t, CBestShare> mapBest GUARDED_BY(cs_best); // by plotter id, this round
 
-static void CalculateNextMerkleRoot(uint256 &merkle_root, const uint256 &merkle_branch)
+static bool ParsePlotFileName(const std::string &strName, CPlotFile &plot)
 {
-    // Append a branch to the root. Double SHA256 the whole thing:
-    uint256 hash;
-    CHash256()
-        .Write(merkle_root.begin(), merkle_root.size())
-        .Write(merkle_branch.begin(), merkle_branch.size())
-        .Finalize(hash.begin());
-    merkle_root = hash;
+    std::vector<std::string> vParts;
+    std::string::size_type nStart = 0, nEnd;
+    while ((nEnd = strName.find('_', nStart)) != std::string::npos)
+    {
+        vParts.push_back(strName.substr(nStart, nEnd - nStart));
+        nStart = nEnd + 1;
+    }
+    vParts.push_back(strName.substr(nStart));
+    if (vParts.size() == 4)
+    {
+        fprintf(stderr, "Skipping %s: PoC1 plots have to be converted to PoC2 first\n", strName.c_str());
+        return false;
+    }
+    return vParts.size() == 3 && ParseUint64(vParts[0], &plot.nPlotterId) &&
+           ParseUint64(vParts[1], &plot.nStartNonce) && ParseUint64(vParts[2], &plot.nNonces) && plot.nNonces > 0;
 }
 
-static uint256 CalculateMerkleRoot(uint256 &coinbase_hash, const std::vector<uint256> &merkleproof)
+static bool OpenPlotFile(CPlotFile &plot)
 {
-    uint256 merkle_root = coinbase_hash;
-    for (unsigned int i = 0; i < merkleproof.size(); i++)
+#ifndef WIN32
+    int flags = O_RDONLY;
+#ifdef O_DIRECT
+    if (plotIOMode == PLOTIO_DIRECT)
+        flags |= O_DIRECT;
+#endif
+    plot.fd = open(plot.strPath.c_str(), flags);
+    if (plot.fd < 0)
+    {
+        fprintf(stderr, "Unable to open %s: %s\n", plot.strPath.c_str(), strerror(errno));
+        return false;
+    }
+    if (plotIOMode == PLOTIO_MMAP)
     {
-        CalculateNextMerkleRoot(merkle_root, merkleproof[i]);
+        void *p = mmap(nullptr, plot.nNonces * CALC_DL_NONCE_SIZE, PROT_READ, MAP_SHARED, plot.fd, 0);
+        if (p == MAP_FAILED)
+        {
+            fprintf(stderr, "Unable to map %s: %s\n", plot.strPath.c_str(), strerror(errno));
+            close(plot.fd);
+            plot.fd = -1;
+            return false;
+        }
+        // only one scoop of every nonce is read, readahead past it is wasted
+        madvise(p, plot.nNonces * CALC_DL_NONCE_SIZE, MADV_RANDOM);
+        plot.pMap = (const unsigned char *)p;
     }
-    return merkle_root;
+#endif
+    return true;
 }
 
-static bool CpuMineBlockHasher(CBlockHeader *pblock,
-    vector<unsigned char> &coinbaseBytes,
-    const std::vector<uint256> &merkleproof)
+/** Find and open the plot files in every -plotdir, and cut them into chunks */
+static bool LoadPlotFiles()
 {
-    uint32_t nExtraNonce = std::rand();
-    uint32_t nNonce = pblock->nNonce;
-    arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
-    bool found = false;
-    int ntries = 10;
-    unsigned char *pbytes = (unsigned char *)&coinbaseBytes[0];
-
-    while (!found)
+    uint64_t nTotalNonces = 0;
+    for (const std::string &strDir : mapMultiArgs["-plotdir"])
     {
-        // hashMerkleRoot:
+        fs::path dir(strDir);
+        if (!fs::is_directory(dir))
         {
-            ++nExtraNonce;
-            // 48 - next in arr after Height. (Height in coinbase required for block.version=2):
-            *(unsigned int *)(pbytes + 48) = nExtraNonce;
-            uint256 hash;
-            CHash256().Write(pbytes, coinbaseBytes.size()).Finalize(hash.begin());
-
-            pblock->hashMerkleRoot = CalculateMerkleRoot(hash, merkleproof);
+            fprintf(stderr, "Error: plot directory %s not found\n", strDir.c_str());
+            return false;
         }
-
-        //
-        // Search
-        //
-        uint256 hash;
-        while (!found)
+        for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it)
         {
-            // Check if something found
-            if (ScanHash(pblock, nNonce, &hash))
+            if (!fs::is_regular_file(it->status()))
+                continue;
+            CPlotFile plot;
+            plot.strPath = it->path().string();
+            if (!ParsePlotFileName(it->path().filename().string(), plot))
+                continue;
+            if (fs::file_size(it->path()) != plot.nNonces * CALC_DL_NONCE_SIZE)
             {
-                if (UintToArith256(hash) <= hashTarget)
-                {
-                    // Found a solution
-                    pblock->nNonce = nNonce;
-                    found = true;
-                    printf("proof-of-work found  \n  hash: %s  \ntarget: %s\n", hash.GetHex().c_str(),
-                        hashTarget.GetHex().c_str());
-                    break;
-                }
-                else
-                {
-                    if (ntries-- < 1)
-                    {
-                        pblock->nNonce = nNonce; // report the last nonce checked for accounting
-                        return false; // Give up leave
-                    }
-                }
+                fprintf(stderr, "Skipping %s: its size does not match its nonces, is it still being plotted?\n",
+                    plot.strPath.c_str());
+                continue;
             }
+            if (!OpenPlotFile(plot))
+                continue;
+            for (uint64_t nFirst = 0; nFirst < plot.nNonces; nFirst += SCAN_CHUNK_NONCES)
+                vScanChunks.push_back({vPlotFiles.size(), nFirst, std::min(SCAN_CHUNK_NONCES, plot.nNonces - nFirst)});
+            nTotalNonces += plot.nNonces;
+            vPlotFiles.push_back(plot);
         }
     }
-
-    return found;
+    if (vPlotFiles.empty())
+    {
+        fprintf(stderr, "Error: no plot files found, use -plotdir=<dir>\n");
+        return false;
+    }
+    printf("%u plot files, %llu nonces (%.2f TiB), deadlines with the %s Shabal kernel\n",
+        (unsigned int)vPlotFiles.size(), (unsigned long long)nTotalNonces,
+        (double)nTotalNonces * CALC_DL_NONCE_SIZE / (1024.0 * 1024 * 1024 * 1024), calc_dl_kernel_name());
+    return true;
 }
 
-static double GetDifficulty(uint64_t nBits)
+/**
+ * Get the scoops of a chunk.  With mmap they are used in place, otherwise they are read into buf,
+ * which holds at least SCAN_CHUNK_NONCES scoops plus SCAN_IO_ALIGN bytes.
+ */
+static const unsigned char *ReadChunk(const CScanChunk &chunk, unsigned int nScoop, unsigned char *buf)
 {
-    int nShift = (nBits >> 24) & 0xff;
-
-    double dDiff = (double)0x0000ffff / (double)(nBits & 0x00ffffff);
-
-    while (nShift < 29)
+    const CPlotFile &plot = vPlotFiles[chunk.nFile];
+    const uint64_t nOffset = (nScoop * plot.nNonces + chunk.nFirst) * CALC_DL_SCOOP_SIZE;
+    const size_t nSize = chunk.nCount * CALC_DL_SCOOP_SIZE;
+#ifndef WIN32
+    if (plot.pMap)
     {
-        dDiff *= 256.0;
-        nShift++;
+        // have the whole chunk read at once instead of faulting it in page by page
+        uint64_t nPage = nOffset & ~(uint64_t)(SCAN_IO_ALIGN - 1);
+        madvise((void *)(plot.pMap + nPage), nOffset + nSize - nPage, MADV_WILLNEED);
+        return plot.pMap + nOffset;
     }
-    while (nShift > 29)
+    // O_DIRECT reads have to start and end on a block boundary
+    uint64_t nStart = nOffset & ~(uint64_t)(SCAN_IO_ALIGN - 1);
+    size_t nRead = (nOffset + nSize - nStart + SCAN_IO_ALIGN - 1) & ~(SCAN_IO_ALIGN - 1);
+    size_t nDone = 0;
+    while (nDone < nOffset + nSize - nStart)
     {
-        dDiff /= 256.0;
-        nShift--;
+        ssize_t n = pread(plot.fd, buf + nDone, nRead - nDone, nStart + nDone);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            fprintf(stderr, "Unable to read %s: %s\n", plot.strPath.c_str(), n < 0 ? strerror(errno) : "end of file");
+            return nullptr;
+        }
+        nDone += n;
     }
-    return dDiff;
+    return buf + (nOffset - nStart);
+#else
+    FILE *file = fopen(plot.strPath.c_str(), "rb");
+    if (!file)
+        return nullptr;
+    bool fRead = _fseeki64(file, nOffset, SEEK_SET) == 0 && fread(buf, 1, nSize, file) == nSize;
+    fclose(file);
+    return fRead ? buf : nullptr;
+#endif
 }
 
-static UniValue CpuMineBlock(unsigned int searchDuration, const UniValue &params, bool &found)
+static void ScanThread()
 {
-    UniValue tmp(UniValue::VOBJ);
-    UniValue ret(UniValue::VARR);
-    string tmpstr;
-    std::vector<uint256> merkleproof;
-    CBlockHeader header;
-    vector<unsigned char> coinbaseBytes(ParseHex(params["coinbase"].get_str()));
+    RenameThread("diskcoin-scan");
+    std::vector<unsigned char> vBuf(SCAN_CHUNK_NONCES * CALC_DL_SCOOP_SIZE + 2 * SCAN_IO_ALIGN);
+    unsigned char *buf = vBuf.data() + (SCAN_IO_ALIGN - ((uintptr_t)vBuf.data() % SCAN_IO_ALIGN)) % SCAN_IO_ALIGN;
+    std::vector<unsigned long long> vDeadlines(SCAN_CHUNK_NONCES);
 
-    found = false;
-
-    // re-create merkle branches:
+    size_t nChunk;
+    while (!fAbortRound.load() && (nChunk = nNextChunk.fetch_add(1)) < vScanChunks.size())
     {
-        UniValue uvMerkleproof = params["merkleProof"];
-        for (unsigned int i = 0; i < uvMerkleproof.size(); i++)
+        const CScanChunk &chunk = vScanChunks[nChunk];
+        const unsigned char *scoops = ReadChunk(chunk, currentRound.nScoop, buf);
+        if (!scoops)
+            continue;
+        calc_dl_scoops(currentRound.genSig, scoops, vDeadlines.data(), chunk.nCount);
+        nBytesRead += chunk.nCount * CALC_DL_SCOOP_SIZE;
+        nNoncesScanned += chunk.nCount;
+
+        uint64_t nBest = 0;
+        for (uint64_t i = 1; i < chunk.nCount; i++)
         {
-            tmpstr = uvMerkleproof[i].get_str();
-            std::vector<unsigned char> mbr = ParseHex(tmpstr);
-            std::reverse(mbr.begin(), mbr.end());
-            merkleproof.push_back(uint256(mbr));
+            if (vDeadlines[i] < vDeadlines[nBest])
+                nBest = i;
         }
+        const CPlotFile &plot = vPlotFiles[chunk.nFile];
+        LOCK(cs_best);
+        std::map<uint64_t, CBestShare>::iterator it = mapBest.find(plot.nPlotterId);
+        if (it == mapBest.end() || vDeadlines[nBest] < it->second.nDeadline)
+            mapBest[plot.nPlotterId] = {plot.nStartNonce + chunk.nFirst + nBest, vDeadlines[nBest], false};
     }
+    if (--nScanning == 0)
+        nScanEnd = GetTimeMicros();
+}
 
-    header = CpuMinerJsonToHeader(params);
-
-    // Set the version (only to test):
+/** Send the bests found since the last call, if they are below the target deadline */
+static void SubmitBest()
+{
+    std::vector<std::pair<uint64_t, CBestShare> > vSubmit;
     {
-        int blockversion = GetArg("-blockversion", header.nVersion);
-        if (blockversion != header.nVersion)
-            printf("Force header.nVersion to %d\n", blockversion);
-        header.nVersion = blockversion;
+        LOCK(cs_best);
+        for (auto &item : mapBest)
+        {
+            if (item.second.fSubmitted)
+                continue;
+            item.second.fSubmitted = true;
+            if (currentRound.nTargetDeadline == 0 ||
+                item.second.nDeadline / currentRound.nBaseTarget <= currentRound.nTargetDeadline)
+                vSubmit.push_back(item);
+        }
     }
+    if (vSubmit.empty())
+        return;
 
-    uint32_t startNonce = header.nNonce = std::rand();
-
-    printf("Mining: id: %x parent: %s bits: %x difficulty: %3.2f time: %d\n", (unsigned int)params["id"].get_int64(),
-        header.hashPrevBlock.ToString().c_str(), header.nBits, GetDifficulty(header.nBits), header.nTime);
-
-    int64_t start = GetTime();
-    while ((GetTime() < start + searchDuration) && !found)
+    UniValue shares(UniValue::VARR);
+    for (const auto &item : vSubmit)
     {
-        // When mining mainnet, you would normally want to advance the time to keep the block time as close to the
-        // real time as possible.  However, this CPU miner is only useful on testnet and in testnet the block difficulty
-        // resets to 1 after 20 minutes.  This will cause the block's difficulty to mismatch the expected difficulty
-        // and the block will be rejected.  So do not advance time (let it be advanced by bitcoind every time we
-        // request a new block).
-        // header.nTime = (header.nTime < GetTime()) ? GetTime() : header.nTime;
-        found = CpuMineBlockHasher(&header, coinbaseBytes, merkleproof);
+        UniValue share(UniValue::VOBJ);
+        share.pushKV("nonce", std::to_string(item.second.nNonce));
+        share.pushKV("plotterId", std::to_string(item.first));
+        share.pushKV("deadline", item.second.nDeadline);
+        shares.push_back(share);
     }
+    UniValue params(UniValue::VARR);
+    params.push_back(shares);
+    params.push_back(currentRound.nHeight);
 
-    // Leave if not found:
-    if (!found)
+    try
     {
-        printf("Checked %llu possibilities\n", (unsigned long long)(header.nNonce - startNonce));
-        return ret;
+        UniValue reply = CallRPC("submitNonces", params);
+        const UniValue &error = find_value(reply, "error");
+        if (!error.isNull())
+        {
+            fprintf(stderr, "Nonce submission error: %s\n", error.write().c_str());
+            return;
+        }
+        const UniValue &results = find_value(find_value(reply, "result"), "results");
+        for (size_t i = 0; i < results.size() && i < vSubmit.size(); i++)
+        {
+            printf("Height %llu plotter %llu nonce %llu: deadline %llu s%s%s\n",
+                (unsigned long long)currentRound.nHeight, (unsigned long long)vSubmit[i].first, (unsigned long long)vSubmit[i].second.nNonce,
+                (unsigned long long)find_value(results[i], "deadline").get_int64(),
+                find_value(results[i], "is_update").isTrue() ? ", best so far" : "",
+                find_value(results[i], "is_shed").isTrue() ? ", shed by the node" : "");
+        }
     }
-
-    printf("Solution! Checked %llu possibilities\n", (unsigned long long )(header.nNonce - startNonce));
-
-    tmpstr = HexStr(coinbaseBytes.begin(), coinbaseBytes.end());
-    tmp.pushKV("coinbase", tmpstr);
-    tmp.pushKV("id", params["id"]);
-    tmp.pushKV("time", UniValue(header.nTime)); // Optional. We have changed so must send.
-    tmp.pushKV("nonce", UniValue(header.nNonce));
-    tmp.pushKV("version", UniValue(header.nVersion)); // Optional. We may have changed so sending.
-    ret.push_back(tmp);
-
-    return ret;
-}
-
-static UniValue RPCSubmitSolution(const UniValue &solution, int &nblocks)
-{
-    UniValue reply = CallRPC("submitminingsolution", solution);
-
-    const UniValue &error = find_value(reply, "error");
-
-    if (!error.isNull())
+    catch (const std::exception &e)
     {
-        fprintf(stderr, "Block Candidate submission error: %d %s\n", error["code"].get_int(),
-            error["message"].get_str().c_str());
-        return reply;
+        fprintf(stderr, "Nonce submission failed: %s\n", e.what());
     }
+}
 
-    const UniValue &result = find_value(reply, "result");
-
-    if (result.isStr())
+/**
+ * Scan every plot at the scoop of the round.  poll is called about four times a second while the
+ * threads are busy; returning false abandons the round.  Returns false if the round was abandoned.
+ */
+static bool ScanRound(int nThreads, const std::function<bool()> &poll)
+{
+    currentRound.nScoop = calc_dl_scoop(currentRound.nHeight, currentRound.genSig);
     {
-        fprintf(stderr, "Block Candidate rejected. Error: %s\n", result.get_str().c_str());
-        // Print some debug info if the block is rejected
-        UniValue dbg = solution[0].get_obj();
-        fprintf(stderr, "id: %d  time: %d  nonce: %d  version: 0x%x\n", (unsigned int)dbg["id"].get_int64(),
-            (uint32_t)dbg["time"].get_int64(), (uint32_t)dbg["nonce"].get_int64(), (uint32_t)dbg["version"].get_int());
-        fprintf(stderr, "coinbase: %s\n", dbg["coinbase"].get_str().c_str());
+        LOCK(cs_best);
+        mapBest.clear();
     }
-    else
+    nNextChunk = 0;
+    fAbortRound = false;
+    nBytesRead = 0;
+    nNoncesScanned = 0;
+
+    nScanStart = GetTimeMicros();
+    nScanning = nThreads;
+    boost::thread_group scanThreads;
+    for (int i = 0; i < nThreads; i++)
+        scanThreads.create_thread(&ScanThread);
+    for (int nWaits = 1; nScanning.load() > 0; nWaits++)
     {
-        if (result.isNull())
-        {
-            printf("Block Candidate accepted.\n");
-            if (nblocks > 0)
-                nblocks--; // Processed a block
-        }
-        else
+        MilliSleep(10);
+        if (nWaits % 25 == 0 && !poll())
         {
-            fprintf(stderr, "Unknown \"submitminingsolution\" Error.\n");
+            fAbortRound = true;
+            break;
         }
     }
+    scanThreads.join_all();
+    double dSeconds = std::max(nScanEnd.load() - nScanStart, (int64_t)1) * 0.000001;
 
-    return reply;
+    std::string strResult = fAbortRound.load() ? ", abandoned for a new block" : "";
+    {
+        LOCK(cs_best);
+        uint64_t nBest = std::numeric_limits<uint64_t>::max();
+        for (const auto &item : mapBest)
+            nBest = std::min(nBest, item.second.nDeadline / currentRound.nBaseTarget);
+        if (!fAbortRound.load() && !mapBest.empty())
+            strResult = strprintf(", best deadline %llu s", (unsigned long long)nBest);
+    }
+    printf("Height %llu scoop %u: %llu nonces, %.1f MiB in %.2fs, %.1f MiB/s, %.0f nonces/s%s\n",
+        (unsigned long long)currentRound.nHeight, currentRound.nScoop, (unsigned long long)nNoncesScanned.load(),
+        nBytesRead.load() / (1024.0 * 1024), dSeconds, nBytesRead.load() / (1024.0 * 1024) / dSeconds,
+        nNoncesScanned.load() / dSeconds, strResult.c_str());
+    return !fAbortRound.load();
 }
 
-int CpuMiner(void)
+/** Measure the plots without a node: rounds at made up signatures, so at different scoops */
+static int BenchPlots(int nThreads)
 {
-    int searchDuration = GetArg("-duration", 30);
-    int nblocks = GetArg("-nblocks", -1); //-1 mine forever
-    int coinbasesize = GetArg("-coinbasesize", 0);
-
-    if (coinbasesize < 0)
+    int nRounds = GetArg("-benchrounds", 10);
+    uint64_t nTotalBytes = 0, nTotalNonces = 0;
+    int64_t nMicros = 0;
+    for (int i = 0; i < nRounds; i++)
     {
-        printf("Negative coinbasesize not reasonable/supported.\n");
-        return 0;
+        currentRound.nHeight = i + 1;
+        currentRound.nBaseTarget = 1;
+        currentRound.nTargetDeadline = 0;
+        for (unsigned int j = 0; j < sizeof(currentRound.genSig); j++)
+            currentRound.genSig[j] = std::rand();
+        ScanRound(nThreads, []() { return true; });
+        nTotalBytes += nBytesRead.load();
+        nTotalNonces += nNoncesScanned.load();
+        nMicros += nScanEnd.load() - nScanStart;
     }
+    double dSeconds = std::max(nMicros, (int64_t)1) * 0.000001;
+    printf("%d rounds on %d threads: %.1f MiB in %.2fs, %.1f MiB/s, %.0f nonces/s\n", nRounds, nThreads,
+        nTotalBytes / (1024.0 * 1024), dSeconds, nTotalBytes / (1024.0 * 1024) / dSeconds, nTotalNonces / dSeconds);
+    return EXIT_SUCCESS;
+}
 
-    UniValue mineresult;
-    bool found = false;
-
-    if (0 == nblocks)
+/**
+ * getMiningInfo, long polling for a signature other than strLastGenSig if one is given.
+ * Returns false while the node cannot be reached or is still syncing.
+ */
+static bool GetRound(const std::string &strLastGenSig, CMiningRound &next)
+{
+    UniValue params(UniValue::VARR);
+    if (!strLastGenSig.empty())
     {
-        printf("Nothing to do for zero (0) blocks\n");
-        return 0;
+        params.push_back(strLastGenSig);
+        params.push_back(MINER_LONGPOLL_TIMEOUT);
     }
-
-    while (0 != nblocks)
+    UniValue reply;
+    try
     {
-        UniValue reply;
-        UniValue result;
-        string strPrint;
-        int nRet = 0;
-        try
-        {
-            // Execute and handle connection failures with -rpcwait
-            const bool fWait = true;
-            do
-            {
-                try
-                {
-                    UniValue params(UniValue::VARR);
-                    if (found)
-                    {
-                        // Submit the solution.
-                        // Called here so all exceptions are handled properly below.
-                        reply = RPCSubmitSolution(mineresult, nblocks);
-                        if (nblocks == 0)
-                            return 0; // Done mining exit program
-                        found = false; // Mine again
-                    }
-
-                    if (!found)
-                    {
-                        if (coinbasesize > 0)
-                        {
-                            params.push_back(UniValue(coinbasesize));
-                        }
-                        reply = CallRPC("getminingcandidate", params);
-                    }
-
-                    // Parse reply
-                    result = find_value(reply, "result");
-                    const UniValue &error = find_value(reply, "error");
-
-                    if (!error.isNull())
-                    {
-                        // Error
-                        int code = error["code"].get_int();
-                        if (fWait && code == RPC_IN_WARMUP)
-                            throw CConnectionFailed("server in warmup");
-                        strPrint = "error: " + error.write();
-                        nRet = abs(code);
-                        if (error.isObject())
-                        {
-                            UniValue errCode = find_value(error, "code");
-                            UniValue errMsg = find_value(error, "message");
-                            strPrint = errCode.isNull() ? "" : "error code: " + errCode.getValStr() + "\n";
-
-                            if (errMsg.isStr())
-                                strPrint += "error message:\n" + errMsg.get_str();
-                        }
-                    }
-                    else
-                    {
-                        // Result
-                        if (result.isNull())
-                            strPrint = "";
-                        else if (result.isStr())
-                            strPrint = result.get_str();
-                        else
-                            strPrint = result.write(2);
-                    }
-                    // Connection succeeded, no need to retry.
-                    break;
-                }
-                catch (const CConnectionFailed &c)
-                {
-                    if (fWait)
-                    {
-                        printf("Warning: %s\n", c.what());
-                        MilliSleep(1000);
-                    }
-                    else
-                        throw;
-                }
-            } while (fWait);
-        }
-        catch (const boost::thread_interrupted &)
-        {
-            throw;
-        }
-        catch (const std::exception &e)
-        {
-            strPrint = string("error: ") + e.what();
-            nRet = EXIT_FAILURE;
-        }
-        catch (...)
-        {
-            PrintExceptionContinue(NULL, "CommandLineRPC()");
-            throw;
-        }
-
-        if (strPrint != "")
-        {
-            if (nRet != 0)
-                fprintf(stderr, "%s\n", strPrint.c_str());
-            // Actually do some mining
-            if (result.isNull())
-            {
-                MilliSleep(1000);
-            }
-            else
-            {
-                found = false;
-                mineresult = CpuMineBlock(searchDuration, result, found);
-                if (!found)
-                {
-                    // printf("Mining did not succeed\n");
-                    mineresult.setNull();
-                }
-                // The result is sent to bitcoind above when the loop gets to it.
-                // See:   RPCSubmitSolution(mineresult,nblocks);
-                // This is so RPC Exceptions are handled in one place.
-            }
-        }
+        reply = CallRPC("getMiningInfo", params);
+    }
+    catch (const CConnectionFailed &e)
+    {
+        printf("Warning: %s\n", e.what());
+        MilliSleep(1000);
+        return false;
+    }
+    const UniValue &error = find_value(reply, "error");
+    if (!error.isNull())
+    {
+        if (find_value(error, "code").get_int() != RPC_IN_WARMUP)
+            fprintf(stderr, "getMiningInfo error: %s\n", error.write().c_str());
+        MilliSleep(1000);
+        return false;
     }
-    return 0;
+    const UniValue &result = find_value(reply, "result");
+    std::vector<unsigned char> vGenSig = ParseHex(find_value(result, "generationSignature").get_str());
+    if (vGenSig.size() != sizeof(next.genSig) ||
+        !ParseUint64(find_value(result, "baseTarget").get_str(), &next.nBaseTarget) || next.nBaseTarget == 0)
+        throw std::runtime_error("getMiningInfo returned malformed mining info");
+    next.nHeight = find_value(result, "height").get_int64();
+    next.strGenSig = find_value(result, "generationSignature").get_str();
+    memcpy(next.genSig, vGenSig.data(), sizeof(next.genSig));
+    int64_t nTargetDeadline = GetArg("-targetdeadline", 0);
+    next.nTargetDeadline = nTargetDeadline > 0 ? nTargetDeadline : find_value(result, "targetDeadline").get_int64();
+    return true;
 }
 
-void static MinerThread()
+static int MinePlots(int nThreads)
 {
-    while (1)
+    std::string strLastGenSig;
+    while (true)
     {
-        try
-        {
-            CpuMiner();
-        }
-        catch (const std::exception &e)
-        {
-            PrintExceptionContinue(&e, "CommandLineRPC()");
-        }
-        catch (...)
-        {
-            PrintExceptionContinue(NULL, "CommandLineRPC()");
-        }
+        CMiningRound next;
+        if (!GetRound(strLastGenSig, next))
+            continue;
+        if (next.strGenSig == strLastGenSig)
+            continue; // the long poll timed out
+        currentRound = next;
+        strLastGenSig = currentRound.strGenSig;
+
+        int nPolls = 0;
+        bool fDone = ScanRound(nThreads, [&nPolls]() {
+            SubmitBest();
+            // look for a new block every two seconds, a scan that outlives it is wasted
+            if (++nPolls % 8 != 0)
+                return true;
+            CMiningRound latest;
+            return !GetRound("", latest) || latest.strGenSig == currentRound.strGenSig;
+        });
+        SubmitBest();
+        if (!fDone)
+            strLastGenSig.clear(); // start on the new block right away
     }
+    return EXIT_SUCCESS;
 }
 
 int main(int argc, char *argv[])
 {
+    //add for diskcoin -->
+    g_argv = argv;
+    g_argc = argc;
+    //<--
     SetupEnvironment();
     if (!SetupNetworking())
     {
@@ -523,15 +557,43 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    int nThreads = GetArg("-cpus", 1);
-    boost::thread_group minerThreads;
-    for (int i = 0; i < nThreads - 1; i++)
-        minerThreads.create_thread(MinerThread);
+    std::string strIO = GetArg("-plotio", "mmap");
+    if (strIO == "mmap")
+        plotIOMode = PLOTIO_MMAP;
+    else if (strIO == "direct")
+        plotIOMode = PLOTIO_DIRECT;
+    else if (strIO == "read")
+        plotIOMode = PLOTIO_READ;
+    else
+    {
+        fprintf(stderr, "Error: unknown -plotio=%s\n", strIO.c_str());
+        return EXIT_FAILURE;
+    }
+#ifdef WIN32
+    if (plotIOMode != PLOTIO_READ)
+#elif !defined(O_DIRECT)
+    if (plotIOMode == PLOTIO_DIRECT)
+#else
+    if (false)
+#endif
+    {
+        printf("-plotio=%s is not supported on this platform, reading plots normally\n", strIO.c_str());
+        plotIOMode = PLOTIO_READ;
+    }
+
+    int nThreads = GetArg("-cpus", 0);
+    if (nThreads <= 0)
+        nThreads = GetNumCores();
 
     int ret = EXIT_FAILURE;
     try
     {
-        ret = CpuMiner();
+        if (!LoadPlotFiles())
+            return EXIT_FAILURE;
+        if (GetBoolArg("-bench", false))
+            ret = BenchPlots(nThreads);
+        else
+            ret = MinePlots(nThreads);
     }
     catch (const std::exception &e)
     {
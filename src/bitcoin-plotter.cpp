@@ -0,0 +1,314 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "allowed_args.h"
+#include "clientversion.h"
+#include "fs.h"
+#include "shabal/calc_dl.h"
+#include "shabal/sph_shabal.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+#include <atomic>
+#include <stdio.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#ifdef DEBUG_LOCKORDER
+#include <boost/thread/tss.hpp>
+// BU add lockstack stuff here for bitcoin-cli, because I need to carefully
+// order it in globals.cpp for bitcoind and bitcoin-qt
+boost::mutex dd_mutex;
+std::map<std::pair<void *, void *>, LockStack> lockorders;
+boost::thread_specific_ptr<LockStack> lockstack;
+#endif
+
+// Plot file generator
+//
+// A PoC2 plot file <plotterid>_<startnonce>_<nonces> stores scoop 0 of every nonce, then scoop 1 of
+// every nonce and so on, so that a miner reads one contiguous stretch per block.  Nonces are generated
+// a group at a time straight into that transposed layout, by every thread, and while the next group is
+// generated the previous one is written out as 4096 runs in increasing file offsets: one per scoop.
+
+static const int64_t DEFAULT_PLOTTER_MEM = 1024;
+static const int DEFAULT_PLOTTER_VERIFY = 16;
+/** Nonces a generating thread takes at once, a multiple of every kernel's lanes */
+static const uint64_t PLOT_BATCH_NONCES = 64;
+
+static uint64_t nPlotterId = 0;
+static uint64_t nStartNonce = 0;
+static uint64_t nPlotNonces = 0;
+
+/** A group of nonces being generated or written, scoop s of nonce i at s * nStride + i * 64 */
+struct CPlotGroup
+{
+    std::vector<unsigned char> vData;
+    size_t nStride;
+    uint64_t nFirst; //! first nonce, counted from the start of the file
+    uint64_t nCount;
+};
+
+static std::atomic<uint64_t> nNextBatch{0};
+
+static void GenerateThread(CPlotGroup *pgroup)
+{
+    std::vector<unsigned long long> vNonces(PLOT_BATCH_NONCES);
+    uint64_t nBatch;
+    while ((nBatch = nNextBatch.fetch_add(PLOT_BATCH_NONCES)) < pgroup->nCount)
+    {
+        uint64_t nCount = std::min(PLOT_BATCH_NONCES, pgroup->nCount - nBatch);
+        for (uint64_t i = 0; i < nCount; i++)
+            vNonces[i] = nStartNonce + pgroup->nFirst + nBatch + i;
+        calc_plot_nonces(nPlotterId, vNonces.data(), nCount, pgroup->vData.data() + nBatch * CALC_DL_SCOOP_SIZE,
+            pgroup->nStride);
+    }
+}
+
+static void GenerateGroup(CPlotGroup &group, int nThreads)
+{
+    nNextBatch = 0;
+    boost::thread_group generateThreads;
+    for (int i = 0; i < nThreads; i++)
+        generateThreads.create_thread(boost::bind(&GenerateThread, &group));
+    generateThreads.join_all();
+}
+
+static bool WriteAt(FILE *file, const unsigned char *data, size_t nSize, uint64_t nOffset)
+{
+#ifndef WIN32
+    while (nSize > 0)
+    {
+        ssize_t n = pwrite(fileno(file), data, nSize, nOffset);
+        if (n <= 0)
+            return false;
+        data += n;
+        nSize -= n;
+        nOffset += n;
+    }
+    return true;
+#else
+    return _fseeki64(file, nOffset, SEEK_SET) == 0 && fwrite(data, 1, nSize, file) == nSize;
+#endif
+}
+
+static void WriteGroup(FILE *file, const CPlotGroup *pgroup, bool *pfOk)
+{
+    *pfOk = true;
+    for (uint64_t s = 0; s < CALC_DL_NUM_SCOOPS && *pfOk; s++)
+    {
+        *pfOk = WriteAt(file, pgroup->vData.data() + s * pgroup->nStride, pgroup->nCount * CALC_DL_SCOOP_SIZE,
+            (s * nPlotNonces + pgroup->nFirst) * CALC_DL_SCOOP_SIZE);
+    }
+}
+
+/** Compare random nonces of the plot with the deadlines the node would compute for them */
+static bool VerifyPlot(const fs::path &path, int nChecks)
+{
+    FILE *file = fsbridge::fopen(path, "rb");
+    if (!file)
+        return false;
+    bool fOk = true;
+    for (int i = 0; i < nChecks && fOk; i++)
+    {
+        unsigned char sig[32];
+        for (unsigned int j = 0; j < sizeof(sig); j++)
+            sig[j] = std::rand();
+        unsigned long long nHeight = std::rand();
+        uint64_t nNonce = ((uint64_t)std::rand() << 32 | std::rand()) % nPlotNonces;
+        unsigned int nScoop = calc_dl_scoop(nHeight, sig);
+
+        unsigned char scoop[CALC_DL_SCOOP_SIZE];
+        unsigned long long nDeadline = 0;
+#ifndef WIN32
+        fOk = pread(fileno(file), scoop, sizeof(scoop), (nScoop * nPlotNonces + nNonce) * CALC_DL_SCOOP_SIZE) ==
+              sizeof(scoop);
+#else
+        fOk = _fseeki64(file, (nScoop * nPlotNonces + nNonce) * CALC_DL_SCOOP_SIZE, SEEK_SET) == 0 &&
+              fread(scoop, 1, sizeof(scoop), file) == sizeof(scoop);
+#endif
+        if (fOk)
+        {
+            calc_dl_scoops(sig, scoop, &nDeadline, 1);
+            fOk = nDeadline == calc_dl(nHeight, sig, nPlotterId, nStartNonce + nNonce);
+        }
+        if (!fOk)
+            fprintf(stderr, "Error: nonce %llu does not have the deadline it should have\n",
+                (unsigned long long)(nStartNonce + nNonce));
+    }
+    fclose(file);
+    return fOk;
+}
+
+static int Plot()
+{
+    int nThreads = GetArg("-threads", 0);
+    if (nThreads <= 0)
+        nThreads = GetNumCores();
+    // two groups are in memory: the one being generated and the one being written
+    uint64_t nGroupNonces = GetArg("-mem", DEFAULT_PLOTTER_MEM) * 1024 * 1024 / 2 / CALC_DL_NONCE_SIZE;
+    nGroupNonces = std::max(nGroupNonces - nGroupNonces % PLOT_BATCH_NONCES, PLOT_BATCH_NONCES);
+    nGroupNonces = std::min(nGroupNonces, nPlotNonces);
+
+    fs::path dir(GetArg("-path", "."));
+    std::string strName = strprintf("%llu_%llu_%llu", (unsigned long long)nPlotterId,
+        (unsigned long long)nStartNonce, (unsigned long long)nPlotNonces);
+    // the miner only picks the file up once it has its final name
+    fs::path pathTmp = dir / (strName + ".plotting");
+    fs::path pathPlot = dir / strName;
+
+    FILE *file = fsbridge::fopen(pathTmp, "wb+");
+    if (!file)
+    {
+        fprintf(stderr, "Error: unable to create %s\n", pathTmp.string().c_str());
+        return EXIT_FAILURE;
+    }
+#if defined(__linux__)
+    if (posix_fallocate(fileno(file), 0, nPlotNonces * CALC_DL_NONCE_SIZE) != 0)
+    {
+        fprintf(stderr, "Error: not enough space for %s\n", pathTmp.string().c_str());
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+#endif
+
+    printf("Plotting %llu nonces (%.2f GiB) for %llu to %s, %d threads with the %s Shabal kernel, %llu nonces "
+           "per group\n",
+        (unsigned long long)nPlotNonces, (double)nPlotNonces * CALC_DL_NONCE_SIZE / (1024.0 * 1024 * 1024),
+        (unsigned long long)nPlotterId, pathPlot.string().c_str(), nThreads, calc_dl_kernel_name(),
+        (unsigned long long)nGroupNonces);
+
+    CPlotGroup groups[2];
+    for (CPlotGroup &group : groups)
+    {
+        group.vData.resize(nGroupNonces * CALC_DL_NONCE_SIZE);
+        group.nStride = nGroupNonces * CALC_DL_SCOOP_SIZE;
+    }
+
+    int64_t nStart = GetTimeMicros();
+    int64_t nGenerateMicros = 0;
+    bool fWriteOk = true;
+    boost::thread writer;
+    for (uint64_t nFirst = 0, n = 0; nFirst < nPlotNonces; nFirst += nGroupNonces, n++)
+    {
+        CPlotGroup &group = groups[n % 2];
+        group.nFirst = nFirst;
+        group.nCount = std::min(nGroupNonces, nPlotNonces - nFirst);
+        int64_t nGenerateStart = GetTimeMicros();
+        GenerateGroup(group, nThreads);
+        nGenerateMicros += GetTimeMicros() - nGenerateStart;
+
+        if (writer.joinable())
+            writer.join();
+        if (!fWriteOk)
+            break;
+        writer = boost::thread(&WriteGroup, file, &group, &fWriteOk);
+
+        double dSeconds = std::max(GetTimeMicros() - nStart, (int64_t)1) * 0.000001;
+        printf("%5.1f%%  %.0f nonces/min\n", 100.0 * (nFirst + group.nCount) / nPlotNonces,
+            (nFirst + group.nCount) * 60 / dSeconds);
+        fflush(stdout);
+    }
+    if (writer.joinable())
+        writer.join();
+    fWriteOk = fWriteOk && fflush(file) == 0;
+    if (fWriteOk)
+        FileCommit(file);
+    fclose(file);
+    if (!fWriteOk)
+    {
+        fprintf(stderr, "Error: unable to write %s\n", pathTmp.string().c_str());
+        return EXIT_FAILURE;
+    }
+
+    double dSeconds = std::max(GetTimeMicros() - nStart, (int64_t)1) * 0.000001;
+    printf("Plotted %llu nonces in %.1fs: %.0f nonces/min, %.1f MiB/s written, generating %.0f nonces/min\n",
+        (unsigned long long)nPlotNonces, dSeconds, nPlotNonces * 60 / dSeconds,
+        nPlotNonces * (CALC_DL_NONCE_SIZE / (1024.0 * 1024)) / dSeconds,
+        nPlotNonces * 60 / std::max(nGenerateMicros * 0.000001, 0.000001));
+
+    int nChecks = GetArg("-verify", DEFAULT_PLOTTER_VERIFY);
+    if (nChecks > 0 && !VerifyPlot(pathTmp, nChecks))
+        return EXIT_FAILURE;
+    if (!RenameOver(pathTmp, pathPlot))
+    {
+        fprintf(stderr, "Error: unable to rename %s\n", pathTmp.string().c_str());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    SetupEnvironment();
+
+    AllowedArgs::BitcoinPlotter allowedArgs;
+    try
+    {
+        ParseParameters(argc, argv, allowedArgs);
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "Error parsing program options: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (argc < 2 || mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help") || mapArgs.count("-version"))
+    {
+        std::string strUsage =
+            strprintf(_("%s diskcoin-plotter utility version"), _(PACKAGE_NAME)) + " " + FormatFullVersion() + "\n";
+        if (!mapArgs.count("-version"))
+        {
+            strUsage += "\n" + _("Usage:") + "\n" + "  diskcoin-plotter -id=<n> -count=<n> [options]  " +
+                        _("Create a PoC2 plot file") + "\n\n" + allowedArgs.helpMessage();
+        }
+        fprintf(stdout, "%s", strUsage.c_str());
+        return argc < 2 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (!ParseUint64(GetArg("-id", ""), &nPlotterId))
+    {
+        fprintf(stderr, "Error: -id=<n> is required\n");
+        return EXIT_FAILURE;
+    }
+    // the node rejects every share of a larger id, its plots could never be mined
+    if ((nPlotterId >> 56) > 0)
+    {
+        fprintf(stderr, "Error: plotter id must less than 0x00ffffffffffffff\n");
+        return EXIT_FAILURE;
+    }
+    int64_t nStart = GetArg("-startnonce", 0);
+    int64_t nNonces = GetArg("-count", 0);
+    if (nStart < 0 || nNonces <= 0)
+    {
+        fprintf(stderr, "Error: -count=<n> is required and -startnonce can not be negative\n");
+        return EXIT_FAILURE;
+    }
+    nStartNonce = nStart;
+    nPlotNonces = nNonces;
+
+    try
+    {
+        return Plot();
+    }
+    catch (const std::exception &e)
+    {
+        PrintExceptionContinue(&e, "Plot()");
+    }
+    catch (...)
+    {
+        PrintExceptionContinue(NULL, "Plot()");
+    }
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "compat.h"
+#include "sequential_files.h"
+#include "util.h"
+
+#include <sys/stat.h>
+
+CBlockFileMap::CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    munmap((void *)pdata, nSize);
+#endif
+}
+
+std::shared_ptr<const CBlockFileMap::CMappedFile> CBlockFileMap::Map(int nFile)
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    FILE *file = OpenBlockFile(CDiskBlockPos(nFile, 0), true);
+    if (!file)
+        return nullptr;
+    // The mapping outlives the descriptor, the file is only needed to size and map it
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fileno(file), &st) == 0 && st.st_size > 0)
+        p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fileno(file), 0);
+    fclose(file);
+    if (p == MAP_FAILED)
+    {
+        LOG(BLK, "Unable to map block file %05u, reading it instead\n", nFile);
+        return nullptr;
+    }
+    return std::make_shared<const CMappedFile>(nFile, (const char *)p, (size_t)st.st_size);
+#endif
+}
+
+bool CBlockFileMap::Get(const CDiskBlockPos &pos, unsigned int nSize, CRawBlock &raw)
+{
+    if (pos.IsNull() || nMaxFiles == 0)
+        return false;
+    size_t nEnd = (size_t)pos.nPos + nSize;
+
+    std::shared_ptr<const CMappedFile> pmap;
+    {
+        LOCK(cs);
+        for (auto it = lru.begin(); it != lru.end(); ++it)
+        {
+            if ((*it)->nFile != pos.nFile)
+                continue;
+            // A mapping that ends too soon is of a file that has grown since, map it again
+            if ((*it)->nSize >= nEnd)
+            {
+                pmap = *it;
+                lru.splice(lru.begin(), lru, it);
+            }
+            else
+                lru.erase(it);
+            break;
+        }
+        if (!pmap)
+        {
+            pmap = Map(pos.nFile);
+            if (!pmap)
+                return false;
+            lru.push_front(pmap);
+            if (lru.size() > nMaxFiles)
+                lru.pop_back();
+        }
+    }
+    if (pmap->nSize < nEnd)
+        return false;
+    raw.Set(pmap, pmap->pdata + pos.nPos, pmap->pdata + nEnd);
+    return true;
+}
+
+void CBlockFileMap::Forget(int nFile)
+{
+    LOCK(cs);
+    lru.remove_if([nFile](const std::shared_ptr<const CMappedFile> &pmap) { return pmap->nFile == nFile; });
+}
+
+void CBlockFileMap::Clear()
+{
+    LOCK(cs);
+    lru.clear();
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BLOCKSTORAGE_BLOCKFILEMAP_H
+#define BLOCKSTORAGE_BLOCKFILEMAP_H
+
+#include "chain.h"
+#include "sync.h"
+
+#include <list>
+#include <memory>
+
+/** Number of block files kept mapped; a blk?????.dat file is at most MAX_BLOCKFILE_SIZE */
+static const size_t DEFAULT_BLOCK_FILE_MAPS = sizeof(void *) > 4 ? 8 : 2;
+
+/**
+ * The serialized bytes of a block, as they are on disk and on the wire.
+ *
+ * They are used in place wherever they live, a mapped block file or a record
+ * still waiting to be written, which owner keeps alive for as long as this
+ * object or a copy of it exists.
+ */
+class CRawBlock
+{
+private:
+    std::shared_ptr<const void> owner;
+    const char *pbegin;
+    const char *pend;
+
+public:
+    CRawBlock() : pbegin(nullptr), pend(nullptr) {}
+
+    void Set(std::shared_ptr<const void> ownerIn, const char *pbeginIn, const char *pendIn)
+    {
+        owner = std::move(ownerIn);
+        pbegin = pbeginIn;
+        pend = pendIn;
+    }
+    void SetNull() { Set(nullptr, nullptr, nullptr); }
+
+    const char *begin() const { return pbegin; }
+    const char *end() const { return pend; }
+    size_t size() const { return pend - pbegin; }
+    bool empty() const { return pbegin == pend; }
+
+    template <typename Stream>
+    void Serialize(Stream &s) const
+    {
+        s.write(pbegin, size());
+    }
+};
+
+/**
+ * Least recently used set of read-only mappings of the blk?????.dat files.
+ *
+ * Reading a block then costs no open, seek, read or close, and no copy into
+ * a buffer before it is deserialized.  Block files only grow while blocks are
+ * added, and are preallocated a chunk at a time, so a mapping is redone only
+ * when a read goes past its end.  Files that are truncated or pruned have to
+ * be forgotten first; readers still holding their mapping keep it valid.
+ * Not available on Windows, where reads go through the file as before.
+ */
+class CBlockFileMap
+{
+private:
+    struct CMappedFile
+    {
+        int nFile;
+        const char *pdata;
+        size_t nSize;
+
+        CMappedFile(int nFileIn, const char *pdataIn, size_t nSizeIn) : nFile(nFileIn), pdata(pdataIn), nSize(nSizeIn)
+        {
+        }
+        ~CMappedFile();
+    };
+
+    CCriticalSection cs;
+    //! Most recently used first
+    std::list<std::shared_ptr<const CMappedFile> > lru GUARDED_BY(cs);
+    const size_t nMaxFiles;
+
+    std::shared_ptr<const CMappedFile> Map(int nFile);
+
+public:
+    CBlockFileMap(size_t nMaxFilesIn = DEFAULT_BLOCK_FILE_MAPS) : nMaxFiles(nMaxFilesIn) {}
+
+    /**
+     * Point raw at the nSize bytes at pos in its block file, mapping the file if it is not already.
+     * Returns false if the range cannot be mapped, the caller then reads the file instead.
+     */
+    bool Get(const CDiskBlockPos &pos, unsigned int nSize, CRawBlock &raw);
+
+    /** Drop the mapping of a block file, before it is truncated or deleted */
+    void Forget(int nFile);
+    void Clear();
+};
+
+extern CBlockFileMap blockFileMap;
+
+#endif // BLOCKSTORAGE_BLOCKFILEMAP_H
@@ -514,6 +514,46 @@ bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(CRawBlock &raw, const CBlockIndex *pindex, const Consensus::Params &consensusParams)
+{
+    // Failed blocks take the full read, which may reconsider them
+    if (!pblockdb && !(pindex->nStatus & BLOCK_FAILED_MASK))
+    {
+        if (!ReadRawBlockFromDiskSequential(raw, pindex->GetBlockPos()))
+        {
+            return false;
+        }
+        // The header is enough to tell that these are the bytes of the block the index entry was accepted for
+        CBlockHeader header;
+        try
+        {
+            CSpanReader(SER_DISK, CLIENT_VERSION, raw.begin(), raw.end()) >> header;
+        }
+        catch (const std::exception &e)
+        {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pindex->GetBlockPos().ToString());
+        }
+        if (header.GetHash() != pindex->GetBlockHash())
+        {
+            return error("ReadRawBlockFromDisk(CRawBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                pindex->ToString(), pindex->GetBlockPos().ToString());
+        }
+        return true;
+    }
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, consensusParams))
+    {
+        return false;
+    }
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+    std::shared_ptr<CSerializeData> pdata = std::make_shared<CSerializeData>();
+    ss.GetAndClear(*pdata);
+    raw.Set(pdata, pdata->data(), pdata->data() + pdata->size());
+    return true;
+}
+
 bool WriteUndoToDisk(const CBlockUndo &blockundo,
     CDiskBlockPos &pos,
     const CBlockIndex *pindex,
@@ -641,7 +681,10 @@ bool FlushStateToDiskInternal(CValidationState &state,
         // First make sure all block and undo data is flushed to disk. This is not used for levelDB block storage
         if (BLOCK_DB_MODE == SEQUENTIAL_BLOCK_FILES)
         {
-            FlushBlockFile();
+            if (!FlushBlockFile())
+            {
+                return AbortNode(state, "Failed to write block or undo data");
+            }
         }
         // Then update all block file information (which may refer to block and undo files).
         {
@@ -682,7 +725,10 @@ bool FlushStateToDiskInternal(CValidationState &state,
         // Finally remove any pruned files, this will be empty for blockdb mode
         if (fFlushForPrune)
         {
-            UnlinkPrunedFiles(setFilesToPrune);
+            if (!UnlinkPrunedFiles(setFilesToPrune))
+            {
+                return AbortNode(state, "Failed to write block or undo data");
+            }
         }
         nLastWrite = nNow;
     }
@@ -844,7 +890,10 @@ bool FindBlockPos(CValidationState &state,
         {
             LOGA("Leaving block file %i: %s\n", nLastBlockFile, vinfoBlockFile[nLastBlockFile].ToString());
         }
-        FlushBlockFile(!fKnown);
+        if (!FlushBlockFile(!fKnown))
+        {
+            return AbortNode(state, "Failed to write block or undo data");
+        }
         nLastBlockFile = nFile;
     }
 
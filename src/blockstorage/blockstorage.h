@@ -4,6 +4,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blockfilemap.h"
 #include "blockleveldb.h"
 #include "main.h"
 #include "undo.h"
@@ -33,6 +34,8 @@ void SyncStorage(const CChainParams &chainparams);
 
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex, const Consensus::Params &consensusParams);
+/** Get a block serialized as on disk and on the wire, without deserializing it where the storage allows */
+bool ReadRawBlockFromDisk(CRawBlock &raw, const CBlockIndex *pindex, const Consensus::Params &consensusParams);
 bool WriteBlockToDisk(const CBlock &block, CDiskBlockPos &pos, const CMessageHeader::MessageStartChars &messageStart);
 
 bool WriteUndoToDisk(const CBlockUndo &blockundo,
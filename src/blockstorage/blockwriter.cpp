@@ -0,0 +1,241 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockwriter.h"
+
+#include "clientversion.h"
+#include "hash.h"
+#include "sequential_files.h"
+#include "util.h"
+#include "utiltime.h"
+
+extern bool AbortNode(const std::string &strMessage, const std::string &userMessage);
+
+CBlockWriter::CBlockWriter()
+    : nQueuedBytes(0), nMaxQueuedBytes(0), fStop(false), fFailed(false), nWrites(0), nBytesWritten(0),
+      nQueueFullWaits(0), nTimeWriting(0)
+{
+}
+
+CBlockWriter::~CBlockWriter() { Stop(); }
+
+void CBlockWriter::Start(size_t nMaxBytes)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (thread.joinable() || nMaxBytes == 0)
+        return;
+    nMaxQueuedBytes = nMaxBytes;
+    fStop = false;
+    thread = std::thread(&CBlockWriter::ThreadWriter, this);
+    LOGA("Writing blocks and undo data behind a queue of %.1fMiB\n", nMaxBytes / 1048576.0);
+}
+
+void CBlockWriter::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!thread.joinable())
+            return;
+        fStop = true;
+        cvWork.notify_all();
+    }
+    thread.join();
+}
+
+bool CBlockWriter::IsRunning()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return thread.joinable() && !fStop;
+}
+
+bool CBlockWriter::Drain()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (mapPending.empty())
+        return !fFailed;
+    while (!mapPending.empty() && !fFailed)
+        cvDone.wait(lock);
+    LOG(BENCH, "Block writer drained: %u records, %.2fMiB written in %.2fs, %u waits for a full queue\n", nWrites,
+        nBytesWritten / 1048576.0, nTimeWriting * 0.000001, nQueueFullWaits);
+    return !fFailed;
+}
+
+bool CBlockWriter::Queue(Type type, CDiskBlockPos &pos, size_t nHeaderSize, CDataStream &ss)
+{
+    std::shared_ptr<CPendingWrite> pwrite = std::make_shared<CPendingWrite>();
+    pwrite->type = type;
+    pwrite->nFile = pos.nFile;
+    pwrite->nWritePos = pos.nPos;
+    pwrite->nDataPos = pos.nPos + nHeaderSize;
+    ss.GetAndClear(pwrite->data);
+    pwrite->nQueued = GetTimeMicros();
+    size_t nBytes = pwrite->data.size();
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    // A full queue holds the caller up as the synchronous write did, but never blocks one record on its own
+    if (nQueuedBytes > 0 && nQueuedBytes + nBytes > nMaxQueuedBytes && !fFailed)
+    {
+        nQueueFullWaits++;
+        while (nQueuedBytes > 0 && nQueuedBytes + nBytes > nMaxQueuedBytes && !fFailed)
+            cvDone.wait(lock);
+    }
+    if (fFailed)
+        return error("%s: an earlier block or undo write failed", __func__);
+
+    pos.nPos = pwrite->nDataPos;
+    mapPending[PendingKey(type, pwrite->nFile, pwrite->nDataPos)] = pwrite;
+    queue.push_back(pwrite);
+    nQueuedBytes += nBytes;
+    nBlockWriteQueueDepth << queue.size();
+    cvWork.notify_one();
+    return true;
+}
+
+bool CBlockWriter::WriteBlock(const CBlock &block,
+    CDiskBlockPos &pos,
+    const CMessageHeader::MessageStartChars &messageStart)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    unsigned int nSize = GetSerializeSize(ss, block);
+    ss << FLATDATA(messageStart) << nSize;
+    size_t nHeaderSize = ss.size();
+    ss.reserve(nHeaderSize + nSize);
+    ss << block;
+    return Queue(BLOCK, pos, nHeaderSize, ss);
+}
+
+bool CBlockWriter::WriteUndo(const CBlockUndo &blockundo,
+    CDiskBlockPos &pos,
+    const uint256 &hashBlock,
+    const CMessageHeader::MessageStartChars &messageStart)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    unsigned int nSize = GetSerializeSize(ss, blockundo);
+    ss << FLATDATA(messageStart) << nSize;
+    size_t nHeaderSize = ss.size();
+    ss.reserve(nHeaderSize + nSize + sizeof(uint256));
+    ss << blockundo;
+
+    // calculate & write checksum
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << hashBlock;
+    hasher << blockundo;
+    ss << hasher.GetHash();
+    return Queue(UNDO, pos, nHeaderSize, ss);
+}
+
+bool CBlockWriter::GetPending(Type type, const CDiskBlockPos &pos, CRawBlock &raw)
+{
+    CPendingWriteRef pwrite;
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (mapPending.empty())
+            return false;
+        std::map<PendingKey, CPendingWriteRef>::const_iterator it =
+            mapPending.find(PendingKey(type, pos.nFile, pos.nPos));
+        if (it == mapPending.end())
+            return false;
+        pwrite = it->second;
+    }
+    // The record is never modified once queued, so it can be used in place after it has been written too
+    const char *pbegin = &pwrite->data[pwrite->nDataPos - pwrite->nWritePos];
+    raw.Set(pwrite, pbegin, pwrite->data.data() + pwrite->data.size());
+    return true;
+}
+
+bool CBlockWriter::ReadPendingBlock(CRawBlock &raw, const CDiskBlockPos &pos) { return GetPending(BLOCK, pos, raw); }
+
+bool CBlockWriter::ReadPendingUndo(CBlockUndo &blockundo, const CDiskBlockPos &pos)
+{
+    CRawBlock raw;
+    if (!GetPending(UNDO, pos, raw))
+        return false;
+    CSpanReader(SER_DISK, CLIENT_VERSION, raw.begin(), raw.end()) >> blockundo;
+    return true;
+}
+
+bool CBlockWriter::WriteBatch(std::vector<CPendingWriteRef> &vBatch)
+{
+    // Records mostly follow each other in the same file, keep it open for the batch
+    FILE *file = nullptr;
+    int nOpenType = -1;
+    int nOpenFile = -1;
+    bool fOk = true;
+    for (const CPendingWriteRef &pwrite : vBatch)
+    {
+        if (pwrite->type != nOpenType || pwrite->nFile != nOpenFile)
+        {
+            if (file)
+                fclose(file);
+            CDiskBlockPos pos(pwrite->nFile, 0);
+            file = pwrite->type == BLOCK ? OpenBlockFile(pos) : OpenUndoFile(pos);
+            nOpenType = pwrite->type;
+            nOpenFile = pwrite->nFile;
+            if (!file)
+            {
+                fOk = error("%s: cannot open %s file %d", __func__, pwrite->type == BLOCK ? "block" : "undo",
+                    pwrite->nFile);
+                break;
+            }
+        }
+        if (fseek(file, pwrite->nWritePos, SEEK_SET) != 0 ||
+            fwrite(pwrite->data.data(), 1, pwrite->data.size(), file) != pwrite->data.size())
+        {
+            fOk = error("%s: cannot write %u bytes at %d:%u", __func__, pwrite->data.size(), pwrite->nFile,
+                pwrite->nWritePos);
+            break;
+        }
+    }
+    // fclose flushes, so the records can be read from the file as soon as they leave mapPending
+    if (file && fclose(file) != 0)
+        fOk = error("%s: cannot flush %s file %d", __func__, nOpenType == BLOCK ? "block" : "undo", nOpenFile);
+    return fOk;
+}
+
+void CBlockWriter::ThreadWriter()
+{
+    RenameThread("blockwriter");
+    std::vector<CPendingWriteRef> vBatch;
+    bool fOk = true;
+    while (fOk)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (queue.empty() && !fStop)
+                cvWork.wait(lock);
+            if (queue.empty())
+                break;
+            vBatch.assign(queue.begin(), queue.end());
+            queue.clear();
+        }
+
+        int64_t nStart = GetTimeMicros();
+        fOk = WriteBatch(vBatch);
+        int64_t nEnd = GetTimeMicros();
+
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            if (!fOk)
+            {
+                // Leave the records pending, so they can still be read, until the node has shut down
+                fFailed = true;
+                cvDone.notify_all();
+                continue;
+            }
+            for (const CPendingWriteRef &pwrite : vBatch)
+            {
+                mapPending.erase(PendingKey(pwrite->type, pwrite->nFile, pwrite->nDataPos));
+                nQueuedBytes -= pwrite->data.size();
+                nBytesWritten += pwrite->data.size();
+                nBlockWriteLatency << (nEnd - pwrite->nQueued);
+            }
+            nWrites += vBatch.size();
+            nTimeWriting += nEnd - nStart;
+            cvDone.notify_all();
+        }
+        vBatch.clear();
+    }
+    if (!fOk)
+        AbortNode("Failed to write block or undo data", "");
+}
@@ -0,0 +1,121 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BLOCKSTORAGE_BLOCKWRITER_H
+#define BLOCKSTORAGE_BLOCKWRITER_H
+
+#include "blockfilemap.h"
+#include "chain.h"
+#include "protocol.h"
+#include "serialize.h"
+#include "stat.h"
+#include "streams.h"
+#include "sync.h"
+#include "undo.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+/** Default for -blockwritequeue, in MiB of serialized blocks and undo data; 0 writes synchronously */
+static const unsigned int DEFAULT_BLOCK_WRITE_QUEUE = 32;
+
+/** Number of blocks and undo records waiting to be written, sampled at every queued write */
+extern CStatHistory<uint64_t> nBlockWriteQueueDepth;
+/** Microseconds from queueing a block or undo record to having it in the file */
+extern CStatHistory<uint64_t> nBlockWriteLatency;
+
+/**
+ * Write-behind stage for the blk?????.dat and rev?????.dat files.
+ *
+ * Blocks and undo data are serialized by the caller, still under cs_main, but
+ * the file writes happen on a thread of their own, so that AcceptBlock and
+ * ConnectBlock do not wait for the disk.  Their position is known up front, as
+ * FindBlockPos and FindUndoPos have already reserved the space.  Until a record
+ * is in the file it is served from memory, so reading it back always works.
+ * FlushBlockFile waits for the queue to drain before it commits the files, so
+ * the block index is never written pointing at data that is not on disk, and
+ * all the writes since the last flush share its fsync.
+ */
+class CBlockWriter
+{
+public:
+    enum Type
+    {
+        BLOCK = 0,
+        UNDO = 1
+    };
+
+private:
+    struct CPendingWrite
+    {
+        Type type;
+        int nFile;
+        unsigned int nWritePos; //! where the record header goes
+        unsigned int nDataPos; //! where the block or undo data starts, what the index refers to
+        CSerializeData data; //! the whole record, header included
+        int64_t nQueued;
+    };
+    typedef std::shared_ptr<const CPendingWrite> CPendingWriteRef;
+    typedef std::tuple<int, int, unsigned int> PendingKey; //! type, file, data position
+
+    CWaitableCriticalSection cs;
+    CConditionVariable cvWork;
+    CConditionVariable cvDone;
+    std::deque<CPendingWriteRef> queue GUARDED_BY(cs);
+    //! Records not in the file yet: the queued ones and those being written
+    std::map<PendingKey, CPendingWriteRef> mapPending GUARDED_BY(cs);
+    size_t nQueuedBytes GUARDED_BY(cs);
+    size_t nMaxQueuedBytes GUARDED_BY(cs);
+    bool fStop GUARDED_BY(cs);
+    bool fFailed GUARDED_BY(cs);
+    std::thread thread;
+
+    // Totals since startup, for the bench log line at every drain. Protected by cs
+    uint64_t nWrites;
+    uint64_t nBytesWritten;
+    uint64_t nQueueFullWaits;
+    int64_t nTimeWriting;
+
+    void ThreadWriter();
+    bool WriteBatch(std::vector<CPendingWriteRef> &vBatch);
+    bool Queue(Type type, CDiskBlockPos &pos, size_t nHeaderSize, CDataStream &ss);
+    bool GetPending(Type type, const CDiskBlockPos &pos, CRawBlock &raw);
+
+public:
+    CBlockWriter();
+    ~CBlockWriter();
+
+    /** Start the writer thread with a queue of at most nMaxBytes; until then writes are synchronous */
+    void Start(size_t nMaxBytes);
+    /** Write out everything queued and stop the thread; writes are synchronous again afterwards */
+    void Stop();
+    bool IsRunning();
+
+    /** Wait until every queued record is in its file. Returns false if a write failed */
+    bool Drain();
+
+    /**
+     * Queue a block, once the thread is running.  pos is where its record
+     * starts and is moved to the block data, as WriteBlockToDiskSequential does.
+     */
+    bool WriteBlock(const CBlock &block, CDiskBlockPos &pos, const CMessageHeader::MessageStartChars &messageStart);
+    /** The same for undo data, followed by its checksum over hashBlock and blockundo */
+    bool WriteUndo(const CBlockUndo &blockundo,
+        CDiskBlockPos &pos,
+        const uint256 &hashBlock,
+        const CMessageHeader::MessageStartChars &messageStart);
+
+    /** Get a block that is not in its file yet, in place in the queue. Returns false if it is not pending */
+    bool ReadPendingBlock(CRawBlock &raw, const CDiskBlockPos &pos);
+    /** Read undo data that is not in its file yet. Returns false if it is not pending */
+    bool ReadPendingUndo(CBlockUndo &blockundo, const CDiskBlockPos &pos);
+};
+
+extern CBlockWriter blockWriter;
+
+#endif // BLOCKSTORAGE_BLOCKWRITER_H
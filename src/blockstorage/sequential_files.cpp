@@ -6,6 +6,8 @@
 
 #include "sequential_files.h"
 
+#include "blockfilemap.h"
+#include "blockwriter.h"
 #include "main.h"
 
 extern bool AbortNode(CValidationState &state, const std::string &strMessage, const std::string &userMessage = "");
@@ -48,17 +50,26 @@ FILE *OpenDiskFile(const CDiskBlockPos &pos, const char *prefix, bool fReadOnly)
 
 FILE *OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly) { return OpenDiskFile(pos, "blk", fReadOnly); }
 FILE *OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly) { return OpenDiskFile(pos, "rev", fReadOnly); }
-void FlushBlockFile(bool fFinalize)
+bool FlushBlockFile(bool fFinalize)
 {
     LOCK(cs_LastBlockFile);
 
+    // Whatever the writer still has queued has to be in the files before they are committed, and before
+    // the block index is written pointing at it
+    if (!blockWriter.Drain())
+        return error("%s: queued block or undo data could not be written", __func__);
+
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld)
     {
         if (fFinalize)
+        {
+            // The preallocated tail is about to go, make sure it is not mapped anymore
+            blockFileMap.Forget(nLastBlockFile);
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -71,17 +82,23 @@ void FlushBlockFile(bool fFinalize)
         FileCommit(fileOld);
         fclose(fileOld);
     }
+    return true;
 }
 
-void UnlinkPrunedFiles(std::set<int> &setFilesToPrune)
+bool UnlinkPrunedFiles(std::set<int> &setFilesToPrune)
 {
+    // Nothing may be left to write into a file once it is gone
+    if (!blockWriter.Drain())
+        return error("%s: queued block or undo data could not be written", __func__);
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it)
     {
         CDiskBlockPos pos(*it, 0);
+        blockFileMap.Forget(*it);
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LOG(PRUNE, "Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
     }
+    return true;
 }
 
 
@@ -89,6 +106,9 @@ bool WriteBlockToDiskSequential(const CBlock &block,
     CDiskBlockPos &pos,
     const CMessageHeader::MessageStartChars &messageStart)
 {
+    if (blockWriter.IsRunning())
+        return blockWriter.WriteBlock(block, pos, messageStart);
+
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
@@ -111,20 +131,44 @@ bool WriteBlockToDiskSequential(const CBlock &block,
     return true;
 }
 
-bool ReadBlockFromDiskSequential(CBlock &block, const CDiskBlockPos &pos, const Consensus::Params &consensusParams)
+/** Point raw at the block at pos in its mapped file, using the size in the record header before it */
+static bool GetMappedBlock(CRawBlock &raw, const CDiskBlockPos &pos)
 {
-    block.SetNull();
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
+    unsigned int nSize;
+    if (pos.nPos < sizeof(nSize))
+        return false;
+    if (!blockFileMap.Get(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(nSize)), sizeof(nSize), raw))
+        return false;
+    CSpanReader(SER_DISK, CLIENT_VERSION, raw.begin(), raw.end()) >> nSize;
+    if (nSize > MAX_BLOCKFILE_SIZE || !blockFileMap.Get(pos, nSize, raw))
     {
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+        raw.SetNull();
+        return false;
     }
+    return true;
+}
 
-    // Read block
+bool ReadBlockFromDiskSequential(CBlock &block, const CDiskBlockPos &pos, const Consensus::Params &consensusParams)
+{
+    block.SetNull();
+    // Read block, from memory if it is still waiting to be written, else in place from the mapped file
     try
     {
-        filein >> block;
+        CRawBlock raw;
+        if (blockWriter.ReadPendingBlock(raw, pos) || GetMappedBlock(raw, pos))
+        {
+            CSpanReader(SER_DISK, CLIENT_VERSION, raw.begin(), raw.end()) >> block;
+        }
+        else
+        {
+            // Open history file to read
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+            {
+                return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+            }
+            filein >> block;
+        }
     }
     catch (const std::exception &e)
     {
@@ -141,6 +185,44 @@ bool ReadBlockFromDiskSequential(CBlock &block, const CDiskBlockPos &pos, const
     return true;
 }
 
+bool ReadRawBlockFromDiskSequential(CRawBlock &raw, const CDiskBlockPos &pos)
+{
+    raw.SetNull();
+    try
+    {
+        if (blockWriter.ReadPendingBlock(raw, pos) || GetMappedBlock(raw, pos))
+            return true;
+    }
+    catch (const std::exception &e)
+    {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    // Without a mapping the block is read into a buffer of its own, with the size from its record header
+    unsigned int nSize;
+    if (pos.nPos < sizeof(nSize))
+        return error("%s: Bad position %s", __func__, pos.ToString());
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(nSize)), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+    {
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+    }
+    try
+    {
+        filein >> nSize;
+        if (nSize > MAX_BLOCKFILE_SIZE)
+            return error("%s: Bad block size %u at %s", __func__, nSize, pos.ToString());
+        std::shared_ptr<CSerializeData> pdata = std::make_shared<CSerializeData>(nSize);
+        filein.read(pdata->data(), nSize);
+        raw.Set(pdata, pdata->data(), pdata->data() + nSize);
+    }
+    catch (const std::exception &e)
+    {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
 /* Calculate the amount of disk space the block & undo files currently use */
 uint64_t CalculateCurrentUsage()
 {
@@ -242,6 +324,9 @@ bool WriteUndoToDiskSequenatial(const CBlockUndo &blockundo,
     const uint256 &hashBlock,
     const CMessageHeader::MessageStartChars &messageStart)
 {
+    if (blockWriter.IsRunning())
+        return blockWriter.WriteUndo(blockundo, pos, hashBlock, messageStart);
+
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
@@ -273,6 +358,17 @@ bool WriteUndoToDiskSequenatial(const CBlockUndo &blockundo,
 
 bool ReadUndoFromDiskSequential(CBlockUndo &blockundo, const CDiskBlockPos &pos, const uint256 &hashBlock)
 {
+    // Undo data still waiting to be written is the one its checksum was computed over
+    try
+    {
+        if (blockWriter.ReadPendingUndo(blockundo, pos))
+            return true;
+    }
+    catch (const std::exception &e)
+    {
+        return error("%s: Deserialize error - %s", __func__, e.what());
+    }
+
     // Open history file to read
     CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
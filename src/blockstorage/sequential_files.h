@@ -7,6 +7,7 @@
 #ifndef BLOCKDB_SEQUENTIAL_H
 #define BLOCKDB_SEQUENTIAL_H
 
+#include "blockfilemap.h"
 #include "net.h"
 #include "txdb.h"
 #include "undo.h"
@@ -23,17 +24,20 @@ FILE *OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 
-void FlushBlockFile(bool fFinalize = false);
+/** Commit the current block and undo files. Returns false if queued block or undo data could not be written */
+bool FlushBlockFile(bool fFinalize = false);
 
 /**
  *  Actually unlink the specified files
  */
-void UnlinkPrunedFiles(std::set<int> &setFilesToPrune);
+bool UnlinkPrunedFiles(std::set<int> &setFilesToPrune);
 
 bool WriteBlockToDiskSequential(const CBlock &block,
     CDiskBlockPos &pos,
     const CMessageHeader::MessageStartChars &messageStart);
 bool ReadBlockFromDiskSequential(CBlock &block, const CDiskBlockPos &pos, const Consensus::Params &consensusParams);
+/** Get the serialized block at pos without deserializing it, in place where the file is mapped */
+bool ReadRawBlockFromDiskSequential(CRawBlock &raw, const CDiskBlockPos &pos);
 void FindFilesToPruneSequential(std::set<int> &setFilesToPrune, uint64_t nPruneAfterHeight);
 bool WriteUndoToDiskSequenatial(const CBlockUndo &blockundo,
     CDiskBlockPos &pos,
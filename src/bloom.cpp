@@ -374,77 +374,3 @@ void CRollingBloomFilter::reset()
         *it = 0;
     }
 }
-
-//add for diskcoin -->
-#define Nhfn 6
-#define Nhbit (POC_FILTER_FLEN*8)
-#define Nmsync 100
-#define Nsyncsec 120
-
-bool CPocBloomFilter::load (const char *path) {
-    strncpy(this->path, path, sizeof(this->path)-1); //save it first, because sync need it.
-
-    if (read_bin_file (this->path, this->data, sizeof(this->data)) != sizeof(this->data)) {
-        return false;
-    }
-
-    this->nModify = 0;
-    this->nFirstMdyTime = GetTime();
-    return true;
-}
-
-void CPocBloomFilter::clear() {
-    memset (this->data, 0, sizeof(this->data));
-    this->nModify = 1;
-    this->nFirstMdyTime = GetTime();
-}
-
-bool CPocBloomFilter::sync () {
-    //assert (this->path);
-    if (this->nModify == 0) {
-        return true;
-    }
-
-    if (write_bin_file (this->path, this->data, sizeof(this->data)) != sizeof(this->data)) {
-        LOGAF("Failed to sync %s", this->path);
-        return false;
-    }
-    LOGAF("Succeed to sync %s, nsync: %llu, %s", this->path, this->nModify, 
-        DateTimeStrFormat("%Y-%m-%d %H:%M:%S", this->nFirstMdyTime));
-
-    this->nModify = 0;
-    this->nFirstMdyTime = GetTime();
-    return true;
-}
-
-void CPocBloomFilter::insert(const uint256 &hash) {
-    std::vector<unsigned char> vKey(hash.begin(), hash.end());
-
-    for (unsigned int i = 0; i < Nhfn; i++) {
-        unsigned int nIndex = MurmurHash3(i * 0xFBA4C795 + 0x49393, vKey) % Nhbit;
-        // Sets bit nIndex of this->data
-        this->data[nIndex >> 3] |= (1 << (7 & nIndex));
-    }
-    this->nModify++;
-    
-    if (this->nModify >= (Nmsync >> 3)) {
-        if (this->nModify >= Nmsync || this->nFirstMdyTime + Nsyncsec < GetTime()) {
-            this->sync();
-        }
-    }
-}
-
-bool CPocBloomFilter::contains(const uint256 &hash) const {
-    std::vector<unsigned char> vKey(hash.begin(), hash.end());
-
-    for (unsigned int i = 0; i < Nhfn; i++) {
-        unsigned int nIndex = MurmurHash3(i * 0xFBA4C795 + 0x49393, vKey) % Nhbit;
-        // Checks bit nIndex of this->data
-        if (!(this->data[nIndex >> 3] & (1 << (7 & nIndex)))){
-            return false;
-        }
-    }
-    return true;
-}
-
-//<--
@@ -184,31 +184,4 @@ private:
     int nHashFuncs;
 };
 
-//add for diskcoin -->
-#define POC_FILTER_FLEN (10*1024*1024)
-
-class CPocBloomFilter
-{
-public:
-    uint64_t nModify;
-    uint64_t nFirstMdyTime;
-public:
-    CPocBloomFilter() {
-        path[0] = '\0';
-        nModify = 0;
-        nFirstMdyTime = 0;
-    }
-
-    bool load(const char *path); //allow call once
-    void clear();
-    bool sync();
-
-    void insert(const uint256 &hash);
-    bool contains(const uint256 &hash) const;
-private:
-    char path[1024];
-    char data[POC_FILTER_FLEN];
-};
-//<--
-
 #endif // BITCOIN_BLOOM_H
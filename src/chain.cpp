@@ -17,9 +17,9 @@ void CalculateSignature(const CBlockIndex *pindex, unsigned char* sig)
 {
 	unsigned char data[32+8+sizeof(uint256)+1] = {};
     
-    uint64_t plotter_id = pindex->GetBlockHeader().nPlotterId;
+    uint64_t plotter_id = pindex->nPlotterId;
 
-    memcpy(data, pindex->GetBlockHeader().sig, 32);
+    memcpy(data, pindex->sig, 32);
     memcpy(data+32, &plotter_id, sizeof(plotter_id));
     memcpy(data+40, pindex->phashBlock, sizeof(uint256));
 
@@ -60,7 +60,7 @@ uint64_t CalculateBaseTarget(const CBlockIndex *pindex)
         const CBlockIndex *it_block = cur_block;
         do
         {   
-            avg_base_target += it_block->GetBlockHeader().nBaseTarget;
+            avg_base_target += it_block->nBaseTarget;
             it_block = it_block->pprev;
         }while(it_block->nHeight>cur_height-4);
 
@@ -74,14 +74,14 @@ uint64_t CalculateBaseTarget(const CBlockIndex *pindex)
     else
     {
         const CBlockIndex *it_block = cur_block->pprev;
-        uint64_t avg_base_target = it_block->GetBlockHeader().nBaseTarget;
+        uint64_t avg_base_target = it_block->nBaseTarget;
         int block_counter = 1;
         do
         {
             it_block = it_block->pprev;
             block_counter++;
             avg_base_target = (avg_base_target*block_counter + 
-                it_block->GetBlockHeader().nBaseTarget) / (block_counter+1);
+                it_block->nBaseTarget) / (block_counter+1);
         }while(block_counter < 24);
 
         uint32_t dif_time = cur_block->nTime - it_block->nTime;
@@ -97,7 +97,7 @@ uint64_t CalculateBaseTarget(const CBlockIndex *pindex)
             dif_time = target_time_span * 2;
         }
 
-        cur_base_target = cur_block->pprev->GetBlockHeader().nBaseTarget;
+        cur_base_target = cur_block->pprev->nBaseTarget;
         new_base_target = avg_base_target * dif_time / target_time_span;
 
         updownPercent = 20;
@@ -129,44 +129,18 @@ uint64_t CalculateBaseTarget(const CBlockIndex *pindex)
 	return new_base_target;
 }
 
-uint64_t CChain::GetBaseTarget()
+uint64_t CChain::GetBaseTarget() const
 {
-    static int height = 0;
-    static uint64_t base_target = 0;
-
-    int cur_height = this->Height();
-    if (cur_height == height && 0 != base_target)
-    {
-        return base_target;
-    }
-
-    const CBlockIndex *cur_block = (*this)[cur_height];
-
-    base_target = CalculateBaseTarget(cur_block);
-    
-    height = cur_height;
-
-    return base_target;
+    const CBlockIndex *tip = Tip();
+    assert(tip);
+    return tip->nNextBaseTarget;
 }
 
-const unsigned char* CChain::GetGenerationSignature()
+const unsigned char* CChain::GetGenerationSignature() const
 {
-    static int height = -1;
-    static unsigned char gensig[32] = {};
-
-    int64_t cur_height = this->Height();
-    if (cur_height == height)
-    {
-        return gensig;
-    }
-
-	const CBlockIndex *cur_block = (*this)[cur_height];
-
-    CalculateSignature(cur_block, gensig);
-
-	height = cur_height;
-    
-    return gensig;
+    const CBlockIndex *tip = Tip();
+    assert(tip);
+    return tip->nextGenSig;
 }
 
 /**
@@ -289,6 +263,53 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+void CBlockIndex::BuildPocNext()
+{
+    nNextBaseTarget = CalculateBaseTarget(this);
+    CalculateSignature(this, nextGenSig);
+    nStatus |= BLOCK_HAVE_POC_NEXT;
+}
+
+CBlockIndex *CBlockIndexArena::Allocate(size_t n)
+{
+    LOCK(cs);
+    if (vSlabs.empty() || nSlabUsed + n > vSlabs.back().second)
+    {
+        size_t nSize = std::max(n, SLAB_ENTRIES);
+        vSlabs.push_back(std::make_pair(new CBlockIndex[nSize], nSize));
+        nSlabUsed = 0;
+    }
+    CBlockIndex *pindex = vSlabs.back().first + nSlabUsed;
+    nSlabUsed += n;
+    nAllocated += n;
+    return pindex;
+}
+
+void CBlockIndexArena::Clear()
+{
+    LOCK(cs);
+    for (const std::pair<CBlockIndex *, size_t> &slab : vSlabs)
+        delete[] slab.first;
+    vSlabs.clear();
+    nSlabUsed = 0;
+    nAllocated = 0;
+}
+
+size_t CBlockIndexArena::size() const
+{
+    LOCK(cs);
+    return nAllocated;
+}
+
+size_t CBlockIndexArena::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    size_t nBytes = 0;
+    for (const std::pair<CBlockIndex *, size_t> &slab : vSlabs)
+        nBytes += slab.second * sizeof(CBlockIndex);
+    return nBytes;
+}
+
 /** Member helper functions needed to implement time based fork activation
  *
  * In the following comments x-1 is used to identify the first block for which GetMedianTimePast()
@@ -10,6 +10,7 @@
 #include "arith_uint256.h"
 #include "pow.h"
 #include "primitives/block.h"
+#include "sync.h"
 #include "tinyformat.h"
 #include "uint256.h"
 #include "util.h"
@@ -151,6 +152,8 @@ enum BlockStatus : uint32_t
     BLOCK_FAILED_VALID = 64, //! stage after last reached validness failed
     BLOCK_FAILED_CHILD = 128, //! descends from failed block
     BLOCK_FAILED_MASK = BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
+
+    BLOCK_HAVE_POC_NEXT = 256, //! nNextBaseTarget and nextGenSig are stored with the index
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -161,8 +164,9 @@ enum BlockStatus : uint32_t
 class CBlockIndex
 {
 public:
-    //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
-    const uint256 *phashBlock;
+    // The members are ordered by how often they are touched: what ancestor walks, GetAncestor and
+    // the base target computation read comes first, in one cache line; the file positions, the
+    // signatures and the rest of the header, needed only when the block itself is looked at, last.
 
     //! pointer to the index of the predecessor of this block
     CBlockIndex *pprev;
@@ -173,44 +177,59 @@ public:
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
-    //! Which # file this block is stored in (blk?????.dat)
-    int nFile;
+    unsigned int nTime;
 
-    //! Byte offset within blk?????.dat where this block's data is stored
-    unsigned int nDataPos;
+    // diskcoin
+    uint64_t nBaseTarget;
 
-    //! Byte offset within rev?????.dat where this block's undo data is stored
-    unsigned int nUndoPos;
+    //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
+    const uint256 *phashBlock;
 
-    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
-    arith_uint256 nChainWork;
+    //! Verification status of this block. See enum BlockStatus
+    unsigned int nStatus;
 
-    //! Number of transactions in this block.
-    //! Note: in a potential headers-first mode, this number cannot be relied upon
-    unsigned int nTx;
+    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
+    uint32_t nSequenceId;
 
     //! (memory only) Number of transactions in the chain up to and including this block.
     //! This value will be non-zero only if and only if transactions for this block and all its parents are available.
     uint64_t nChainTx;
 
-    //! Verification status of this block. See enum BlockStatus
-    unsigned int nStatus;
+    unsigned int nBits;
+
+    //! Number of transactions in this block.
+    //! Note: in a potential headers-first mode, this number cannot be relied upon
+    unsigned int nTx;
+
+    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
+    arith_uint256 nChainWork;
+
+    //! (memory only) Median time past of this entry once BuildMedianTimePast() ran, 0 before
+    int64_t nMedianTimePast;
 
     //! block header
     int nVersion;
+
+    //! Which # file this block is stored in (blk?????.dat)
+    int nFile;
+
+    //! Byte offset within blk?????.dat where this block's data is stored
+    unsigned int nDataPos;
+
+    //! Byte offset within rev?????.dat where this block's undo data is stored
+    unsigned int nUndoPos;
+
     uint256 hashMerkleRoot;
-    unsigned int nTime;
-    unsigned int nBits;
 
     // diskcoin
     unsigned char sig[32];
-    uint64_t nBaseTarget;
     uint64_t nPlotterId;
     uint64_t nNonce;
     uint64_t nDeadline;
 
-    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
-    uint32_t nSequenceId;
+    //! base target and generation signature a child of this block must carry
+    uint64_t nNextBaseTarget;
+    unsigned char nextGenSig[32];
 
 
     void SetNull()
@@ -223,6 +242,7 @@ public:
         nDataPos = 0;
         nUndoPos = 0;
         nChainWork = arith_uint256();
+        nMedianTimePast = 0;
         nTx = 0;
         nChainTx = 0;
         nStatus = 0;
@@ -239,6 +259,8 @@ public:
         nPlotterId = 0;
         nDeadline = 0;
         memset(sig, 0x00, 32);
+        nNextBaseTarget = 0;
+        memset(nextGenSig, 0x00, sizeof(nextGenSig));
     }
 
     CBlockIndex() { SetNull(); }
@@ -327,6 +349,14 @@ public:
     };
 
     int64_t GetMedianTimePast() const
+    {
+        if (nMedianTimePast != 0)
+            return nMedianTimePast;
+        return CalculateMedianTimePast();
+    }
+
+    //! The median of the times of this entry and its nMedianTimeSpan - 1 ancestors, walking pprev
+    int64_t CalculateMedianTimePast() const
     {
         int64_t pmedian[nMedianTimeSpan];
         int64_t *pbegin = &pmedian[nMedianTimeSpan];
@@ -378,6 +408,13 @@ public:
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
 
+    //! Store the median time past, which never changes once pprev is set. Header checks, fork
+    //! activation and every mempool acceptance ask for it, so they get it without walking the chain.
+    void BuildMedianTimePast() { nMedianTimePast = CalculateMedianTimePast(); }
+
+    //! diskcoin: compute nNextBaseTarget and nextGenSig. Needs phashBlock, pprev and the ancestor headers.
+    void BuildPocNext();
+
     //! Efficiently find an ancestor of this block.
     CBlockIndex *GetAncestor(int height);
     const CBlockIndex *GetAncestor(int height) const;
@@ -443,9 +480,26 @@ public:
         {
 			READWRITE(sig[i]);
         }
+        if (nStatus & BLOCK_HAVE_POC_NEXT)
+        {
+            try
+            {
+                READWRITE(nNextBaseTarget);
+                READWRITE(FLATDATA(nextGenSig));
+            }
+            catch (const std::ios_base::failure &)
+            {
+                // An older binary that rewrote the entry kept the flag but not the values after it. Read them
+                // as absent, LoadBlockIndexDB computes them again
+                if (!ser_action.ForRead())
+                    throw;
+                nStatus &= ~BLOCK_HAVE_POC_NEXT;
+            }
+        }
     }
 
-    uint256 GetBlockHash() const
+    //! The header as stored, with hashPrev in place of the not yet linked pprev
+    CBlockHeader GetBlockHeader() const
     {
         CBlockHeader block;
         block.nVersion = nVersion;
@@ -461,9 +515,11 @@ public:
 		block.nDeadline = nDeadline;
 		memcpy(block.sig, sig, sizeof(sig));
         
-        return block.GetHash();
+        return block;
     }
 
+    uint256 GetBlockHash() const { return GetBlockHeader().GetHash(); }
+
 
     std::string ToString() const
     {
@@ -475,6 +531,40 @@ public:
     }
 };
 
+/**
+ * Storage for the entries of mapBlockIndex.  They are handed out of large
+ * slabs rather than allocated one by one, which saves the allocator overhead
+ * of every entry and keeps entries that are created together, like the whole
+ * index loaded at startup in height order, next to each other in memory.
+ * Entries are never freed on their own: they all go at once in Clear(), when
+ * the block index is unloaded.
+ */
+class CBlockIndexArena
+{
+private:
+    mutable CCriticalSection cs;
+    std::vector<std::pair<CBlockIndex *, size_t> > vSlabs GUARDED_BY(cs); //! start and size
+    size_t nSlabUsed GUARDED_BY(cs); //! entries handed out of the last slab
+    size_t nAllocated GUARDED_BY(cs);
+
+public:
+    //! entries in a slab, unless more are asked for at once
+    static const size_t SLAB_ENTRIES = 4096;
+
+    CBlockIndexArena() : nSlabUsed(0), nAllocated(0) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    //! n null entries, next to each other
+    CBlockIndex *Allocate(size_t n = 1);
+    //! Destroy every entry handed out
+    void Clear();
+
+    //! entries handed out
+    size_t size() const;
+    //! bytes held, whether handed out or not
+    size_t DynamicMemoryUsage() const;
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain
 {
@@ -533,10 +623,10 @@ public:
     const CBlockIndex *FindFork(const CBlockIndex *pindex) const;
 
     /** diskcoin: get current height baseTarget. */
-    uint64_t GetBaseTarget();
+    uint64_t GetBaseTarget() const;
 
     /** diskcoin: get current height generationSignature. */
-    const unsigned char* GetGenerationSignature();
+    const unsigned char* GetGenerationSignature() const;
 };
 
 #endif // BITCOIN_CHAIN_H
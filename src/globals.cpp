@@ -13,6 +13,8 @@
 #include "blockrelay/compactblock.h"
 #include "blockrelay/graphene.h"
 #include "blockrelay/thinblock.h"
+#include "blockstorage/blockfilemap.h"
+#include "blockstorage/blockwriter.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "clientversion.h"
@@ -45,6 +47,8 @@
 #include "version.h"
 #include "versionbits.h"
 #include "bloom.h"
+#include "plotterstats.h"
+#include "pocfilter.h"
 
 #include <atomic>
 #include <boost/lexical_cast.hpp>
@@ -76,12 +80,12 @@ int64_t nTimeOffset = 0;
 CCriticalSection cs_rpcWarmup;
 
 //add for diskcoin -->
-CSharedCriticalSection cs_pocfilter;
-CPocBloomFilter *pPocFilter;
+CPocFilter *pPocFilter;
 //<--
 
 CSharedCriticalSection cs_mapBlockIndex;
 BlockMap mapBlockIndex GUARDED_BY(cs_mapBlockIndex);
+CBlockIndexArena blockIndexArena;
 
 CCriticalSection cs_main;
 CChain chainActive GUARDED_BY(cs_main); // however, chainActive.Tip() is lock free
@@ -438,6 +442,10 @@ CStatHistory<uint64_t> sendAmt;
 CStatHistory<uint64_t> nTxValidationTime("txValidationTime", STAT_OP_MAX | STAT_INDIVIDUAL);
 CCriticalSection cs_blockvalidationtime;
 CStatHistory<uint64_t> nBlockValidationTime("blockValidationTime", STAT_OP_MAX | STAT_INDIVIDUAL);
+CStatHistory<uint64_t> nMinerTemplateTime("miner/templateTime", STAT_OP_MAX | STAT_INDIVIDUAL);
+CStatHistory<uint64_t> nMinerReleaseDelay("miner/releaseDelay", STAT_OP_MAX | STAT_INDIVIDUAL);
+CStatHistory<uint64_t> nBlockWriteQueueDepth("blockWriter/queueDepth", STAT_OP_MAX | STAT_INDIVIDUAL);
+CStatHistory<uint64_t> nBlockWriteLatency("blockWriter/latency", STAT_OP_MAX | STAT_INDIVIDUAL);
 
 // Single classes for gather thin type block relay statistics
 CThinBlockData thindata;
@@ -445,6 +453,15 @@ CGrapheneBlockData graphenedata;
 CCompactBlockData compactdata;
 ThinTypeRelay thinrelay;
 
+// Share accounting and rate limiting of the plotters submitting nonces
+CPlotterStats plotterStats;
+
+// Write-behind stage of the block and undo files, after the stats it records into
+CBlockWriter blockWriter;
+
+// Mappings of the most recently read block files
+CBlockFileMap blockFileMap;
+
 uint256 bitcoinCashForkBlockHash = uint256S("000000000000000000651ef99cb9fcbe0dadde1d424bd9f15ff20136191a5eec");
 
 map<int64_t, CMiningCandidate> miningCandidatesMap GUARDED_BY(cs_main);
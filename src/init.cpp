@@ -13,6 +13,7 @@
 #include "addrman.h"
 #include "amount.h"
 #include "blockstorage/blockstorage.h"
+#include "blockstorage/blockwriter.h"
 #include "blockstorage/sequential_files.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -31,8 +32,11 @@
 #include "key.h"
 #include "main.h"
 #include "miner.h"
+#include "mininginfo.h"
 #include "net.h"
 #include "parallel.h"
+#include "plotterstats.h"
+#include "pocverify.h"
 #include "policy/policy.h"
 #include "rpc/register.h"
 #include "rpc/server.h"
@@ -52,6 +56,7 @@
 #include "validation/verifydb.h"
 #include "validationinterface.h"
 #include "shabal/stakedb.h"
+#include "shabal/sph_shabal.h"
 
 #ifdef ENABLE_WALLET
 #include "wallet/db.h"
@@ -188,6 +193,7 @@ void Interrupt(thread_group &threadGroup)
     // stop TxAdmission needs to be done before threadGroup tries to join_all
     // we only join_all after Interrupt so call StopTxAdmission here
     StopTxAdmission();
+    StopPocVerify();
 }
 
 void Shutdown()
@@ -225,6 +231,7 @@ void Shutdown()
         pwalletMain->Flush(false);
 #endif
     GenerateBitcoins(false, 0, Params());
+    UnregisterSubmitCache();
     StopTxAdmission();
     StopNode();
     StopTorControl();
@@ -234,6 +241,9 @@ void Shutdown()
         DumpMempool();
     }
 
+    if (pPocFilter)
+        pPocFilter->sync();
+
     if (fFeeEstimatesInitialized)
     {
         fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
@@ -251,6 +261,8 @@ void Shutdown()
         {
             FlushStateToDisk();
         }
+        // Anything still queued was flushed above, writes are synchronous from here on
+        blockWriter.Stop();
         delete pcoinsTip;
         pcoinsTip = NULL;
         delete pcoinscatcher;
@@ -871,6 +883,11 @@ bool AppInit2(Config &config, thread_group &threadGroup)
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LOGA("Using the '%s' SHA256 implementation\n", sha256_algo);
+    // the SIMD kernels decide which blocks and shares are valid, never trust one that disagrees with calc_dl
+    const std::string strShabalKernel = calc_dl_kernel_name();
+    if (!calc_dl_self_test())
+        LOGA("The '%s' Shabal deadline kernel gives wrong deadlines on this CPU, not using it\n", strShabalKernel);
+    LOGA("Using the '%s' Shabal deadline kernel\n", calc_dl_kernel_name());
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
 
@@ -910,16 +927,22 @@ bool AppInit2(Config &config, thread_group &threadGroup)
         OpenDebugLog();
 
     //add for diskcoin-->
-    fs::path pocFilterFile = GetDataDir() / "pocfilter.dat";
+    fs::path pocFilterFile = GetDataDir() / "pocverified.dat";
     LOGA("pocfilter path: %s", pocFilterFile.string());
-    pPocFilter = new CPocBloomFilter();
+    pPocFilter = new CPocFilter();
     if (!pPocFilter) {
         return InitError(_("Failed to alloc pocfilter memory."));
     }
-    if (!pPocFilter->load(pocFilterFile.string().c_str())) {
+    if (!pPocFilter->load(pocFilterFile)) {
         LOGA(_("Using zero pocfilter."));
         pPocFilter->clear();
     }
+    // the old bloom filter file is replaced by the verified header file above
+    fs::path pocBloomFile = GetDataDir() / "pocfilter.dat";
+    if (fs::exists(pocBloomFile)) {
+        LOGA("Removing obsolete %s", pocBloomFile.string());
+        fs::remove(pocBloomFile);
+    }
 
     fs::path stakeFile = GetDataDir() / "stakedb.dat";
     LOGA("stakedb path: %s", stakeFile.string());
@@ -927,6 +950,9 @@ bool AppInit2(Config &config, thread_group &threadGroup)
         LOGA("Failed to load stakedb.");
         return InitError("Failed to load stakedb");
     }
+    stakedb_register_signals();
+    RegisterMiningInfo();
+    RegisterSubmitCache();
     //<--
 
 #ifdef ENABLE_WALLET
@@ -1106,6 +1132,9 @@ bool AppInit2(Config &config, thread_group &threadGroup)
 
     bool fLoaded = false;
     StartTxAdmission(threadGroup);
+    StartPocVerify(threadGroup);
+    blockWriter.Start(std::max(GetArg("-blockwritequeue", DEFAULT_BLOCK_WRITE_QUEUE), (int64_t)0) * 1024 * 1024);
+    StartPocFilterFlush(threadGroup, pPocFilter);
     while (!fLoaded)
     {
         bool fReset = fReindex;
@@ -1182,6 +1211,13 @@ bool AppInit2(Config &config, thread_group &threadGroup)
                     break;
                 }
 
+                // Check for changed -pledgeindex state
+                if (fPledgeIndex != GetBoolArg("-pledgeindex", DEFAULT_PLEDGEINDEX))
+                {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -pledgeindex");
+                    break;
+                }
+
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
                 if (fHavePruned && !fPruneMode)
@@ -1216,6 +1252,11 @@ bool AppInit2(Config &config, thread_group &threadGroup)
                     strLoadError = _("Corrupted block database detected");
                     break;
                 }
+                if (!SyncPledgeAddressIndex(chainparams.GetConsensus()))
+                {
+                    strLoadError = _("Error bringing the pledge address index to the chain tip");
+                    break;
+                }
             }
             catch (const std::exception &e)
             {
@@ -1349,6 +1390,12 @@ bool AppInit2(Config &config, thread_group &threadGroup)
     }
     IsChainNearlySyncdInit(); // BUIP010 XTHIN: initialize fIsChainNearlySyncd
     IsInitialBlockDownloadInit();
+    {
+        // Tip notifications only start once a block is connected outside of IBD
+        LOCK(cs_main);
+        if (chainActive.Tip())
+            UpdateMiningInfo(chainActive.Tip());
+    }
 
     std::vector<fs::path> vImportFiles;
     if (mapArgs.count("-loadblock"))
@@ -1542,6 +1589,8 @@ bool AppInit2(Config &config, thread_group &threadGroup)
     // ********************************************************* Step 11: start node
 
 	// diskcoin
+	plotterStats.SetLimits(GetArg("-plottershareburst", DEFAULT_PLOTTER_SHARE_BURST),
+		GetArg("-plottersharerate", DEFAULT_PLOTTER_SHARE_RATE));
 	{
 		auto pids = mapMultiArgs["-addblackplotterid"];
 		for (auto it = pids.begin(); it != pids.end(); it++)
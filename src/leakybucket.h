@@ -9,7 +9,10 @@
 #include "config/bitcoin-config.h"
 #endif
 
+#include <assert.h>
+#include <chrono>
 #include <limits>
+#include <stdint.h>
 
 // Variables for traffic shaping
 extern const int64_t DEFAULT_MAX_RECV_BURST;
@@ -78,6 +78,7 @@
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
+bool fPledgeIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -707,10 +708,8 @@ void MainCleanup()
 {
     {
         WRITELOCK(cs_mapBlockIndex); // BU apply the appropriate lock so no contention during destruction
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
     }
 
     {
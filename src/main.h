@@ -24,6 +24,7 @@
 #include "txdb.h"
 #include "versionbits.h"
 #include "bloom.h"
+#include "pocfilter.h"
 
 #include <algorithm>
 #include <exception>
@@ -179,10 +180,11 @@ extern CTxMemPool mempool;
 typedef boost::unordered_map<uint256, CBlockIndex *, BlockHasher> BlockMap;
 extern CSharedCriticalSection cs_mapBlockIndex;
 extern BlockMap mapBlockIndex;
+//! Owns the entries of mapBlockIndex
+extern CBlockIndexArena blockIndexArena;
 
 //add for diskcoin -->
-extern CSharedCriticalSection cs_pocfilter;
-extern CPocBloomFilter *pPocFilter;
+extern CPocFilter *pPocFilter;
 //<--
 
 extern uint64_t nLastBlockTx;
@@ -192,6 +194,7 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern bool fTxIndex;
+extern bool fPledgeIndex;
 extern bool fIsBareMultisigStd;
 extern unsigned int nBytesPerSigOp;
 extern bool fCheckBlockIndex;
@@ -22,6 +22,7 @@
 #include "pow.h"
 #include "primitives/transaction.h"
 #include "script/standard.h"
+#include "stakereward.h"
 #include "timedata.h"
 #include "txmempool.h"
 #include "unlimited.h"
@@ -249,6 +250,15 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript &sc
     CBlockIndex *pindexPrev = chainActive.Tip();
     assert(pindexPrev); // can't make a new block if we don't even have the genesis block
 
+    //add for diskcoin -->
+    // A template built ahead of a submission already carries the PoC values of its parent,
+    // the miner patches the nonce, plotter and deadline in when it is released
+    if (!pSubmit) {
+        pblock->nBaseTarget = pindexPrev->nNextBaseTarget;
+        memcpy(pblock->sig, pindexPrev->nextGenSig, 32);
+    }
+    //<--
+
     int nStakeHeight = stakedb_restep_to (pindexPrev);
     LOGAF("try added self %d, next->%d, nStakeHeight:%d", pindexPrev->nHeight, pindexPrev->nHeight+1, nStakeHeight);
     if (nStakeHeight < 0) {
@@ -258,18 +268,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript &sc
         // throw std::runtime_error(strprintf("Failed to restep_to %d, cancel new block", pindexPrev->nHeight));
     }
 
-    // uint64_t uPledge = GetWalletAddressPledge(scriptPubKeyIn);
-    // uint32_t uMinedBlockNum = GetWalletAddressMinedBlock(scriptPubKeyIn) + 1;
-
     CTxDestination addrDest;
     if (!ExtractDestination(scriptPubKeyIn, addrDest)) {
         throw std::runtime_error(strprintf("%s:%d: attacks-coinbase-addr2.", __func__, __LINE__));
     }
-    std::string addr = EncodeDestination(addrDest);
-    uint64_t uPledge = stakedb_get_stake(addr.c_str());
-    uint32_t uMinedBlockNum = stakedb_get_mined (addr.c_str()) + 1;
-
-    if (uMinedBlockNum == 0) {
+    CStakeReward reward;
+    if (!GetStakeReward(pindexPrev->nHeight + 1, scriptPubKeyIn, chainparams.GetConsensus(), reward)) {
         throw std::runtime_error(strprintf("%s:%d: attacks-coinbase-minednum.", __func__, __LINE__));
     }
     //<--
@@ -296,7 +300,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript &sc
         nLastBlockTx = nBlockTx;
         nLastBlockSize = nBlockSize;
         LOGA("CreateNewBlock(): total size %llu txs: %llu fees: %lld sigops %u. uPledge=%lu, mined=%d\n", nBlockSize, nBlockTx, nFees,
-            nBlockSigOps, uPledge, uMinedBlockNum);
+            nBlockSigOps, reward.nPledge, reward.nMinedBlocks);
 
         bool canonical = enableCanonicalTxOrder.Value();
         // On BCH always allow overwite of enableCanonicalTxOrder but not for regtest
@@ -321,13 +325,11 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript &sc
             pblocktemplate->vTxSigOps.push_back(txe->GetSigOpCount());
         }
 
-        // uint64_t uPledge = GetWalletAddressPledge(); // deadlock !!!
         //get minersubsidy first
-        CAmount nMinerValue = GetBlockMinerSubsidy(nHeight, chainparams.GetConsensus(), uPledge, uMinedBlockNum);
         // CAmount nFundValue = GetBlockFundSubsidy(nHeight, chainparams.GetConsensus(), uPledge);
         // CAmount nMinerValue = nFees + GetBlockMinerSubsidy(nHeight, chainparams.GetConsensus(), uPledge);
-        CAmount nFundValue = GetBlockSubsidy(nHeight, chainparams.GetConsensus()) - nMinerValue;
-        nMinerValue += nFees;
+        CAmount nFundValue = reward.nFundValue;
+        CAmount nMinerValue = reward.nMinerValue + nFees;
         pblock->vtx[0] =
             coinbaseTx(scriptFundPubKeyIn, scriptPubKeyIn,  nHeight, nFundValue, nMinerValue);
         pblocktemplate->vTxFees[0] = -nFees;
@@ -0,0 +1,155 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mininginfo.h"
+
+#include "chain.h"
+#include "crypto/aes.h"
+#include "httpserver.h"
+#include "sync.h"
+#include "threadgroup.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+
+//! serializes publishing, and lets long polls wait for it
+static CWaitableCriticalSection cs_mininginfo;
+static CConditionVariable cvMiningInfo;
+//! only accessed through std::atomic_load and std::atomic_store
+static std::shared_ptr<const CMiningInfo> pMiningInfo;
+
+//! long polls waiting in WaitMiningInfo, each of them holding an HTTP worker
+static int nLongPolls GUARDED_BY(cs_mininginfo) = 0;
+
+//! height of the block last passed to MarkMiningInfoStale
+static std::atomic<int> nStaleHeight{-1};
+static std::atomic<uint64_t> nReads{0};
+static std::atomic<uint64_t> nStaleReads{0};
+
+class CMiningInfoListener : public CValidationInterface
+{
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindex) override { UpdateMiningInfo(pindex); }
+};
+static CMiningInfoListener miningInfoListener;
+
+static std::shared_ptr<const CMiningInfo> BuildMiningInfo(const CBlockIndex *pindexTip)
+{
+    std::shared_ptr<CMiningInfo> info = std::make_shared<CMiningInfo>();
+    info->hashTip = pindexTip->GetBlockHash();
+    info->nTipTime = pindexTip->nTime;
+    info->nHeight = pindexTip->nHeight + 1;
+    info->nBaseTarget = pindexTip->nNextBaseTarget;
+
+    memcpy(info->genSig, pindexTip->nextGenSig, 32);
+
+    const unsigned char *plain = info->genSig;
+    bool need_encrypt = false; //encrypt anyway
+    unsigned char cipher[33];
+
+    if (need_encrypt) {
+        unsigned char key[32];
+        snprintf((char*)key, sizeof(key)-1, "DISKCOIN%-8d", info->nHeight);
+        AES128Encrypt enc(key);
+        enc.Encrypt(&cipher[0], plain);
+        enc.Encrypt(&cipher[16], plain+16);
+        plain = cipher;
+    }
+    info->strGenSig = HexEncode(plain, 32);
+    // int32 max value if encrypted, uint32 max value if not
+    info->nTargetDeadline = need_encrypt ? 2147483647 : 4294967295;
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("height", info->nHeight);
+    result.pushKV("baseTarget", i64tostr(info->nBaseTarget));
+    result.pushKV("generationSignature", info->strGenSig);
+    result.pushKV("targetDeadline", info->nTargetDeadline);
+    info->strJSON = result.write() + "\n";
+    info->result = std::move(result);
+    return info;
+}
+
+std::shared_ptr<const CMiningInfo> UpdateMiningInfo(const CBlockIndex *pindexTip)
+{
+    std::shared_ptr<const CMiningInfo> info;
+    bool fNew = false;
+    {
+        boost::unique_lock<boost::mutex> lock(cs_mininginfo);
+        info = std::atomic_load(&pMiningInfo);
+        if (!info || info->hashTip != pindexTip->GetBlockHash())
+        {
+            // cheap enough to build under the lock, which serializes publishers. Updates are not ordered by
+            // height or work, the last tip passed in is published, as for the other UpdatedBlockTip listeners
+            info = BuildMiningInfo(pindexTip);
+            std::atomic_store(&pMiningInfo, info);
+            fNew = true;
+        }
+        // a block marked as being connected on top of this tip was not connected, or disconnected since
+        if (nStaleHeight.load() >= info->nHeight)
+            nStaleHeight.store(-1);
+    }
+    if (!fNew)
+        return info;
+    cvMiningInfo.notify_all();
+    LOG(RPC, "Mining info for height %d: %s\n", info->nHeight, info->strGenSig);
+    return info;
+}
+
+std::shared_ptr<const CMiningInfo> GetMiningInfo()
+{
+    std::shared_ptr<const CMiningInfo> info = std::atomic_load(&pMiningInfo);
+    if (info)
+    {
+        nReads++;
+        if (nStaleHeight.load() >= info->nHeight)
+            nStaleReads++;
+    }
+    return info;
+}
+
+std::shared_ptr<const CMiningInfo> WaitMiningInfo(const std::string &strGenSig, int64_t nTimeoutMs)
+{
+    std::shared_ptr<const CMiningInfo> info = std::atomic_load(&pMiningInfo);
+    if (!info || info->strGenSig != strGenSig)
+        return GetMiningInfo();
+
+    // Leave at least one HTTP worker to submitNonce and every other call, past that polls are answered at once
+    static const int nMaxLongPolls = std::max((int)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS) - 1, 0);
+    boost::system_time until = boost::get_system_time() + boost::posix_time::milliseconds(nTimeoutMs);
+    {
+        boost::unique_lock<boost::mutex> lock(cs_mininginfo);
+        if (nLongPolls >= nMaxLongPolls)
+        {
+            LOG(RPC, "Too many mining info long polls (max: %d), answering at once\n", nMaxLongPolls);
+            lock.unlock();
+            return GetMiningInfo();
+        }
+        nLongPolls++;
+        // wake up every second to notice a shutdown
+        while (std::atomic_load(&pMiningInfo)->strGenSig == strGenSig && !shutdown_threads.load() &&
+               boost::get_system_time() < until)
+        {
+            cvMiningInfo.timed_wait(lock, std::min(until, boost::get_system_time() + boost::posix_time::seconds(1)));
+        }
+        nLongPolls--;
+    }
+    return GetMiningInfo();
+}
+
+void RegisterMiningInfo() { RegisterValidationInterface(&miningInfoListener); }
+void MarkMiningInfoStale(int nHeight) { nStaleHeight.store(nHeight); }
+
+CMiningInfoStats GetMiningInfoStats()
+{
+    CMiningInfoStats stats;
+    std::shared_ptr<const CMiningInfo> info = std::atomic_load(&pMiningInfo);
+    stats.nHeight = info ? info->nHeight : -1;
+    stats.nReads = nReads.load();
+    stats.nStaleReads = nStaleReads.load();
+    return stats;
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MININGINFO_H
+#define BITCOIN_MININGINFO_H
+
+#include "uint256.h"
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+#include <univalue.h>
+
+class CBlockIndex;
+
+/** Longest a getMiningInfo long poll may wait for new mining info, in seconds */
+static const int64_t MAX_MINING_LONGPOLL = 60;
+
+/**
+ * What plot scanners need to mine the block after one tip: the getMiningInfo
+ * response, built once per tip and shared by every poller.
+ *
+ * A snapshot is never changed once published.  Each new tip publishes a new one
+ * with an atomic pointer swap, so readers take no lock at all, cs_main included,
+ * and keep serving the previous round while a block is being connected.
+ */
+struct CMiningInfo
+{
+    uint256 hashTip;
+    unsigned int nTipTime;
+    int nHeight; //! height of the next block
+    uint64_t nBaseTarget;
+    uint64_t nTargetDeadline;
+    unsigned char genSig[32]; //! the generation signature deadlines are computed against
+    std::string strGenSig; //! the generation signature as served, in hex
+    UniValue result;
+    std::string strJSON; //! result.write() and a newline, served as is over REST and ZMQ
+};
+
+/** The mining info of pindexTip, only rebuilt if it is not the tip of the last call */
+std::shared_ptr<const CMiningInfo> UpdateMiningInfo(const CBlockIndex *pindexTip);
+/** The latest published mining info, or null before the first one. Takes no lock. */
+std::shared_ptr<const CMiningInfo> GetMiningInfo();
+/**
+ * Wait up to nTimeoutMs for mining info whose generation signature is not
+ * strGenSig, and return the latest mining info either way.  Fewer long polls
+ * than -rpcthreads wait at a time, the others are answered at once.
+ */
+std::shared_ptr<const CMiningInfo> WaitMiningInfo(const std::string &strGenSig, int64_t nTimeoutMs);
+
+/**
+ * Rebuild the mining info on every block connected outside of IBD, through the
+ * validation interface.  ActivateBestChain and InvalidateBlock publish it for
+ * the tip they leave, which covers disconnects and IBD.
+ */
+void RegisterMiningInfo();
+/**
+ * Note that the block at nHeight is being connected: until its mining info is
+ * published, reads of the current one are counted as stale.
+ */
+void MarkMiningInfoStale(int nHeight);
+
+struct CMiningInfoStats
+{
+    int nHeight; //! height of the next block in the published mining info, -1 if none
+    uint64_t nReads;
+    uint64_t nStaleReads; //! reads served while a newer tip was being connected
+};
+
+CMiningInfoStats GetMiningInfoStats();
+
+#endif // BITCOIN_MININGINFO_H
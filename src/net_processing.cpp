@@ -18,6 +18,7 @@
 #include "main.h"
 #include "merkleblock.h"
 #include "nodestate.h"
+#include "pocverify.h"
 #include "requestManager.h"
 #include "timedata.h"
 #include "txadmission.h"
@@ -166,9 +167,11 @@ void static ProcessGetData(CNode *pfrom, const Consensus::Params &consensusParam
                 // it's available before trying to send.
                 if (fSend && (mi->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
+                    // Send block from disk, a full block as the bytes that are stored without deserializing it
                     CBlock block;
-                    if (!ReadBlockFromDisk(block, mi, consensusParams))
+                    CRawBlock rawBlock;
+                    if (inv.type == MSG_BLOCK ? !ReadRawBlockFromDisk(rawBlock, mi, consensusParams) :
+                                                !ReadBlockFromDisk(block, mi, consensusParams))
                     {
                         // its possible that I know about it but haven't stored it yet
                         LOG(THIN, "unable to load block %s from disk\n",
@@ -180,7 +183,7 @@ void static ProcessGetData(CNode *pfrom, const Consensus::Params &consensusParam
                         if (inv.type == MSG_BLOCK)
                         {
                             pfrom->blocksSent += 1;
-                            pfrom->PushMessage(NetMsgType::BLOCK, block);
+                            pfrom->PushMessage(NetMsgType::BLOCK, rawBlock);
                         }
                         else if (inv.type == MSG_THINBLOCK && pfrom->xVersion.as_u64c(XVer::BU_XTHIN_VERSION) < 2 &&
                                  pfrom->ThinBlockCapable())
@@ -1224,6 +1227,15 @@ bool ProcessMessage(CNode *pfrom, std::string strCommand, CDataStream &vRecv, in
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
+        // Compute the deadlines of the batch in parallel before taking cs_main. The verified ones end up in
+        // the PoC filter, so AcceptBlockHeader below does not compute them again one at a time.
+        if (nCount > 0)
+        {
+            CBlockIndex *pindexPrev = LookupBlockIndex(headers[0].hashPrevBlock);
+            if (pindexPrev)
+                CheckHeadersProofOfCapacityBatch(headers, pindexPrev->nHeight + 1);
+        }
+
         LOCK(cs_main);
 
         // Nothing interesting. Stop asking this peers for more headers.
@@ -0,0 +1,211 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "plotterstats.h"
+
+#include "pocverify.h"
+#include "unlimited.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+CPlotterStats::CEntry::CEntry(uint64_t nPlotterId, int64_t nBurst, int64_t nRate)
+    : stats(nPlotterId), bucket(nBurst, nRate)
+{
+    if (nBurst == 0)
+        bucket.disable();
+}
+
+CPlotterStats::CPeerEntry::CPeerEntry(int64_t nBurst, int64_t nRate)
+    : bucket(nBurst * PEER_SHARE_LIMIT_FACTOR, nRate * PEER_SHARE_LIMIT_FACTOR), nLastSubmit(0)
+{
+    if (nBurst == 0)
+        bucket.disable();
+}
+
+/**
+ * Forget the tenth of the entries that have been idle longest, so a stream of new
+ * keys costs one pass over the map per MAX_PLOTTER_STATS / 10 of them
+ */
+template <typename Key, typename Entry, typename LastSubmit>
+static void ForgetIdlest(std::map<Key, Entry> &map, LastSubmit lastSubmit)
+{
+    std::vector<std::pair<int64_t, Key> > vLast;
+    vLast.reserve(map.size());
+    for (const auto &entry : map)
+        vLast.push_back(std::make_pair(lastSubmit(entry.second), entry.first));
+    typename std::vector<std::pair<int64_t, Key> >::iterator nth = vLast.begin() + vLast.size() / 10;
+    std::nth_element(vLast.begin(), nth, vLast.end());
+    for (typename std::vector<std::pair<int64_t, Key> >::iterator last = vLast.begin(); last != nth; ++last)
+        map.erase(last->second);
+}
+
+CPlotterStats::CPlotterStats() : nBurst(DEFAULT_PLOTTER_SHARE_BURST), nRate(DEFAULT_PLOTTER_SHARE_RATE) {}
+
+CPlotterStats::CEntry &CPlotterStats::GetEntry(uint64_t nPlotterId)
+{
+    std::map<uint64_t, CEntry>::iterator it = mapPlotters.find(nPlotterId);
+    if (it != mapPlotters.end())
+        return it->second;
+
+    if (mapPlotters.size() >= MAX_PLOTTER_STATS)
+    {
+        ForgetIdlest(mapPlotters, [](const CEntry &entry) { return entry.stats.nLastSubmit; });
+        LOG(RPC, "Plotter stats full, %u plotters left\n", mapPlotters.size());
+    }
+    return mapPlotters.emplace(nPlotterId, CEntry(nPlotterId, nBurst, nRate)).first->second;
+}
+
+CPlotterStats::CPeerEntry *CPlotterStats::GetPeerEntry(const CNetAddr *pPeer)
+{
+    if (!pPeer || pPeer->IsLocal())
+        return nullptr;
+    std::map<CNetAddr, CPeerEntry>::iterator it = mapPeers.find(*pPeer);
+    if (it != mapPeers.end())
+        return &it->second;
+
+    if (mapPeers.size() >= MAX_PLOTTER_STATS)
+    {
+        ForgetIdlest(mapPeers, [](const CPeerEntry &entry) { return entry.nLastSubmit; });
+        LOG(RPC, "Plotter peer limits full, %u peers left\n", mapPeers.size());
+    }
+    return &mapPeers.emplace(*pPeer, CPeerEntry(nBurst, nRate)).first->second;
+}
+
+void CPlotterStats::SetLimits(int64_t nBurstIn, int64_t nRateIn)
+{
+    LOCK(cs_plotterstats);
+    nBurst = nBurstIn;
+    nRate = nRateIn;
+    for (auto &entry : mapPlotters)
+    {
+        if (nBurst == 0)
+            entry.second.bucket.disable();
+        else
+            entry.second.bucket.set(nBurst, nRate);
+    }
+    for (auto &entry : mapPeers)
+    {
+        if (nBurst == 0)
+            entry.second.bucket.disable();
+        else
+            entry.second.bucket.set(nBurst * PEER_SHARE_LIMIT_FACTOR, nRate * PEER_SHARE_LIMIT_FACTOR);
+    }
+}
+
+size_t CPlotterStats::Admit(const std::vector<CNonceShare> &shares,
+    std::vector<char> &vSkip,
+    std::vector<char> &vShed,
+    const CNetAddr *pPeer)
+{
+    vShed.assign(shares.size(), 0);
+    const int64_t nNow = GetTime();
+    size_t nShed = 0;
+
+    LOCK(cs_plotterstats);
+    CPeerEntry *ppeer = GetPeerEntry(pPeer);
+    if (ppeer)
+        ppeer->nLastSubmit = nNow;
+    // shares of one plotter usually come together, so only look it up again when it changes
+    CEntry *pentry = nullptr;
+    bool fBlacklisted = false;
+    for (size_t i = 0; i < shares.size(); i++)
+    {
+        if (!pentry || pentry->stats.nPlotterId != shares[i].nPlotterId)
+        {
+            pentry = &GetEntry(shares[i].nPlotterId);
+            fBlacklisted = InBlacklist(shares[i].nPlotterId);
+        }
+        pentry->stats.nSubmitted++;
+        pentry->stats.nLastSubmit = nNow;
+        if (vSkip[i])
+            continue;
+        // the peer is only charged for the shares its plotters are allowed
+        if (fBlacklisted || (ppeer && ppeer->bucket.available() < 1) || !pentry->bucket.try_leak(1))
+        {
+            vSkip[i] = 1;
+            vShed[i] = 1;
+            pentry->stats.nShed++;
+            nShed++;
+        }
+        else if (ppeer)
+            ppeer->bucket.try_leak(1);
+    }
+    nTotalSubmitted += shares.size();
+    nTotalShed += nShed;
+    return nShed;
+}
+
+void CPlotterStats::Record(const std::vector<CNonceShare> &shares,
+    const std::vector<CNonceResult> &results,
+    const std::vector<char> &vInvalid,
+    int nHeight,
+    bool fNextBlock,
+    int64_t nVerifyMicros,
+    const CNetAddr *pPeer)
+{
+    size_t nComputed = 0;
+    for (size_t i = 0; i < shares.size(); i++)
+    {
+        if (!results[i].fFast && !results[i].fShed)
+            nComputed++;
+    }
+    if (nComputed == 0)
+        return;
+    const int64_t nMicrosPerShare = nVerifyMicros / nComputed;
+
+    LOCK(cs_plotterstats);
+    CPeerEntry *ppeer = GetPeerEntry(pPeer);
+    size_t nInvalid = 0;
+    for (size_t i = 0; i < shares.size(); i++)
+    {
+        if (results[i].fFast || results[i].fShed)
+            continue;
+        CEntry &entry = GetEntry(shares[i].nPlotterId);
+        entry.stats.nVerified++;
+        entry.stats.nVerifyMicros += nMicrosPerShare;
+        if (vInvalid[i])
+        {
+            entry.stats.nInvalid++;
+            entry.bucket.leak(PLOTTER_INVALID_PENALTY);
+            if (ppeer)
+                ppeer->bucket.leak(PLOTTER_INVALID_PENALTY);
+            nInvalid++;
+        }
+        if (fNextBlock && (entry.stats.nBestHeight != nHeight || results[i].nDeadline < entry.stats.nBestDeadline))
+        {
+            entry.stats.nBestHeight = nHeight;
+            entry.stats.nBestDeadline = results[i].nDeadline;
+        }
+    }
+    nTotalVerified += nComputed;
+    nTotalInvalid += nInvalid;
+}
+
+std::vector<CPlotterShareStats> CPlotterStats::GetStats(uint64_t nPlotterId)
+{
+    std::vector<CPlotterShareStats> vStats;
+    LOCK(cs_plotterstats);
+    if (nPlotterId != 0)
+    {
+        std::map<uint64_t, CEntry>::const_iterator it = mapPlotters.find(nPlotterId);
+        if (it != mapPlotters.end())
+            vStats.push_back(it->second.stats);
+        return vStats;
+    }
+    vStats.reserve(mapPlotters.size());
+    for (const auto &entry : mapPlotters)
+        vStats.push_back(entry.second.stats);
+    return vStats;
+}
+
+void CPlotterStats::GetTotals(uint64_t &nSubmitted, uint64_t &nVerified, uint64_t &nInvalid, uint64_t &nShed)
+{
+    LOCK(cs_plotterstats);
+    nSubmitted = nTotalSubmitted();
+    nVerified = nTotalVerified();
+    nInvalid = nTotalInvalid();
+    nShed = nTotalShed();
+}
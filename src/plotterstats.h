@@ -0,0 +1,138 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PLOTTERSTATS_H
+#define BITCOIN_PLOTTERSTATS_H
+
+#include "leakybucket.h"
+#include "netaddress.h"
+#include "stat.h"
+#include "sync.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+struct CNonceShare;
+struct CNonceResult;
+
+/** Shares a plotter may have verified in one burst (0 = no rate limiting) */
+static const int64_t DEFAULT_PLOTTER_SHARE_BURST = 10000;
+/** Shares per second a plotter may have verified on average */
+static const int64_t DEFAULT_PLOTTER_SHARE_RATE = 100;
+/** Extra shares charged to a plotter for each share whose claimed deadline was wrong */
+static const int64_t PLOTTER_INVALID_PENALTY = 10;
+/** Plotters tracked at most, the ones idle longest are forgotten first */
+static const size_t MAX_PLOTTER_STATS = 10000;
+/** A REST client may have this many times the shares of one plotter verified, whatever plotter ids it sends */
+static const int64_t PEER_SHARE_LIMIT_FACTOR = 10;
+
+struct CPlotterShareStats
+{
+    uint64_t nPlotterId;
+    uint64_t nSubmitted; //! shares received
+    uint64_t nVerified; //! shares whose deadline was computed
+    uint64_t nInvalid; //! verified shares that did not have the deadline they claimed
+    uint64_t nShed; //! shares dropped before their deadline was computed
+    int nBestHeight; //! height of the last verified share for the next block
+    uint64_t nBestDeadline; //! best verified deadline at nBestHeight
+    int64_t nVerifyMicros; //! this plotter's part of the time spent computing deadlines
+    int64_t nLastSubmit;
+
+    CPlotterShareStats(uint64_t nPlotterIdIn = 0)
+        : nPlotterId(nPlotterIdIn), nSubmitted(0), nVerified(0), nInvalid(0), nShed(0), nBestHeight(-1),
+          nBestDeadline(0), nVerifyMicros(0), nLastSubmit(0)
+    {
+    }
+};
+
+/**
+ * Accounting and admission control for the nonces submitted by plot scanners.
+ *
+ * Every share that would reach the deadline kernel takes a token from its
+ * plotter's leaky bucket first; a plotter that has run out, or is blacklisted,
+ * has its shares shed without computing anything.  Shares whose claimed
+ * deadline turns out to be wrong cost PLOTTER_INVALID_PENALTY extra tokens, so a
+ * plotter flooding bad nonces is throttled well before an honest one.
+ *
+ * Plotter ids are whatever the client sends, so a client rotating them would
+ * never run out.  Shares that came over REST, which is not authenticated, also
+ * take a token from the bucket of the peer address, PEER_SHARE_LIMIT_FACTOR
+ * times the size of a plotter's so that a pool proxy still fits.  Loopback
+ * peers and RPC clients, which hold the RPC credentials, are only limited per
+ * plotter id.
+ */
+class CPlotterStats
+{
+private:
+    struct CEntry
+    {
+        CPlotterShareStats stats;
+        CLeakyBucket bucket;
+
+        CEntry(uint64_t nPlotterId, int64_t nBurst, int64_t nRate);
+    };
+
+    struct CPeerEntry
+    {
+        CLeakyBucket bucket;
+        int64_t nLastSubmit;
+
+        CPeerEntry(int64_t nBurst, int64_t nRate);
+    };
+
+    CCriticalSection cs_plotterstats; // locks everything below this point
+
+    int64_t nBurst;
+    int64_t nRate;
+    std::map<uint64_t, CEntry> mapPlotters;
+    std::map<CNetAddr, CPeerEntry> mapPeers;
+
+    CStatHistory<uint64_t> nTotalSubmitted;
+    CStatHistory<uint64_t> nTotalVerified;
+    CStatHistory<uint64_t> nTotalInvalid;
+    CStatHistory<uint64_t> nTotalShed;
+
+    CEntry &GetEntry(uint64_t nPlotterId) EXCLUSIVE_LOCKS_REQUIRED(cs_plotterstats);
+    //! null for no peer or a loopback one
+    CPeerEntry *GetPeerEntry(const CNetAddr *pPeer) EXCLUSIVE_LOCKS_REQUIRED(cs_plotterstats);
+
+public:
+    CPlotterStats();
+
+    /** Change the leaky bucket of every plotter, nBurst 0 turns rate limiting off */
+    void SetLimits(int64_t nBurstIn, int64_t nRateIn);
+
+    /**
+     * Decide which shares may have their deadline computed.  vSkip marks the
+     * shares that will not be computed anyway; the shed ones are marked in
+     * vSkip and vShed.  pPeer is the address the shares came from over REST.
+     * Returns the number of shares shed.
+     */
+    size_t Admit(const std::vector<CNonceShare> &shares,
+        std::vector<char> &vSkip,
+        std::vector<char> &vShed,
+        const CNetAddr *pPeer = nullptr);
+
+    /**
+     * Account for a submitted batch once its deadlines are known.  vInvalid marks
+     * the computed shares whose claimed deadline was wrong, and nVerifyMicros is
+     * the time spent computing, split between plotters by computed shares.
+     */
+    void Record(const std::vector<CNonceShare> &shares,
+        const std::vector<CNonceResult> &results,
+        const std::vector<char> &vInvalid,
+        int nHeight,
+        bool fNextBlock,
+        int64_t nVerifyMicros,
+        const CNetAddr *pPeer = nullptr);
+
+    /** Stats of every tracked plotter, or only of nPlotterId if it is not 0 */
+    std::vector<CPlotterShareStats> GetStats(uint64_t nPlotterId = 0);
+    void GetTotals(uint64_t &nSubmitted, uint64_t &nVerified, uint64_t &nInvalid, uint64_t &nShed);
+};
+
+extern CPlotterStats plotterStats;
+
+#endif // BITCOIN_PLOTTERSTATS_H
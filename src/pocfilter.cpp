@@ -0,0 +1,376 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "pocfilter.h"
+
+#include "crypto/common.h"
+#include "threadgroup.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+// File layout: the magic, then fixed size little-endian records of
+// hash (32 bytes), height (4 bytes) and deadline (8 bytes).
+static const unsigned char POC_FILTER_MAGIC[8] = {'D', 'K', 'P', 'O', 'C', 'F', 0, 1};
+static const size_t POC_FILTER_RECORD_SIZE = 32 + 4 + 8;
+
+// The flush thread appends once this many inserts are queued, or any queued ones after Nsyncsec
+#define Nmsync 100
+#define Nsyncsec 120
+
+// Prune once the lowest height is this far past the keep window
+static const int POC_FILTER_PRUNE_STEP = 1000;
+// Rewrite the file once it holds this many more records than there are entries
+static const size_t POC_FILTER_REWRITE_SLACK = 10000;
+
+CPocFilter::CPocFilter()
+    : table(new Slot[POC_FILTER_SLOTS]), freeSlots(POC_FILTER_SLOTS), nBestHeight(0), nPrunedHeight(0),
+      file(nullptr), nLastSync(0), nEntries(0), nDiskEntries(0), nHits(0), nMisses(0), nEvicted(0)
+{
+    for (uint32_t i = 0; i < POC_FILTER_SLOTS; i++)
+    {
+        table[i].nSeq.store(0, std::memory_order_relaxed);
+        for (auto &word : table[i].key)
+            word.store(0, std::memory_order_relaxed);
+        table[i].nHeight = 0;
+        table[i].nDeadline = 0;
+    }
+}
+
+CPocFilter::~CPocFilter()
+{
+    if (file)
+        fclose(file);
+}
+
+void CPocFilter::store(uint32_t i, const uint256 &hash, int nHeight, uint64_t nDeadline)
+{
+    // Seqlock write: readers that see an odd or changed sequence number retry
+    Slot &slot = table[i];
+    uint32_t nSeq = slot.nSeq.load(std::memory_order_relaxed);
+    slot.nSeq.store(nSeq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int w = 0; w < 4; w++)
+        slot.key[w].store(ReadLE64(hash.begin() + 8 * w), std::memory_order_relaxed);
+    slot.nSeq.store(nSeq + 2, std::memory_order_release);
+    slot.nHeight = nHeight;
+    slot.nDeadline = nDeadline;
+}
+
+void CPocFilter::erase(uint32_t i)
+{
+    freeSlots.bit_set(i);
+    store(i, uint256(), 0, 0);
+    nEntries--;
+}
+
+bool CPocFilter::add(const uint256 &hash, int nHeight, uint64_t nDeadline)
+{
+    AssertLockHeld(cs_table);
+
+    uint32_t nHome = hash.GetCheapHash() & (POC_FILTER_SLOTS - 1);
+    uint32_t nFree = POC_FILTER_SLOTS;
+    uint32_t nLowest = POC_FILTER_SLOTS;
+    for (uint32_t p = 0; p < POC_FILTER_PROBES; p++)
+    {
+        uint32_t i = (nHome + p) & (POC_FILTER_SLOTS - 1);
+        if (freeSlots.bit_is_set(i))
+        {
+            if (nFree == POC_FILTER_SLOTS)
+                nFree = i;
+            continue;
+        }
+        bool fMatch = true;
+        for (int w = 0; w < 4 && fMatch; w++)
+            fMatch = table[i].key[w].load(std::memory_order_relaxed) == ReadLE64(hash.begin() + 8 * w);
+        if (fMatch)
+            return false;
+        if (nLowest == POC_FILTER_SLOTS || table[i].nHeight < table[nLowest].nHeight)
+            nLowest = i;
+    }
+
+    if (nFree == POC_FILTER_SLOTS)
+    {
+        // The window is full: losing the lowest entry only costs a recomputation
+        erase(nLowest);
+        nEvicted++;
+        nFree = nLowest;
+    }
+    store(nFree, hash, nHeight, nDeadline);
+    freeSlots.bit_unset(nFree);
+    nEntries++;
+    if (nHeight > nBestHeight)
+        nBestHeight = nHeight;
+    return true;
+}
+
+bool CPocFilter::load(const fs::path &pathIn)
+{
+    LOCK(cs_file);
+    path = pathIn; //save it first, because sync need it.
+
+    size_t nSize = 0;
+    try
+    {
+        boost::interprocess::file_mapping mapping(path.string().c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region region(mapping, boost::interprocess::read_only);
+        const unsigned char *p = (const unsigned char *)region.get_address();
+        nSize = region.get_size();
+
+        if (nSize < sizeof(POC_FILTER_MAGIC) || memcmp(p, POC_FILTER_MAGIC, sizeof(POC_FILTER_MAGIC)) != 0)
+        {
+            LOGA("%s: %s is not a PoC filter file\n", __func__, path.string());
+            return false;
+        }
+        LOCK(cs_table);
+        for (size_t pos = sizeof(POC_FILTER_MAGIC); pos + POC_FILTER_RECORD_SIZE <= nSize;
+             pos += POC_FILTER_RECORD_SIZE)
+        {
+            uint256 hash;
+            memcpy(hash.begin(), p + pos, 32);
+            add(hash, (int)ReadLE32(p + pos + 32), ReadLE64(p + pos + 36));
+            nDiskEntries++;
+        }
+    }
+    catch (const boost::interprocess::interprocess_exception &e)
+    {
+        LOGA("%s: unable to map %s: %s\n", __func__, path.string(), e.what());
+        return false;
+    }
+
+    nLastSync = GetTime();
+    prune(nBestHeight - POC_FILTER_KEEP_BLOCKS);
+
+    // A torn last record, or mostly pruned records, means the file has to be rewritten
+    if ((nSize - sizeof(POC_FILTER_MAGIC)) % POC_FILTER_RECORD_SIZE != 0 ||
+        nDiskEntries > 2 * nEntries + POC_FILTER_REWRITE_SLACK)
+        return rewrite();
+
+    file = fsbridge::fopen(path, "ab");
+    if (!file)
+    {
+        LOGA("%s: unable to open %s\n", __func__, path.string());
+        return false;
+    }
+    LOGA("Loaded %u verified PoC headers from %s\n", nEntries.load(), path.string());
+    return true;
+}
+
+void CPocFilter::clear()
+{
+    {
+        LOCK(cs_table);
+        for (uint32_t i = 0; i < POC_FILTER_SLOTS; i++)
+        {
+            if (!freeSlots.bit_is_set(i))
+                erase(i);
+        }
+        nBestHeight = 0;
+        nPrunedHeight = 0;
+    }
+    {
+        LOCK(cs_pending);
+        vPending.clear();
+    }
+    LOCK(cs_file);
+    nLastSync = GetTime();
+    rewrite();
+}
+
+bool CPocFilter::rewrite()
+{
+    AssertLockHeld(cs_file);
+    if (file)
+    {
+        fclose(file);
+        file = nullptr;
+    }
+
+    // Entries queued for the flush thread are in the snapshot too; appending
+    // them again later only leaves duplicates that load() skips.
+    std::vector<unsigned char> vRecords;
+    {
+        LOCK(cs_table);
+        vRecords.reserve(nEntries * POC_FILTER_RECORD_SIZE);
+        unsigned char record[POC_FILTER_RECORD_SIZE];
+        for (uint32_t i = 0; i < POC_FILTER_SLOTS; i++)
+        {
+            if (freeSlots.bit_is_set(i))
+                continue;
+            for (int w = 0; w < 4; w++)
+                WriteLE64(record + 8 * w, table[i].key[w].load(std::memory_order_relaxed));
+            WriteLE32(record + 32, (uint32_t)table[i].nHeight);
+            WriteLE64(record + 36, table[i].nDeadline);
+            vRecords.insert(vRecords.end(), record, record + sizeof(record));
+        }
+    }
+
+    fs::path pathTmp = path.string() + ".new";
+    FILE *fileout = fsbridge::fopen(pathTmp, "wb");
+    if (!fileout)
+    {
+        LOGAF("Failed to sync %s", pathTmp.string());
+        return false;
+    }
+
+    bool fOk = fwrite(POC_FILTER_MAGIC, sizeof(POC_FILTER_MAGIC), 1, fileout) == 1;
+    if (!vRecords.empty())
+        fOk = fOk && fwrite(vRecords.data(), vRecords.size(), 1, fileout) == 1;
+    if (fOk)
+        FileCommit(fileout);
+    fclose(fileout);
+
+    if (!fOk || !RenameOver(pathTmp, path))
+    {
+        LOGAF("Failed to sync %s", path.string());
+        return false;
+    }
+    nDiskEntries = vRecords.size() / POC_FILTER_RECORD_SIZE;
+
+    file = fsbridge::fopen(path, "ab");
+    return file != nullptr;
+}
+
+bool CPocFilter::sync()
+{
+    LOCK(cs_file);
+    std::vector<Record> vRecords;
+    {
+        LOCK(cs_pending);
+        vRecords.swap(vPending);
+    }
+    nLastSync = GetTime();
+    if (vRecords.empty())
+        return true;
+    if (!file)
+        return rewrite();
+
+    unsigned char record[POC_FILTER_RECORD_SIZE];
+    for (const Record &item : vRecords)
+    {
+        memcpy(record, item.hash.begin(), 32);
+        WriteLE32(record + 32, (uint32_t)item.nHeight);
+        WriteLE64(record + 36, item.nDeadline);
+        if (fwrite(record, sizeof(record), 1, file) != 1)
+        {
+            LOGAF("Failed to sync %s", path.string());
+            return false;
+        }
+    }
+    if (fflush(file) != 0)
+    {
+        LOGAF("Failed to sync %s", path.string());
+        return false;
+    }
+    LOG(BLOOM, "Synced %u new entries to %s", vRecords.size(), path.string());
+
+    nDiskEntries += vRecords.size();
+    if (nDiskEntries > 2 * nEntries + POC_FILTER_REWRITE_SLACK)
+        return rewrite();
+    return true;
+}
+
+bool CPocFilter::SyncNeeded() const
+{
+    size_t nPending;
+    {
+        LOCK(cs_pending);
+        nPending = vPending.size();
+    }
+    return nPending >= Nmsync || (nPending > 0 && nLastSync + Nsyncsec < GetTime());
+}
+
+void CPocFilter::insert(const uint256 &hash, int nHeight, uint64_t nDeadline)
+{
+    {
+        LOCK(cs_table);
+        if (!add(hash, nHeight, nDeadline))
+            return;
+        if (nPrunedHeight < nBestHeight - POC_FILTER_KEEP_BLOCKS - POC_FILTER_PRUNE_STEP)
+            prune(nBestHeight - POC_FILTER_KEEP_BLOCKS);
+    }
+    LOCK(cs_pending);
+    vPending.push_back(Record{hash, nHeight, nDeadline});
+}
+
+bool CPocFilter::contains(const uint256 &hash) const
+{
+    uint64_t key[4];
+    for (int w = 0; w < 4; w++)
+        key[w] = ReadLE64(hash.begin() + 8 * w);
+
+    uint32_t nHome = hash.GetCheapHash() & (POC_FILTER_SLOTS - 1);
+    for (uint32_t p = 0; p < POC_FILTER_PROBES; p++)
+    {
+        uint32_t i = (nHome + p) & (POC_FILTER_SLOTS - 1);
+        if (freeSlots.bit_is_set(i))
+            continue;
+        // Seqlock read: retry if a writer was changing the slot meanwhile
+        const Slot &slot = table[i];
+        bool fMatch;
+        uint32_t nSeq;
+        do
+        {
+            nSeq = slot.nSeq.load(std::memory_order_acquire);
+            fMatch = true;
+            for (int w = 0; w < 4; w++)
+                fMatch &= slot.key[w].load(std::memory_order_relaxed) == key[w];
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((nSeq & 1) || slot.nSeq.load(std::memory_order_relaxed) != nSeq);
+        if (fMatch)
+        {
+            nHits++;
+            return true;
+        }
+    }
+    nMisses++;
+    return false;
+}
+
+void CPocFilter::prune(int nMinHeight)
+{
+    LOCK(cs_table);
+    for (uint32_t i = 0; i < POC_FILTER_SLOTS; i++)
+    {
+        if (!freeSlots.bit_is_set(i) && table[i].nHeight < nMinHeight)
+            erase(i);
+    }
+    if (nMinHeight > nPrunedHeight)
+        nPrunedHeight = nMinHeight;
+}
+
+CPocFilterStats CPocFilter::GetStats() const
+{
+    CPocFilterStats stats;
+    stats.nEntries = nEntries;
+    stats.nDiskEntries = nDiskEntries;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    stats.nEvicted = nEvicted;
+    stats.nMemoryUsage = sizeof(Slot) * POC_FILTER_SLOTS + POC_FILTER_SLOTS / 8;
+    {
+        LOCK(cs_pending);
+        stats.nPending = vPending.size();
+        stats.nMemoryUsage += vPending.capacity() * sizeof(Record);
+    }
+    return stats;
+}
+
+static void ThreadPocFilterFlush(CPocFilter *filter)
+{
+    RenameThread("pocfilter");
+    while (!shutdown_threads.load())
+    {
+        MilliSleep(500);
+        if (filter->SyncNeeded())
+            filter->sync();
+    }
+}
+
+void StartPocFilterFlush(thread_group &threadGroup, CPocFilter *filter)
+{
+    threadGroup.create_thread(&ThreadPocFilterFlush, filter);
+}
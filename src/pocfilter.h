@@ -0,0 +1,130 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_POCFILTER_H
+#define BITCOIN_POCFILTER_H
+
+#include "cuckoocache.h"
+#include "fs.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+class thread_group;
+
+/** Entries this many blocks below the highest verified header are pruned */
+static const int POC_FILTER_KEEP_BLOCKS = 10080;
+/** Slots in the lookup table, a power of two comfortably above the keep window */
+static const uint32_t POC_FILTER_SLOTS = 1 << 16;
+/** A hash can only live in this many consecutive slots from its home slot */
+static const uint32_t POC_FILTER_PROBES = 8;
+
+struct CPocFilterStats
+{
+    size_t nEntries; //! entries in memory
+    size_t nDiskEntries; //! records in the file, including pruned ones not compacted yet
+    size_t nPending; //! entries waiting for the flush thread
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nEvicted; //! entries dropped early because their probe window was full
+    size_t nMemoryUsage; //! bytes used by the in-memory index
+};
+
+/**
+ * Exact, persistent record of the headers whose PoC deadline has been verified.
+ *
+ * Each entry holds the header hash, its height and the deadline computed for it.
+ * Entries are keyed by header hash, which commits to the parent, so a reorg
+ * never makes one wrong; competing headers at a height are separate entries.
+ *
+ * contains() takes no lock.  Entries live in a fixed open addressing table of
+ * POC_FILTER_SLOTS slots; a bit-packed atomic flag per slot says whether it is
+ * free, and each slot carries a sequence number that is odd while a writer is
+ * changing it, so a reader that raced with a writer retries instead of seeing a
+ * torn hash.  Writers are serialized by cs_table.  When every slot in a probe
+ * window is taken, the lowest entry in it is evicted: that only costs a deadline
+ * recomputation later, it can never make contains() return a false positive.
+ *
+ * insert() never touches the disk.  New entries are queued and the flush thread
+ * (or the final sync() at shutdown) appends them to the file.  load()
+ * memory-maps the file once to rebuild the table; the file is rewritten once it
+ * holds mostly pruned records.
+ */
+class CPocFilter
+{
+public:
+    CPocFilter();
+    ~CPocFilter();
+
+    bool load(const fs::path &path); //allow call once
+    void clear();
+    /** Append the queued entries to the file */
+    bool sync();
+    /** Whether enough entries are queued, or they have been queued long enough, to sync */
+    bool SyncNeeded() const;
+
+    void insert(const uint256 &hash, int nHeight, uint64_t nDeadline);
+    bool contains(const uint256 &hash) const;
+    /** Drop every entry below nMinHeight */
+    void prune(int nMinHeight);
+
+    CPocFilterStats GetStats() const;
+
+private:
+    struct Slot
+    {
+        std::atomic<uint32_t> nSeq;
+        std::atomic<uint64_t> key[4];
+        // only used by writers, under cs_table
+        int nHeight;
+        uint64_t nDeadline;
+    };
+    struct Record
+    {
+        uint256 hash;
+        int nHeight;
+        uint64_t nDeadline;
+    };
+
+    std::unique_ptr<Slot[]> table;
+    //! bit set means the slot is free
+    CuckooCache::CBitPackedAtomicFlags freeSlots;
+
+    //! serializes changes to the table
+    mutable CCriticalSection cs_table;
+    int nBestHeight;
+    //! everything below this height has been pruned
+    int nPrunedHeight;
+
+    //! inserted but not yet appended to the file
+    mutable CCriticalSection cs_pending;
+    std::vector<Record> vPending;
+
+    //! serializes file access
+    mutable CCriticalSection cs_file;
+    fs::path path;
+    FILE *file;
+    std::atomic<int64_t> nLastSync;
+
+    std::atomic<size_t> nEntries;
+    std::atomic<size_t> nDiskEntries;
+    mutable std::atomic<uint64_t> nHits;
+    mutable std::atomic<uint64_t> nMisses;
+    std::atomic<uint64_t> nEvicted;
+
+    bool add(const uint256 &hash, int nHeight, uint64_t nDeadline);
+    void store(uint32_t i, const uint256 &hash, int nHeight, uint64_t nDeadline);
+    void erase(uint32_t i);
+    bool rewrite();
+};
+
+/** Start the thread that appends newly verified headers to the filter file */
+void StartPocFilterFlush(thread_group &threadGroup, CPocFilter *filter);
+
+#endif // BITCOIN_POCFILTER_H
@@ -0,0 +1,232 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "pocverify.h"
+
+#include "chain.h"
+#include "checkqueue.h"
+#include "main.h"
+#include "pocfilter.h"
+#include "pow.h"
+#include "sync.h"
+#include "threadgroup.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+/** Headers handed to a worker at a time; each one is a full nonce generation */
+static const unsigned int POCVERIFY_BATCH_SIZE = 4;
+/** Nonces of one plotter computed by one CNonceCheck */
+static const size_t NONCE_GROUP_SIZE = 64;
+
+static CCheckQueue<CPocCheck> *pocCheckQueue = nullptr;
+static CCheckQueue<CNonceCheck> *nonceCheckQueue = nullptr;
+static unsigned int nPocVerifyThreads = 0;
+
+/** Only one batch may use each queue at a time */
+static CCriticalSection cs_pocverify;
+static CCriticalSection cs_noncecheck;
+
+// Totals since startup, for the per-batch bench log line. Protected by cs_pocverify
+static int64_t nTimePocVerify = 0;
+static uint64_t nPocVerified = 0;
+
+static void ThreadPocVerify(int i)
+{
+    RenameThread(strprintf("pocverify%d", i).c_str());
+    pocCheckQueue->Thread();
+}
+
+static void ThreadNonceCheck(int i)
+{
+    RenameThread(strprintf("pocnonce%d", i).c_str());
+    nonceCheckQueue->Thread();
+}
+
+bool CPocCheck::operator()()
+{
+    if (!CheckProofOfCapacityDeadline(header, nHeight))
+        return false;
+    *pfVerified = 1;
+    return true;
+}
+
+bool CNonceCheck::operator()()
+{
+    std::vector<uint64_t> vDeadlines = CalculateBestBatch(nHeight, pGenSig, nPlotterId, vNonces);
+    for (size_t i = 0; i < vDeadlines.size(); i++)
+        *vOut[i] = vDeadlines[i];
+    return true;
+}
+
+void StartPocVerify(thread_group &threadGroup)
+{
+    int nThreads = GetArg("-pocverifythreads", DEFAULT_POCVERIFY_THREADS);
+    if (nThreads <= 0)
+        nThreads += GetNumCores();
+    // The calling thread joins the workers while it waits for a batch, so a
+    // single thread has no parallelism (equivalent to batching turned off).
+    if (nThreads <= 1)
+        nThreads = 0;
+    else if (nThreads > MAX_POCVERIFY_THREADS)
+        nThreads = MAX_POCVERIFY_THREADS;
+
+    LOGA("Using %d threads for PoC header verification\n", nThreads);
+    nPocVerifyThreads = nThreads;
+    if (nThreads == 0)
+        return;
+
+    pocCheckQueue = new CCheckQueue<CPocCheck>(POCVERIFY_BATCH_SIZE);
+    nonceCheckQueue = new CCheckQueue<CNonceCheck>(1);
+    for (int i = 0; i < nThreads; i++)
+    {
+        threadGroup.create_thread(&ThreadPocVerify, i + 1);
+        threadGroup.create_thread(&ThreadNonceCheck, i + 1);
+    }
+}
+
+void StopPocVerify()
+{
+    if (pocCheckQueue)
+        pocCheckQueue->Shutdown();
+    if (nonceCheckQueue)
+        nonceCheckQueue->Shutdown();
+}
+
+void CheckHeadersProofOfCapacityBatch(const std::vector<CBlockHeader> &headers, int nFirstHeight)
+{
+    if (pocCheckQueue == nullptr || headers.size() < 2)
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+
+    // Pick out the headers that would need a deadline computation. Malformed ones
+    // are left to CheckBlockHeader, which rejects them with the proper DoS score.
+    std::vector<char> vVerified(headers.size(), 0);
+    std::vector<CPocCheck> vChecks;
+    vChecks.reserve(headers.size());
+    for (size_t i = 0; i < headers.size(); i++)
+    {
+        const CBlockHeader &header = headers[i];
+        // heights are only known for the run of headers that connect to each other
+        if (i > 0 && header.hashPrevBlock != headers[i - 1].GetHash())
+            break;
+        int nHeight = nFirstHeight + i;
+        if (nHeight == 0 || (header.nPlotterId >> 56) > 0 || header.nBaseTarget == 0)
+            continue;
+        if (!ProofOfCapacityCheckNeeded(header, nHeight))
+            continue;
+        vChecks.emplace_back(header, nHeight, &vVerified[i]);
+    }
+    size_t nChecks = vChecks.size();
+    if (nChecks < 2)
+        return;
+
+    LOCK(cs_pocverify);
+    bool fAllOk;
+    {
+        CCheckQueueControl<CPocCheck> control(pocCheckQueue);
+        control.Add(vChecks);
+        fAllOk = control.Wait();
+    }
+
+    unsigned int nVerified = 0;
+    for (size_t i = 0; i < headers.size(); i++)
+    {
+        if (vVerified[i])
+        {
+            pPocFilter->insert(headers[i].GetHash(), nFirstHeight + i, headers[i].nDeadline);
+            nVerified++;
+        }
+    }
+
+    int64_t nTime = GetTimeMicros() - nTimeStart;
+    nTimePocVerify += nTime;
+    nPocVerified += nVerified;
+    LOG(BENCH, "PoC verify batch at height %d: %u/%u headers%s in %.2fms (%.2fms/header, %u threads) "
+               "[%.2fs, %u headers]\n",
+        nFirstHeight, nVerified, (unsigned int)nChecks, fAllOk ? "" : " (failed)", 0.001 * nTime,
+        0.001 * nTime / nChecks, nPocVerifyThreads, nTimePocVerify * 0.000001, nPocVerified);
+}
+
+bool CheckBlockIndexProofOfCapacityBatch(const std::vector<const CBlockIndex *> &vIndex)
+{
+    std::vector<char> vVerified(vIndex.size(), 0);
+    std::vector<CPocCheck> vChecks;
+    vChecks.reserve(vIndex.size());
+    for (size_t i = 0; i < vIndex.size(); i++)
+    {
+        CBlockHeader header = vIndex[i]->GetBlockHeader();
+        if (!ProofOfCapacityCheckNeeded(header, vIndex[i]->nHeight))
+            continue;
+        vChecks.emplace_back(header, vIndex[i]->nHeight, &vVerified[i]);
+    }
+
+    bool fAllOk = true;
+    if (pocCheckQueue == nullptr || vChecks.size() < 2)
+    {
+        for (CPocCheck &check : vChecks)
+            fAllOk = check() && fAllOk;
+    }
+    else
+    {
+        LOCK(cs_pocverify);
+        CCheckQueueControl<CPocCheck> control(pocCheckQueue);
+        control.Add(vChecks);
+        fAllOk = control.Wait();
+    }
+
+    for (size_t i = 0; i < vIndex.size(); i++)
+    {
+        if (vVerified[i])
+            pPocFilter->insert(vIndex[i]->GetBlockHash(), vIndex[i]->nHeight, vIndex[i]->nDeadline);
+    }
+    return fAllOk;
+}
+
+void CalculateDeadlinesBatch(int nHeight,
+    const unsigned char *gen_sig,
+    const std::vector<CNonceShare> &shares,
+    const std::vector<char> &vSkip,
+    std::vector<uint64_t> &vDeadlines)
+{
+    vDeadlines.assign(shares.size(), 0);
+
+    // Group the shares by plotter, in chunks that fill the Shabal lanes
+    std::vector<size_t> vOrder;
+    vOrder.reserve(shares.size());
+    for (size_t i = 0; i < shares.size(); i++)
+    {
+        if (!vSkip[i])
+            vOrder.push_back(i);
+    }
+    std::sort(vOrder.begin(), vOrder.end(),
+        [&shares](size_t a, size_t b) { return shares[a].nPlotterId < shares[b].nPlotterId; });
+
+    std::vector<CNonceCheck> vChecks;
+    uint64_t nLastPlotter = 0;
+    for (size_t i : vOrder)
+    {
+        const CNonceShare &share = shares[i];
+        if (vChecks.empty() || vChecks.back().size() >= NONCE_GROUP_SIZE || share.nPlotterId != nLastPlotter)
+            vChecks.emplace_back(nHeight, gen_sig, share.nPlotterId);
+        vChecks.back().Add(share.nNonce, &vDeadlines[i]);
+        nLastPlotter = share.nPlotterId;
+    }
+    if (vChecks.empty())
+        return;
+
+    if (nonceCheckQueue == nullptr || vChecks.size() < 2)
+    {
+        for (CNonceCheck &check : vChecks)
+            check();
+        return;
+    }
+
+    LOCK(cs_noncecheck);
+    CCheckQueueControl<CNonceCheck> control(nonceCheckQueue);
+    control.Add(vChecks);
+    control.Wait();
+}
@@ -0,0 +1,174 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_POCVERIFY_H
+#define BITCOIN_POCVERIFY_H
+
+#include "consensus/params.h"
+#include "primitives/block.h"
+#include "serialize.h"
+
+#include <vector>
+
+class CBlockIndex;
+class thread_group;
+
+/** Default for -pocverifythreads, 0 = one per core */
+static const int DEFAULT_POCVERIFY_THREADS = 0;
+/** Maximum number of PoC verification threads */
+static const int MAX_POCVERIFY_THREADS = 16;
+
+/**
+ * Closure representing the deadline check of one header, run on the PoC
+ * verification threads through a CCheckQueue.  On success the result flag
+ * is set so the caller can tell which headers of a batch were verified.
+ */
+class CPocCheck
+{
+private:
+    CBlockHeader header;
+    int nHeight;
+    char *pfVerified;
+
+public:
+    CPocCheck() : nHeight(0), pfVerified(nullptr) {}
+    CPocCheck(const CBlockHeader &headerIn, int nHeightIn, char *pfVerifiedIn)
+        : header(headerIn), nHeight(nHeightIn), pfVerified(pfVerifiedIn)
+    {
+    }
+
+    bool operator()();
+
+    void swap(CPocCheck &check)
+    {
+        std::swap(header, check.header);
+        std::swap(nHeight, check.nHeight);
+        std::swap(pfVerified, check.pfVerified);
+    }
+};
+
+/** One share sent by a plotter: a nonce and, optionally, the raw deadline it claims */
+struct CNonceShare
+{
+    uint64_t nNonce;
+    uint64_t nPlotterId;
+    uint64_t nDeadline; //! 0 if not claimed
+
+    CNonceShare() : nNonce(0), nPlotterId(0), nDeadline(0) {}
+    CNonceShare(uint64_t nNonceIn, uint64_t nPlotterIdIn, uint64_t nDeadlineIn)
+        : nNonce(nNonceIn), nPlotterId(nPlotterIdIn), nDeadline(nDeadlineIn)
+    {
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(nNonce);
+        READWRITE(nPlotterId);
+        READWRITE(nDeadline);
+    }
+};
+
+/** What became of a CNonceShare */
+struct CNonceResult
+{
+    uint64_t nDeadline; //! the raw deadline divided by the base target
+    bool fFast; //! the claimed deadline was taken as is: it could not have entered the submit cache
+    bool fUpdate; //! it is the new best submission for the next block
+    bool fShed; //! dropped before its deadline was computed: the plotter is blacklisted or over its rate
+
+    CNonceResult() : nDeadline(0), fFast(false), fUpdate(false), fShed(false) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(nDeadline);
+        READWRITE(fFast);
+        READWRITE(fUpdate);
+        READWRITE(fShed);
+    }
+};
+
+/** Most shares one submitNonces call may carry */
+static const size_t MAX_SUBMIT_NONCES = 10000;
+
+/**
+ * Closure computing the deadlines of a group of nonces of one plotter, so
+ * that the SIMD Shabal kernels can fill all their lanes.  Run on the nonce
+ * threads through a CCheckQueue.
+ */
+class CNonceCheck
+{
+private:
+    int nHeight;
+    const unsigned char *pGenSig;
+    uint64_t nPlotterId;
+    std::vector<uint64_t> vNonces;
+    std::vector<uint64_t *> vOut;
+
+public:
+    CNonceCheck() : nHeight(0), pGenSig(nullptr), nPlotterId(0) {}
+    CNonceCheck(int nHeightIn, const unsigned char *pGenSigIn, uint64_t nPlotterIdIn)
+        : nHeight(nHeightIn), pGenSig(pGenSigIn), nPlotterId(nPlotterIdIn)
+    {
+    }
+
+    void Add(uint64_t nNonce, uint64_t *pOut)
+    {
+        vNonces.push_back(nNonce);
+        vOut.push_back(pOut);
+    }
+    size_t size() const { return vNonces.size(); }
+
+    bool operator()();
+
+    void swap(CNonceCheck &check)
+    {
+        std::swap(nHeight, check.nHeight);
+        std::swap(pGenSig, check.pGenSig);
+        std::swap(nPlotterId, check.nPlotterId);
+        vNonces.swap(check.vNonces);
+        vOut.swap(check.vOut);
+    }
+};
+
+/** Start the PoC verification threads (-pocverifythreads) */
+void StartPocVerify(thread_group &threadGroup);
+/** Make the PoC verification threads exit so that they can be joined */
+void StopPocVerify();
+
+/**
+ * Verify the deadlines of a batch of headers, the first of which is at
+ * nFirstHeight, on the PoC verification threads and add every verified
+ * header hash to pPocFilter in one go.  Only the leading run of headers that
+ * connect to each other is looked at.  Headers that fail, or that are not
+ * checked here, are left for the normal one-by-one check in
+ * CheckBlockHeader, which then rejects them or finds them in the filter.
+ */
+void CheckHeadersProofOfCapacityBatch(const std::vector<CBlockHeader> &headers, int nFirstHeight);
+
+/**
+ * Verify the deadlines of block index entries loaded at startup, on the PoC
+ * verification threads, and add the verified hashes to pPocFilter.  The
+ * entries need not connect to each other; those ProofOfCapacityCheckNeeded
+ * skips are not looked at.  Returns false if any deadline is wrong.
+ */
+bool CheckBlockIndexProofOfCapacityBatch(const std::vector<const CBlockIndex *> &vIndex);
+
+/**
+ * Compute the raw deadlines of many shares for one block, all against the
+ * same generation signature, on the nonce threads.  vDeadlines gets one
+ * entry per share; the entries of shares with fSkip set are left at 0.
+ */
+void CalculateDeadlinesBatch(int nHeight,
+    const unsigned char *gen_sig,
+    const std::vector<CNonceShare> &shares,
+    const std::vector<char> &vSkip,
+    std::vector<uint64_t> &vDeadlines);
+
+#endif // BITCOIN_POCVERIFY_H
@@ -171,9 +171,48 @@ uint64_t CalculateBest(int height, const unsigned char* gen_sig, uint64_t plotte
 	return calc_dl(height, gen_sig, plotter_id, nonce);
 }
 
-static bool CheckProofOfCapacityInner(const CBlockHeader &header, int height, const Consensus::Params &params) {
+std::vector<uint64_t> CalculateBestBatch(int height,
+    const unsigned char *gen_sig,
+    uint64_t plotter_id,
+    const std::vector<uint64_t> &nonces)
+{
+    std::vector<unsigned long long> in(nonces.begin(), nonces.end());
+    std::vector<unsigned long long> out(in.size());
+    calc_dl_batch(height, gen_sig, plotter_id, in.data(), out.data(), in.size());
+    return std::vector<uint64_t>(out.begin(), out.end());
+}
+
+bool ProofOfCapacityCheckNeeded(const CBlockHeader &header, int height)
+{
+    //--->fast test 2--->
+    if (fNoCheck || header.nTime + POC_CHECK_MAX_AGE < GetTime() || Params().NetworkIDString()=="regtest") {
+        LOGAF("Skip pocfilter h=%d", height);
+        return false;
+    }
+    //<--
+
     uint256 hash = header.GetHash();
+    bool is_filter = pPocFilter->contains(hash);
+    LOG(BLOOM, "%s pocfilter: %d %s", (is_filter?"GET":"ADD"), height, hash.GetHex());
+    return !is_filter;
+}
+
+bool CheckProofOfCapacityDeadline(const CBlockHeader &header, int height)
+{
+    uint64_t dl = CalculateBest(height, header.sig, header.nPlotterId, header.nNonce)/header.nBaseTarget;
+    if (dl != header.nDeadline) {
+        LOGA("Failed to check deadline h=%d....%llu != %llu, pid=%d, sig: %s, bt: %llu, nonce: %llu", 
+            height, dl, header.nDeadline, header.nPlotterId, HexEncode(header.sig,32), header.nBaseTarget, header.nNonce);
+        return false;
+    }
+    return true;
+}
 
+bool CheckProofOfCapacityFormat(const CBlockHeader &header,
+    const uint256 &hash,
+    int height,
+    const Consensus::Params &params)
+{
     if (height == 0) {
         return hash == params.hashGenesisBlock;
     }
@@ -187,29 +226,21 @@ static bool CheckProofOfCapacityInner(const CBlockHeader &header, int height, co
             height, header.nDeadline, header.nPlotterId, header.nNonce, hash.GetHex());
         return false;
     }
-    //--->fast test 2--->
-    if (fNoCheck || header.nTime + 86400*2 < GetTime() || Params().NetworkIDString()=="regtest") {
-        LOGAF("Skip pocfilter h=%d", height);
-        return true;
-    }
-    //<--
+    return true;
+}
 
-    bool is_filter = false;
-    {
-        READLOCK(cs_pocfilter);
-        is_filter = pPocFilter->contains(hash);
-    }
-    LOG(BLOOM, "%s pocfilter: %d %s", (is_filter?"GET":"ADD"), height, hash.GetHex());
+static bool CheckProofOfCapacityInner(const CBlockHeader &header, int height, const Consensus::Params &params) {
+    uint256 hash = header.GetHash();
 
-    if (!is_filter) {
-        uint64_t dl = CalculateBest(height, header.sig, header.nPlotterId, header.nNonce)/header.nBaseTarget;
-        if (dl != header.nDeadline) {
-            LOGA("Failed to check deadline h=%d....%llu != %llu, pid=%d, sig: %s, bt: %llu, nonce: %llu", 
-                height, dl, header.nDeadline, header.nPlotterId, HexEncode(header.sig,32), header.nBaseTarget, header.nNonce);
+    if (!CheckProofOfCapacityFormat(header, hash, height, params))
+        return false;
+    if (height == 0)
+        return true;
+
+    if (ProofOfCapacityCheckNeeded(header, height)) {
+        if (!CheckProofOfCapacityDeadline(header, height))
             return false;
-        }
-        WRITELOCK(cs_pocfilter);
-        pPocFilter->insert (hash);
+        pPocFilter->insert (hash, height, header.nDeadline);
     }
     return true;
 }
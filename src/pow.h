@@ -10,6 +10,7 @@
 #include "consensus/params.h"
 
 #include <stdint.h>
+#include <vector>
 
 class CBlockHeader;
 class CBlockIndex;
@@ -43,7 +44,24 @@ uint32_t GetNextCashWorkRequired(const CBlockIndex *pindexPrev,
 void CalculateSignature(const CBlockIndex *pindex, unsigned char* sig);
 uint64_t CalculateBaseTarget(const CBlockIndex *pindex);
 uint64_t CalculateBest(int height, const unsigned char* gen_sig, uint64_t plotter_id, uint64_t nonce);
+/** CalculateBest for many nonces of one plotter, using the SIMD Shabal kernels to fill all vector lanes */
+std::vector<uint64_t> CalculateBestBatch(int height,
+    const unsigned char *gen_sig,
+    uint64_t plotter_id,
+    const std::vector<uint64_t> &nonces);
 
+/** Headers older than this are trusted without computing their deadline again */
+static const int64_t POC_CHECK_MAX_AGE = 86400 * 2;
+
+/** Whether the deadline of a header at this height has to be computed: it is recent and not in pPocFilter yet */
+bool ProofOfCapacityCheckNeeded(const CBlockHeader &header, int height);
+/** Compute the deadline of a header and compare it with the one the header claims */
+bool CheckProofOfCapacityDeadline(const CBlockHeader &header, int height);
+/** The checks that need no deadline computation; hash is the hash of header */
+bool CheckProofOfCapacityFormat(const CBlockHeader &header,
+    const uint256 &hash,
+    int height,
+    const Consensus::Params &params);
 bool CheckProofOfCapacity(uint256 hash, const Consensus::Params &params);
 bool CheckHeaderProofOfCapacity(const CBlockHeader &header, const Consensus::Params &params);
 
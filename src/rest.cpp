@@ -9,6 +9,8 @@
 #include "chainparams.h"
 #include "httpserver.h"
 #include "main.h"
+#include "mininginfo.h"
+#include "pocverify.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
@@ -233,17 +235,21 @@ static bool rest_block(HTTPRequest *req, const std::string &strURIPart, bool sho
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+    // The binary and hex formats are the bytes as they are stored, only JSON needs the block deserialized
+    CRawBlock rawBlock;
+    if (rf == RF_BINARY || rf == RF_HEX)
+    {
+        if (!ReadRawBlockFromDisk(rawBlock, pblockindex, Params().GetConsensus()))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+    }
+    else if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
         return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
-
     switch (rf)
     {
     case RF_BINARY:
     {
-        string binaryBlock = ssBlock.str();
+        string binaryBlock(rawBlock.begin(), rawBlock.end());
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
@@ -251,7 +257,7 @@ static bool rest_block(HTTPRequest *req, const std::string &strURIPart, bool sho
 
     case RF_HEX:
     {
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        string strHex = HexStr(rawBlock.begin(), rawBlock.end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
@@ -447,9 +453,14 @@ static const string findkv(const vector<string> &kvPairs, const string &key) {
     return "";
 }
 // A bit of a hack - dependency on a function defined in rpc/mining.cpp
-UniValue getMiningInfo(const UniValue &params, bool fHelp);
+std::shared_ptr<const CMiningInfo> GetMiningInfoForMiner(const std::string &strLastGenSig, int64_t nTimeout);
 // A bit of a hack - dependency on a function defined in rpc/mining.cpp
-UniValue submitNonce(const UniValue &params, bool fHelp);
+UniValue SubmitNonces(const UniValue &params, const CNetAddr *pPeer);
+// A bit of a hack - dependency on a function defined in rpc/mining.cpp
+uint64_t SubmitNonceBatch(const std::vector<CNonceShare> &shares,
+    uint64_t nHeight,
+    std::vector<CNonceResult> &results,
+    const CNetAddr *pPeer);
 
 //POST /burst?requestType=submitNonce&secretPhrase=%s&nonce=%llu
 static bool rest_burst(HTTPRequest *req, const std::string &strURIPart)
@@ -472,22 +483,55 @@ static bool rest_burst(HTTPRequest *req, const std::string &strURIPart)
     bool bRet = true;
     try {
         if (requestType == "getMiningInfo") {
-    		objResponse = getMiningInfo(objRequest, false);
+            //long poll with &generationSignature=<the one the miner has>[&timeout=<seconds>]
+            int64_t nTimeout = MAX_MINING_LONGPOLL;
+            ParseInt64(findkv(kvPairs, "timeout"), &nTimeout);
+            std::shared_ptr<const CMiningInfo> info = GetMiningInfoForMiner(findkv(kvPairs, "generationSignature"), nTimeout);
+            // served as built once for this tip
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReply(HTTP_OK, info->strJSON);
+            return true;
         } else if (requestType == "submitNonce") {
-       		objRequest.push_back(findkv(kvPairs, "nonce"));
-       		objRequest.push_back(findkv(kvPairs, "accountId"));
-
+            std::vector<CNonceShare> shares(1);
+            if (!ParseUint64(findkv(kvPairs, "nonce"), &shares[0].nNonce)) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "args nonce error");
+            }
+            if (!ParseUint64(findkv(kvPairs, "accountId"), &shares[0].nPlotterId)) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "args plotter id error");
+            }
+            if ((shares[0].nPlotterId >> 56) > 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "plotter id must less than 0x00ffffffffffffff");
+            }
+            ParseUint64(findkv(kvPairs, "deadline"), &shares[0].nDeadline);
         	uint64_t num = 0;
-        	if (ParseUint64(findkv(kvPairs, "height"), &num)) {
-           		// objRequest.push_back(num);
+        	ParseUint64(findkv(kvPairs, "height"), &num);
+
+            // REST clients are rate limited by address too, they choose the plotter ids
+            const CNetAddr peer = req->GetPeer();
+            std::vector<CNonceResult> results;
+            num = SubmitNonceBatch(shares, num, results, &peer);
+            if (results[0].fShed) {
+                throw JSONRPCError(RPC_MISC_ERROR, "share dropped: plotter is blacklisted or submitting too fast");
             }
-            objRequest.push_back(num);
-
-            uint64_t deadline = 0;
-            if (ParseUint64(findkv(kvPairs, "deadline"), &deadline) && deadline!=0){
-                objRequest.push_back(deadline);
+            objResponse.pushKV("height", num);
+            objResponse.pushKV("deadline", results[0].nDeadline);
+            objResponse.pushKV("accountId", shares[0].nPlotterId);
+            objResponse.pushKV("requestProcessingTime", 0);
+            objResponse.pushKV("is_fast", results[0].fFast);
+            objResponse.pushKV("is_update", results[0].fUpdate);
+        } else if (requestType == "submitNonces") {
+            //POST body: the JSON array of the submitNonces RPC
+            UniValue shares;
+            if (!shares.read(req->ReadBody()) || !shares.isArray()) {
+                throw JSONRPCError(RPC_PARSE_ERROR, "body must be a JSON array of shares");
             }
-    		objResponse = submitNonce(objRequest, false);
+            objRequest.push_back(shares);
+        	uint64_t num = 0;
+        	if (ParseUint64(findkv(kvPairs, "height"), &num)) {
+                objRequest.push_back(num);
+            }
+            const CNetAddr peer = req->GetPeer();
+            objResponse = SubmitNonces(objRequest, &peer);
         } else { //skip all other
             // if return not json , blago will crash
             // return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Error: skip all other requestType");
@@ -497,6 +541,10 @@ static bool rest_burst(HTTPRequest *req, const std::string &strURIPart)
         // return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, objError.write());
         objResponse = objError;
         bRet = false;
+    } catch (const std::exception &e) {
+        // a malformed body, nothing may escape to the HTTP worker
+        objResponse = JSONRPCError(RPC_INVALID_PARAMETER, e.what());
+        bRet = false;
     }
 
     // return json string
@@ -506,6 +554,110 @@ static bool rest_burst(HTTPRequest *req, const std::string &strURIPart)
 
     return bRet; // continue to process further HTTP reqs on this cxn
 }
+
+//POST /rest/submitnonces.<bin|hex|json>
+//bin and hex bodies carry the target height (uint64, 0 = next block) and a vector of CNonceShare,
+//and get the height used and a vector of CNonceResult back. json is the submitNonces RPC.
+static bool rest_submitnonces(HTTPRequest *req, const std::string &strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::string strBody = req->ReadBody();
+
+    switch (rf)
+    {
+    case RF_HEX:
+    case RF_BINARY:
+    {
+        if (rf == RF_HEX)
+        {
+            if (!IsHex(strBody))
+                return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+            std::vector<unsigned char> data = ParseHex(strBody);
+            strBody.assign(data.begin(), data.end());
+        }
+        uint64_t nHeight = 0;
+        std::vector<CNonceShare> shares;
+        try
+        {
+            CDataStream ss(strBody.data(), strBody.data() + strBody.size(), SER_NETWORK, PROTOCOL_VERSION);
+            ss >> nHeight;
+            ss >> shares;
+        }
+        catch (const std::ios_base::failure &e)
+        {
+            return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+        }
+        if (shares.size() > MAX_SUBMIT_NONCES)
+            return RESTERR(req, HTTP_BAD_REQUEST,
+                strprintf("Error: too many shares (max: %d, tried: %d)", MAX_SUBMIT_NONCES, shares.size()));
+        // the same plotter id check as the JSON shares get
+        for (const CNonceShare &share : shares)
+        {
+            if ((share.nPlotterId >> 56) > 0)
+                return RESTERR(req, HTTP_BAD_REQUEST, "Error: plotter id must less than 0x00ffffffffffffff");
+        }
+
+        const CNetAddr peer = req->GetPeer();
+        std::vector<CNonceResult> results;
+        try
+        {
+            nHeight = SubmitNonceBatch(shares, nHeight, results, &peer);
+        }
+        catch (const UniValue &objError)
+        {
+            return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, find_value(objError, "message").get_str());
+        }
+
+        CDataStream ssResult(SER_NETWORK, PROTOCOL_VERSION);
+        ssResult << nHeight << results;
+        std::string strResult = ssResult.str();
+        if (rf == RF_HEX)
+        {
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, HexStr(strResult.begin(), strResult.end()) + "\n");
+        }
+        else
+        {
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, strResult);
+        }
+        return true;
+    }
+
+    case RF_JSON:
+    {
+        UniValue shares;
+        if (!shares.read(strBody) || !shares.isArray())
+            return RESTERR(req, HTTP_BAD_REQUEST, "Error: body must be a JSON array of shares");
+        UniValue params(UniValue::VARR);
+        params.push_back(shares);
+        const CNetAddr peer = req->GetPeer();
+        UniValue objResponse;
+        try
+        {
+            objResponse = SubmitNonces(params, &peer);
+        }
+        catch (const UniValue &objError)
+        {
+            return RESTERR(req, HTTP_BAD_REQUEST, find_value(objError, "message").get_str());
+        }
+        catch (const std::exception &e)
+        {
+            return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: %s", e.what()));
+        }
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, objResponse.write() + "\n");
+        return true;
+    }
+
+    default:
+        return RESTERR(
+            req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+}
 // <--
 
 static bool rest_getutxos(HTTPRequest *req, const std::string &strURIPart)
@@ -730,6 +882,7 @@ static const struct
     {"/rest/headers/", rest_headers},
     {"/rest/getutxos", rest_getutxos},
 
+    {"/rest/submitnonces", rest_submitnonces}, //diskcoin
     {"/burst", rest_burst}, //diskcoin
     {"/diskcoin", rest_burst}, //diskcoin
 };
@@ -11,11 +11,14 @@
 #include "checkpoints.h"
 #include "coins.h"
 #include "consensus/validation.h"
+#include "dstencode.h"
 #include "hash.h"
 #include "main.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
+#include "shabal/stakedb.h"
+#include "stakereward.h"
 #include "streams.h"
 #include "sync.h"
 #include "tweak.h"
@@ -1592,6 +1595,92 @@ UniValue savemempool(const UniValue &params, bool fHelp)
     return NullUniValue;
 }
 
+UniValue getaddresspledge(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw std::runtime_error(
+            "getaddresspledge \"address\" ( minconf maxconf )\n"
+            "\nReturns the active pledges to an address, read from the pledge index (requires -pledgeindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"      (string, required) The diskcoin address pledged to\n"
+            "2. minconf          (numeric, optional, default=1) The minimum confirmations to filter\n"
+            "3. maxconf          (numeric, optional, default=9999999) The maximum confirmations to filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"address\" : \"address\",   (string) the address pledged to\n"
+            "  \"height\" : n,              (numeric) the height of the active chain\n"
+            "  \"total\" : x.xxx,           (numeric) the total of the pledges listed, in " +
+            CURRENCY_UNIT + "\n"
+                            "  \"pledges\" : [\n"
+                            "    {\n"
+                            "      \"txid\" : \"txid\",      (string) the pledge transaction id\n"
+                            "      \"vout\" : n,             (numeric) the pledged output\n"
+                            "      \"address\" : \"address\", (string) the address the pledged output pays to\n"
+                            "      \"amount\" : x.xxx,       (numeric) the amount pledged in " +
+            CURRENCY_UNIT + "\n"
+                            "      \"satoshi\" : n,          (numeric) the amount pledged in satoshis\n"
+                            "      \"height\" : n,           (numeric) the height of the block with the pledge\n"
+                            "      \"confirmations\" : n     (numeric) The number of confirmations\n"
+                            "    }\n"
+                            "    ,...\n"
+                            "  ]\n"
+                            "}\n"
+                            "\nExamples:\n" +
+            HelpExampleCli("getaddresspledge", "\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\"") +
+            HelpExampleRpc("getaddresspledge", "\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\", 6"));
+
+    if (!fPledgeIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "The pledge index is not enabled, restart with -pledgeindex -reindex");
+
+    CTxDestination dest = DecodeDestination(params[0].get_str());
+    if (!IsValidDestination(dest))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Diskcoin address: " + params[0].get_str());
+
+    int nMinDepth = 1;
+    if (params.size() > 1)
+        nMinDepth = params[1].get_int();
+    int nMaxDepth = 9999999;
+    if (params.size() > 2)
+        nMaxDepth = params[2].get_int();
+
+    LOCK(cs_main);
+    std::vector<std::pair<COutPoint, CPledgeAddressEntry> > vEntries;
+    if (!pblocktree->ReadPledgeAddressIndex(stakedb_key(GetScriptForDestination(dest)), vEntries))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the pledge index");
+
+    const int nTipHeight = chainActive.Height();
+    CAmount nTotal = 0;
+    UniValue pledges(UniValue::VARR);
+    for (const auto &item : vEntries)
+    {
+        int nDepth = nTipHeight - item.second.nHeight + 1;
+        if (nDepth < nMinDepth || nDepth > nMaxDepth)
+            continue;
+        // only unpledges unlist a pledge, one spent by an ordinary transaction is gone all the same
+        if (!pcoinsTip->HaveCoin(item.first))
+            continue;
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", item.first.hash.GetHex());
+        entry.pushKV("vout", (int)item.first.n);
+        CTxDestination address;
+        if (ExtractDestination(item.second.scriptPubKey, address))
+            entry.pushKV("address", EncodeDestination(address));
+        entry.pushKV("amount", ValueFromAmount(item.second.nValue));
+        entry.pushKV("satoshi", UniValue(item.second.nValue));
+        entry.pushKV("height", item.second.nHeight);
+        entry.pushKV("confirmations", nDepth);
+        pledges.push_back(entry);
+        nTotal += item.second.nValue;
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("address", EncodeDestination(dest));
+    result.pushKV("height", nTipHeight);
+    result.pushKV("total", ValueFromAmount(nTotal));
+    result.pushKV("pledges", pledges);
+    return result;
+}
+
 static const CRPCCommand commands[] = {
     //  category              name                      actor (function)         okSafeMode
     //  --------------------- ------------------------  -----------------------  ----------
@@ -1600,6 +1689,7 @@ static const CRPCCommand commands[] = {
     {"blockchain", "getblock", &getblock, true}, {"blockchain", "getblockhash", &getblockhash, true},
     {"blockchain", "getblockheader", &getblockheader, true}, {"blockchain", "getchaintips", &getchaintips, true},
     {"blockchain", "getdifficulty", &getdifficulty, true},
+    {"blockchain", "getaddresspledge", &getaddresspledge, true},
     {"blockchain", "getmempoolancestors", &getmempoolancestors, true},
     {"blockchain", "getmempooldescendants", &getmempooldescendants, true},
     {"blockchain", "getmempoolentry", &getmempoolentry, true}, {"blockchain", "getmempoolinfo", &getmempoolinfo, true},
@@ -58,9 +58,12 @@ static const CRPCConvertParam vRPCConvertParams[] = {{"stop", 0}, {"setmocktime"
     {"liststakeout", 0}, {"liststakeout", 1}, {"liststakeout", 2},
     {"listunstake", 0}, {"listunstake", 1}, {"listunstake", 2},
     {"staketo", 2},
+    {"getMiningInfo", 1},
+    {"submitNonces", 0}, {"submitNonces", 1},
     {"unstake", 1},
     {"listminedblock", 0}, {"listminedblock", 1}, {"listminedblock", 2},
     {"getaddrinfo", 0}, {"getaddrinfo", 1},
+    {"getaddresspledge", 1}, {"getaddresspledge", 2},
     {"ptest", 0},{"ptest", 1},
     //<--
     {"getmempooldescendants", 1}};
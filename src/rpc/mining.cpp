@@ -16,10 +16,14 @@
 #include "init.h"
 #include "main.h"
 #include "miner.h"
+#include "mininginfo.h"
 #include "net.h"
 #include "parallel.h"
+#include "plotterstats.h"
+#include "pocverify.h"
 #include "pow.h"
 #include "rpc/server.h"
+#include "stakereward.h"
 #include "txadmission.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -29,10 +33,6 @@
 #include "validationinterface.h"
 #include "shabal/stakedb.h"
 
-//add for diskcoin -->
-#include "crypto/aes.h"
-//<--
-
 #include <stdint.h>
 
 #include <boost/assign/list_of.hpp>
@@ -288,6 +288,21 @@ UniValue getmininginfo(const UniValue &params, bool fHelp)
             "  \"pooledtx\": n              (numeric) The size of the mem pool\n"
             "  \"testnet\": true|false      (boolean) If using testnet or not\n"
             "  \"chain\": \"xxxx\",         (string) current network name as defined in BIP70 (main, test, regtest)\n"
+            "  \"pocfilter\": {             (json object) cache of headers whose PoC deadline was verified\n"
+            "     \"entries\": n,           (numeric) headers in the cache\n"
+            "     \"diskentries\": n,       (numeric) records in the cache file\n"
+            "     \"pending\": n,           (numeric) headers not written to the cache file yet\n"
+            "     \"hits\": n,              (numeric) lookups that found the header\n"
+            "     \"misses\": n,            (numeric) lookups that had to compute the deadline\n"
+            "     \"evicted\": n,           (numeric) headers dropped before their height was pruned\n"
+            "     \"hitrate\": x.xxx,       (numeric) hits / (hits + misses)\n"
+            "     \"memory\": n             (numeric) bytes used by the in-memory index\n"
+            "  },\n"
+            "  \"mininginfo\": {            (json object) the getMiningInfo snapshot served to plot scanners\n"
+            "     \"height\": n,            (numeric) next block height in the snapshot, -1 if none yet\n"
+            "     \"reads\": n,             (numeric) times the snapshot was read\n"
+            "     \"stalereads\": n         (numeric) reads served while a newer tip was being connected\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmininginfo", "") + HelpExampleRpc("getmininginfo", ""));
@@ -307,6 +322,26 @@ UniValue getmininginfo(const UniValue &params, bool fHelp)
     obj.pushKV("testnet", Params().TestnetToBeDeprecatedFieldRPC());
     obj.pushKV("chain", Params().NetworkIDString());
     obj.pushKV("generate", getgenerate(params, false));
+
+    CPocFilterStats stats = pPocFilter->GetStats();
+    UniValue pocfilter(UniValue::VOBJ);
+    pocfilter.pushKV("entries", (uint64_t)stats.nEntries);
+    pocfilter.pushKV("diskentries", (uint64_t)stats.nDiskEntries);
+    pocfilter.pushKV("pending", (uint64_t)stats.nPending);
+    pocfilter.pushKV("hits", stats.nHits);
+    pocfilter.pushKV("misses", stats.nMisses);
+    pocfilter.pushKV("evicted", stats.nEvicted);
+    uint64_t nLookups = stats.nHits + stats.nMisses;
+    pocfilter.pushKV("hitrate", nLookups ? (double)stats.nHits / nLookups : 0.0);
+    pocfilter.pushKV("memory", (uint64_t)stats.nMemoryUsage);
+    obj.pushKV("pocfilter", pocfilter);
+
+    CMiningInfoStats infoStats = GetMiningInfoStats();
+    UniValue mininginfo(UniValue::VOBJ);
+    mininginfo.pushKV("height", infoStats.nHeight);
+    mininginfo.pushKV("reads", infoStats.nReads);
+    mininginfo.pushKV("stalereads", infoStats.nStaleReads);
+    obj.pushKV("mininginfo", mininginfo);
     return obj;
 }
 
@@ -1069,13 +1104,40 @@ UniValue estimatesmartpriority(const UniValue &params, bool fHelp)
     return result;
 }
 
+/**
+ * The mining info of the next block, waiting up to nTimeout seconds for it to no longer have the
+ * generation signature strLastGenSig if that is given. Throws a JSONRPCError while the node is syncing.
+ * Reads the published snapshot only, so it never waits for cs_main.
+ */
+std::shared_ptr<const CMiningInfo> GetMiningInfoForMiner(const std::string &strLastGenSig, int64_t nTimeout)
+{
+    std::shared_ptr<const CMiningInfo> info = GetMiningInfo();
+    if (!info || info->nTipTime + 2*86400 < GetTime()) {
+        throw JSONRPCError(RPC_IN_WARMUP, "wait init blocks ...");
+    }
+    const int tip_height = info->nHeight - 1;
+    int stake_height = stakedb_get_height();
+    if (stake_height==-1 || (tip_height != 0 && tip_height < stake_height)) {
+
+        throw JSONRPCError(RPC_IN_WARMUP, "wait down blocks ...");
+    }
+
+    if (!strLastGenSig.empty() && nTimeout > 0) {
+        info = WaitMiningInfo(strLastGenSig, std::min(nTimeout, MAX_MINING_LONGPOLL) * 1000);
+    }
+    return info;
+}
+
 UniValue getMiningInfo(const UniValue &params, bool fHelp)
 {
-    if (fHelp)
-	    throw runtime_error(
-	    	"getMiningInfo\n"
+    if (fHelp || params.size() > 2)
+        throw runtime_error(
+            "getMiningInfo ( \"generationSignature\" timeout )\n"
             "\nReturns a json object containing current mining information.\n"
-			"\nResult:\n"
+            "\nArguments:\n"
+            "1. \"generationSignature\" (string, optional) Long poll: wait until the generation signature is no longer this one\n"
+            "2. timeout               (numeric, optional, default=" + std::to_string(MAX_MINING_LONGPOLL) + ") Longest wait in seconds, at most " + std::to_string(MAX_MINING_LONGPOLL) + "\n"
+            "\nResult:\n"
             "{\n"
             "  \"height\": nnn,                 (integer) Next block height\n"
             "  \"baseTarget\": nnn,             (numeric) Next block base target\n"
@@ -1086,65 +1148,141 @@ UniValue getMiningInfo(const UniValue &params, bool fHelp)
             HelpExampleCli("getMiningInfo", "")+
             HelpExampleRpc("getMiningInfo", ""));
 
+    std::string strLastGenSig;
+    int64_t nTimeout = MAX_MINING_LONGPOLL;
+    if (params.size() > 0)
+        strLastGenSig = params[0].get_str();
+    if (params.size() > 1)
+        nTimeout = params[1].get_int64();
 
-	int height = -1;
-    const unsigned char *plain = (const unsigned char *)"";
-    int64_t bt = 0;
+    return GetMiningInfoForMiner(strLastGenSig, nTimeout)->result;
+}
 
-    CBlockIndex *pindex = chainActive.Tip();
-    if (!pindex || pindex->nTime + 2*86400 < GetTime()) {
-        throw JSONRPCError(RPC_IN_WARMUP, "wait init blocks ...");
+/**
+ * Verify a batch of shares for the block at nHeight (0: the next block), all against one snapshot of
+ * its generation signature and base target, and offer the best ones to the submit cache. Shares for
+ * the next block use the published mining info and never take cs_main.
+ * pPeer is the address of a REST client, which is rate limited as a whole besides per plotter.
+ * Returns the height used. Throws a JSONRPCError if it is not known or the node is still syncing.
+ */
+uint64_t SubmitNonceBatch(const std::vector<CNonceShare> &shares,
+    uint64_t nHeight,
+    std::vector<CNonceResult> &results,
+    const CNetAddr *pPeer)
+{
+    std::shared_ptr<const CMiningInfo> info = GetMiningInfoForMiner("", 0);
+    unsigned char signature[32];
+    uint64_t base_target = info->nBaseTarget;
+    const uint64_t next_height = info->nHeight;
+    memcpy(signature, info->genSig, 32);
+
+    if (nHeight > next_height) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "args height large than current height");
+    }
+    if (nHeight != 0 && nHeight < next_height) {
+        // a share for an earlier round, the only case that still needs the chain
+        LOGA("submitNonce height !==! %d <> %d", next_height, nHeight);
+        LOCK(cs_main);
+        const CBlockIndex *pblock = chainActive[nHeight];
+        if (NULL == pblock) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "get target block index error");
+        }
+        memcpy(signature, pblock->sig, 32);
+        base_target = pblock->nBaseTarget;
+    } else {
+        nHeight = next_height;
     }
-    int stake_height = stakedb_get_height();
-    if (stake_height==-1 || (pindex->nHeight != 0 && pindex->nHeight < stake_height)) {
 
-        throw JSONRPCError(RPC_IN_WARMUP, "wait down blocks ...");
+    int64_t nTimeStart = GetTimeMicros();
+    results.assign(shares.size(), CNonceResult());
+    std::vector<char> vSkip(shares.size(), 0);
+    for (size_t i = 0; i < shares.size(); i++) {
+        const CNonceShare &share = shares[i];
+        if (share.nDeadline != 0 && FastCheckSubmitCache(nHeight, share.nDeadline/base_target)) {
+            vSkip[i] = 1;
+            results[i].fFast = true;
+        }
     }
-    {
-        LOCK(cs_main);
-        height = chainActive.Height();
-        if (height >= 0) {
-            plain = chainActive.GetGenerationSignature();
-            bt = chainActive.GetBaseTarget();
+    // Only what is left costs a deadline computation, shed the shares of flooding plotters first
+    std::vector<char> vShed;
+    size_t nShed = plotterStats.Admit(shares, vSkip, vShed, pPeer);
+
+    int64_t nTimeVerify = GetTimeMicros();
+    std::vector<uint64_t> vDeadlines;
+    CalculateDeadlinesBatch(nHeight, signature, shares, vSkip, vDeadlines);
+    nTimeVerify = GetTimeMicros() - nTimeVerify;
+
+    std::vector<size_t> vOrder;
+    std::vector<char> vInvalid(shares.size(), 0);
+    size_t nNotMatch = 0;
+    for (size_t i = 0; i < shares.size(); i++) {
+        if (vShed[i]) {
+            results[i].fShed = true;
+            continue;
         }
+        if (results[i].fFast) {
+            vDeadlines[i] = shares[i].nDeadline;
+        } else {
+            vOrder.push_back(i);
+            if (shares[i].nDeadline != 0 && vDeadlines[i] != shares[i].nDeadline) {
+                vInvalid[i] = 1;
+                nNotMatch++;
+            }
+        }
+        results[i].nDeadline = vDeadlines[i]/base_target;
     }
-	if (-1 == height)
-	{
-		throw JSONRPCError(RPC_IN_WARMUP, "initialize blocks ...");
-	}
 
-	UniValue result(UniValue::VOBJ);
-	
-    bool need_encrypt = false; //encrypt anyway
-    // const unsigned char *plain = chainActive.GetGenerationSignature();
-    unsigned char cipher[33];
-
-    if (need_encrypt) {
-        unsigned char key[32];
-        snprintf((char*)key, sizeof(key)-1, "DISKCOIN%-8d", height+1);
-        AES128Encrypt enc(key);
-        enc.Encrypt(&cipher[0], plain);
-        enc.Encrypt(&cipher[16], plain+16);
-        plain = cipher;
+    // Only the best few can enter the submit cache
+    if (nHeight == next_height) {
+        size_t nOffer = std::min(vOrder.size(), (size_t)SUBMIT_CACHE_SIZE);
+        std::partial_sort(vOrder.begin(), vOrder.begin() + nOffer, vOrder.end(),
+            [&vDeadlines](size_t a, size_t b) { return vDeadlines[a] < vDeadlines[b]; });
+        for (size_t n = 0; n < nOffer; n++) {
+            size_t i = vOrder[n];
+            results[i].fUpdate = SetSubmitCache(nHeight, shares[i].nNonce, shares[i].nPlotterId, results[i].nDeadline);
+        }
     }
+    plotterStats.Record(shares, results, vInvalid, nHeight, nHeight == next_height, nTimeVerify, pPeer);
 
-	result.pushKV("height", height+1);
-	result.pushKV("baseTarget", i64tostr(bt));
-    result.pushKV("generationSignature", HexEncode(plain, 32));
-    if (need_encrypt) {
-        result.pushKV("targetDeadline", uint64_t(2147483647)); // int32 max value, encrypt
+    if (shares.size() == 1) {
+        LOGA("ToCalc(height,sig,pid,nonce)=(%d, %s, %llu, %llu)=%llu / %llu=%llu Fast?=%d NotMatch?=%d Update?=%d Shed?=%d", nHeight,
+            HexEncode(signature, 32), shares[0].nPlotterId, shares[0].nNonce, vDeadlines[0], base_target,
+            results[0].nDeadline, results[0].fFast, nNotMatch, results[0].fUpdate, nShed);
     } else {
-        result.pushKV("targetDeadline", uint64_t(4294967295)); // uint32 max value, not
+        LOGA("Submitted %u nonces for height %d: %u computed, %u fast, %u shed, %u not matching, in %.2fms", shares.size(),
+            nHeight, vOrder.size(), shares.size() - vOrder.size() - nShed, nShed, nNotMatch, 0.001 * (GetTimeMicros() - nTimeStart));
     }
-	
-	return result;
+    return nHeight;
+}
+
+static CNonceShare ParseNonceShare(const UniValue &nonce, const UniValue &plotterId, const UniValue &deadline)
+{
+    // check the types first, the UniValue getters throw std::runtime_error which REST callers would not catch
+    CNonceShare share;
+    if (!nonce.isStr() || !ParseUint64(nonce.get_str(), &share.nNonce))
+    {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "args nonce error");
+    }
+    if (!plotterId.isStr() || !ParseUint64(plotterId.get_str(), &share.nPlotterId))
+    {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "args plotter id error");
+    }
+    if ((share.nPlotterId >> 56) > 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "plotter id must less than 0x00ffffffffffffff");
+    }
+    if (!deadline.isNull()) {
+        if (!deadline.isNum())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "args deadline error");
+        share.nDeadline = deadline.get_uint64();
+    }
+    return share;
 }
 
 UniValue submitNonce(const UniValue &params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 4)
-	    throw runtime_error(
-	        "submitNonce nonce plotterId (height) (deadline)\n"
+        throw runtime_error(
+            "submitNonce nonce plotterId (height) (deadline)\n"
             "\nSubmit mining nonce, and returns a json object containing confirmed deadline."
             "\nArguments:\n"
             "1. \"nonce\"           (string, required) Nonce\n"
@@ -1161,99 +1299,24 @@ UniValue submitNonce(const UniValue &params, bool fHelp)
             HelpExampleCli("submitNonce", "\"6054938129616950179\" \"41530488751042841\" 123321")+
             HelpExampleRpc("submitNonce", "\"6054938129616950179\",\"41530488751042841\",123321"));
 
-    CBlockIndex *pindex = chainActive.Tip();
-    if (!pindex || pindex->nTime + 2*86400 < GetTime()) {
-        throw JSONRPCError(RPC_IN_WARMUP, "wait init blocks ...");
-    }
-    int stake_height = stakedb_get_height();
-    if (stake_height==-1 || (pindex->nHeight != 0 && pindex->nHeight < stake_height)) {
-        throw JSONRPCError(RPC_IN_WARMUP, "wait down blocks ...");
-    }
-
+    std::vector<CNonceShare> shares;
+    shares.push_back(ParseNonceShare(params[0], params[1], 4 <= params.size() ? params[3] : NullUniValue));
     uint64_t height = 0;
-    {
-        LOCK(cs_main);
-        height = chainActive.Height() + 1;
-    }
-    
-	uint64_t base_target = 0;
-	uint64_t nonce = 0;
-	uint64_t plotter_id = 0; 
-    uint64_t deadline = 0;
-	unsigned char signature[32] = {};
-
-	if (!ParseUint64(params[0].get_str(), &nonce))
-	{
-		throw JSONRPCError(RPC_INVALID_PARAMETER, "args nonce error");	
-	}
-	if (!ParseUint64(params[1].get_str(), &plotter_id))
-	{
-		throw JSONRPCError(RPC_INVALID_PARAMETER, "args plotter id error");	
-	}
-    if ((plotter_id >> 56) > 0) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "plotter id must less than 0x00ffffffffffffff");
-    }
-	
-    uint64_t tmph = 0;
-	if (3 <= params.size() && (tmph = params[2].get_uint64()) != 0)
-	{
-		if (tmph > height)
-		{
-			throw JSONRPCError(RPC_INVALID_PARAMETER, "args height large than current height");
-		}
-        if (tmph < height) {
-            LOGA("submitNonce height !==! %d <> %d", height, tmph);
-            height = tmph;
-
-            LOCK(cs_main);
-            const CBlockIndex *pblock = chainActive[height];
-            if (NULL == pblock)
-            {
-                throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "get target block index error");
-            }
-            memcpy(signature, pblock->GetBlockHeader().sig, 32);
-            base_target = pblock->GetBlockHeader().nBaseTarget;
-        } // else not set basetarget
-	} //not set basetarget
-	
-    if (base_target == 0) {
-        LOCK(cs_main);
-        // height = chainActive.Height() + 1;
-		memcpy(signature, chainActive.GetGenerationSignature(), 32);
-		base_target = chainActive.GetBaseTarget();
-	}
-
-    uint64_t retdl = 0;
-    bool is_fast=false, not_match=false, is_update=false;
-    if (4 <= params.size() && (deadline=params[3].get_uint64()) != 0 && FastCheckSubmitCache(height, deadline/base_target)) {
-        is_fast = true;
-        retdl = deadline; 
-    } else {
-        retdl = CalculateBest(height, signature, plotter_id, nonce);
-        if (deadline != 0 && retdl != deadline) {
-            not_match=true;
-        }
-        uint64_t height2 = 0;
-        {
-            LOCK(cs_main);
-            height2 = chainActive.Height()+1;
-        }
-        if (height == height2)
-        {
-            is_update = SetSubmitCache(height, nonce, plotter_id, retdl/base_target);
-        }
-    }
-    LOGA("ToCalc(height,sig,pid,nonce)=(%d, %s, %llu, %llu)=%llu / %llu=%llu Fast?=%d NotMatch?=%d Update?=%d", height, 
-        HexEncode(signature, 32), plotter_id, nonce, retdl, base_target, retdl/base_target, is_fast, not_match, is_update);
+    if (3 <= params.size())
+        height = params[2].get_uint64();
 
+    std::vector<CNonceResult> results;
+    height = SubmitNonceBatch(shares, height, results, nullptr);
+    if (results[0].fShed)
+        throw JSONRPCError(RPC_MISC_ERROR, "share dropped: plotter is blacklisted or submitting too fast");
 
-	UniValue result(UniValue::VOBJ);
-	result.pushKV("height", height);
-	result.pushKV("deadline", retdl/base_target);
-    result.pushKV("accountId", plotter_id);
-	result.pushKV("requestProcessingTime", 0);
-    result.pushKV("is_fast", is_fast);
-    result.pushKV("is_update", is_update);
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("height", height);
+    result.pushKV("deadline", results[0].nDeadline);
+    result.pushKV("accountId", shares[0].nPlotterId);
+    result.pushKV("requestProcessingTime", 0);
+    result.pushKV("is_fast", results[0].fFast);
+    result.pushKV("is_update", results[0].fUpdate);
 
     //just for solo, pool MUST be set to 0, otherwise it will not report its better dl
     /*CSubmit sm;
@@ -1262,9 +1325,85 @@ UniValue submitNonce(const UniValue &params, bool fHelp)
         result.pushKV("targetDeadline", sm.deadline);
     }
     */
+    return result;
+}
+
+/** The submitNonces RPC, for the shares of pPeer if they came over REST */
+UniValue SubmitNonces(const UniValue &params, const CNetAddr *pPeer)
+{
+    if (!params[0].isArray())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "shares must be an array");
+    const UniValue &arr = params[0].get_array();
+    if (arr.size() > MAX_SUBMIT_NONCES)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("too many shares (max: %d)", MAX_SUBMIT_NONCES));
+    std::vector<CNonceShare> shares;
+    shares.reserve(arr.size());
+    for (size_t i = 0; i < arr.size(); i++) {
+        if (!arr[i].isObject())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("share %u is not an object", i));
+        const UniValue &o = arr[i].get_obj();
+        shares.push_back(ParseNonceShare(find_value(o, "nonce"), find_value(o, "plotterId"), find_value(o, "deadline")));
+    }
+    uint64_t height = 0;
+    if (2 <= params.size()) {
+        if (!params[1].isNum())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "height must be a number");
+        height = params[1].get_uint64();
+    }
+
+    std::vector<CNonceResult> results;
+    height = SubmitNonceBatch(shares, height, results, pPeer);
+
+    UniValue list(UniValue::VARR);
+    for (size_t i = 0; i < shares.size(); i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("accountId", shares[i].nPlotterId);
+        entry.pushKV("deadline", results[i].nDeadline);
+        entry.pushKV("is_fast", results[i].fFast);
+        entry.pushKV("is_update", results[i].fUpdate);
+        entry.pushKV("is_shed", results[i].fShed);
+        list.push_back(entry);
+    }
+	UniValue result(UniValue::VOBJ);
+	result.pushKV("height", height);
+    result.pushKV("results", list);
 	return result;
 }
 
+UniValue submitNonces(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+	    throw runtime_error(
+	        "submitNonces [{\"nonce\":\"n\",\"plotterId\":\"id\",\"deadline\":n},...] (height)\n"
+            "\nSubmit many mining nonces at once. They are all verified against the same block,\n"
+            "in parallel, and the best ones are offered to the miner.\n"
+            "\nArguments:\n"
+            "1. \"shares\"          (array, required) At most " + std::to_string(MAX_SUBMIT_NONCES) + " objects with\n"
+            "     \"nonce\"         (string, required) Nonce\n"
+            "     \"plotterId\"     (string, required) Plotter ID\n"
+            "     \"deadline\"      (numeric, optional) original deadline\n"
+            "2. \"height\"          (numeric, optional) Target height for mining, default current mining height\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\": nnn,     (numeric) target block height\n"
+            "  \"results\": [       (array) one object per share, in order\n"
+            "    {\n"
+            "      \"accountId\": nnn, (numeric) plotter ID\n"
+            "      \"deadline\": nnn,  (numeric) confirmed deadline\n"
+            "      \"is_fast\": b,     (boolean) the original deadline was taken without computing it\n"
+            "      \"is_update\": b,   (boolean) it is the new best deadline\n"
+            "      \"is_shed\": b      (boolean) dropped without computing its deadline: the plotter is\n"
+            "                        blacklisted or over its rate (see getplotterstats)\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("submitNonces", "'[{\"nonce\":\"6054938129616950179\",\"plotterId\":\"41530488751042841\"}]'")+
+            HelpExampleRpc("submitNonces", "[{\"nonce\":\"6054938129616950179\",\"plotterId\":\"41530488751042841\"}]"));
+
+    return SubmitNonces(params, nullptr);
+}
+
 UniValue addblackplotterid(const UniValue &params, bool fHelp)
 {
     if (fHelp || 1 != params.size())
@@ -1287,6 +1426,119 @@ UniValue addblackplotterid(const UniValue &params, bool fHelp)
 	return result;
 }
 
+UniValue getplotterstats(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getplotterstats ( \"plotterId\" )\n"
+            "\nReturns the share accounting of the plotters that submitted nonces, busiest verification first.\n"
+            "\nArguments:\n"
+            "1. \"plotterId\"       (string, optional) Only return this plotter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"submitted\": n,      (numeric) shares received since startup\n"
+            "  \"verified\": n,       (numeric) shares whose deadline was computed\n"
+            "  \"invalid\": n,        (numeric) verified shares that did not have the deadline they claimed\n"
+            "  \"shed\": n,           (numeric) shares dropped before their deadline was computed\n"
+            "  \"plotters\": [\n"
+            "    {\n"
+            "      \"plotterId\": \"id\",  (string) plotter id\n"
+            "      \"submitted\": n,    (numeric) shares received\n"
+            "      \"verified\": n,     (numeric) shares whose deadline was computed\n"
+            "      \"invalid\": n,      (numeric) verified shares that did not have the deadline they claimed\n"
+            "      \"shed\": n,         (numeric) shares dropped before their deadline was computed\n"
+            "      \"bestheight\": n,   (numeric) height of its last share for the next block, -1 if none\n"
+            "      \"bestdeadline\": n, (numeric) its best deadline at bestheight\n"
+            "      \"verifytime\": n,   (numeric) its part of the time spent computing deadlines, in ms\n"
+            "      \"lastsubmit\": n    (numeric) time of its last submission\n"
+            "    },...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getplotterstats", "") + HelpExampleRpc("getplotterstats", "\"13312763941371615335\""));
+
+    uint64_t plotter_id = 0;
+    if (params.size() > 0 && !ParseUint64(params[0].get_str(), &plotter_id))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "args plotter id error");
+
+    std::vector<CPlotterShareStats> vStats = plotterStats.GetStats(plotter_id);
+    std::sort(vStats.begin(), vStats.end(), [](const CPlotterShareStats &a, const CPlotterShareStats &b) {
+        return a.nVerifyMicros > b.nVerifyMicros;
+    });
+
+    UniValue plotters(UniValue::VARR);
+    for (const CPlotterShareStats &stats : vStats)
+    {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("plotterId", std::to_string(stats.nPlotterId));
+        entry.pushKV("submitted", stats.nSubmitted);
+        entry.pushKV("verified", stats.nVerified);
+        entry.pushKV("invalid", stats.nInvalid);
+        entry.pushKV("shed", stats.nShed);
+        entry.pushKV("bestheight", stats.nBestHeight);
+        entry.pushKV("bestdeadline", stats.nBestDeadline);
+        entry.pushKV("verifytime", stats.nVerifyMicros / 1000);
+        entry.pushKV("lastsubmit", stats.nLastSubmit);
+        plotters.push_back(entry);
+    }
+
+    uint64_t nSubmitted, nVerified, nInvalid, nShed;
+    plotterStats.GetTotals(nSubmitted, nVerified, nInvalid, nShed);
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("submitted", nSubmitted);
+    result.pushKV("verified", nVerified);
+    result.pushKV("invalid", nInvalid);
+    result.pushKV("shed", nShed);
+    result.pushKV("plotters", plotters);
+    return result;
+}
+
+UniValue getstakeinfo(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getstakeinfo \"address\"\n"
+            "\nReturns the stake of an address and how the subsidy of the next block would be split if it mined it.\n"
+            "\nArguments:\n"
+            "1. \"address\"         (string, required) The miner address\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"address\": \"xxx\",     (string) The address\n"
+            "  \"height\": n,          (numeric) Height of the next block\n"
+            "  \"stakein\": x.xxx,     (numeric) Stake pledged to the address\n"
+            "  \"minedblock\": n,      (numeric) Blocks it mined in the last period, the next one included\n"
+            "  \"minedcoins\": x.xxx,  (numeric) Coins mined before the current period\n"
+            "  \"subsidy\": x.xxx,     (numeric) Subsidy of the next block\n"
+            "  \"minervalue\": x.xxx,  (numeric) The miner's part of it\n"
+            "  \"fundvalue\": x.xxx    (numeric) The fund's part of it\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getstakeinfo", "\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\"") +
+            HelpExampleRpc("getstakeinfo", "\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\""));
+
+    CTxDestination dest = DecodeDestination(params[0].get_str());
+    if (!IsValidDestination(dest))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    int nStakeHeight = stakedb_get_height();
+    if (nStakeHeight < 0)
+        throw JSONRPCError(RPC_IN_WARMUP, "stakedb is not loaded");
+
+    CStakeReward reward;
+    if (!GetStakeReward(nStakeHeight + 1, GetScriptForDestination(dest), Params().GetConsensus(), reward))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "failed to count the blocks mined by the address");
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("address", EncodeDestination(dest));
+    result.pushKV("height", reward.nHeight);
+    result.pushKV("stakein", ValueFromAmount(reward.nPledge));
+    result.pushKV("minedblock", (uint64_t)reward.nMinedBlocks);
+    result.pushKV("minedcoins", ValueFromAmount(reward.nMinedCoins));
+    result.pushKV("subsidy", ValueFromAmount(reward.nSubsidy));
+    result.pushKV("minervalue", ValueFromAmount(reward.nMinerValue));
+    result.pushKV("fundvalue", ValueFromAmount(reward.nFundValue));
+    return result;
+}
+
 static const CRPCCommand commands[] = {
     //  category              name                      actor (function)         okSafeMode
     //  --------------------- ------------------------  -----------------------  ----------
@@ -1299,7 +1551,10 @@ static const CRPCCommand commands[] = {
     // diskcoin
     {"mining", "getMiningInfo", &getMiningInfo, true},
     {"mining", "submitNonce", &submitNonce, true},
+    {"mining", "submitNonces", &submitNonces, true},
     {"mining", "addblackplotterid", &addblackplotterid, true},
+    {"mining", "getplotterstats", &getplotterstats, true},
+    {"mining", "getstakeinfo", &getstakeinfo, true},
 
     // {"generating", "generate", &generate, true}, 
     // {"generating", "generatetoaddress", &generatetoaddress, true},
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <stddef.h>
 #include "shabal/sph_shabal.h"
+#include "shabal/calc_dl.h"
 
 #define sM    16
 
@@ -511,15 +512,12 @@ static unsigned int calc_scoop (const char *signature, unsigned long long height
 	return (((unsigned char)xcache[31]) + 256 * (unsigned char)xcache[30]) % 4096;
 }
 
-#define SCOOP_SIZE 64
-#define NUM_SCOOPS 4096
-#define NONCE_SIZE (NUM_SCOOPS * SCOOP_SIZE)
+#define SCOOP_SIZE CALC_DL_SCOOP_SIZE
+#define NUM_SCOOPS CALC_DL_NUM_SCOOPS
+#define NONCE_SIZE CALC_DL_NONCE_SIZE
 
-#define HASH_SIZE 32
-#define HASH_CAP 4096
-
-#define SSE4_PARALLEL 4
-#define AVX2_PARALLEL 8
+#define HASH_SIZE CALC_DL_HASH_SIZE
+#define HASH_CAP CALC_DL_HASH_CAP
 
 #define SET_NONCE(gendata, nonce, offset)                                      \
   xv = (char *)&nonce;                                                         \
@@ -532,16 +530,24 @@ static unsigned int calc_scoop (const char *signature, unsigned long long height
   gendata[NONCE_SIZE + offset + 6] = xv[1];                                    \
   gendata[NONCE_SIZE + offset + 7] = xv[0]
 
-unsigned long long calc_dl(unsigned long long height, const unsigned char *sig, unsigned long long accid, unsigned long long nonce) {
-  	unsigned int scoop_nr = 0;
-  	// char sig[32 + 128];
-  	// xstr2strr(sig, 33, signature);
+// Deadline hash of a 64 byte scoop: shabal256(gensig || scoop), first 8 bytes.
+static unsigned long long calc_dl_from_scoop(const unsigned char *sig, const uint8_t *scoop) {
+	sph_shabal_context deadline_sc;
+	sph_shabal256_init(&deadline_sc);
+	sph_shabal256(&deadline_sc, sig, HASH_SIZE);
+
+	uint8_t finals2[HASH_SIZE];
+	sph_shabal256(&deadline_sc, scoop, SCOOP_SIZE);
+	sph_shabal256_close(&deadline_sc, (uint32_t *)finals2);
+	unsigned long long finals3;
+	memcpy(&finals3, finals2, sizeof(finals3));
+	return finals3;
+}
+
+// Nonce data of accid/nonce in gendata (16 + NONCE_SIZE bytes), not yet xored with its final hash.
+static void generate_nonce(char *gendata, char *final, unsigned long long accid, unsigned long long nonce) {
   	sph_shabal_context save_32;
   	sph_shabal256_init(&save_32);
-  	scoop_nr = calc_scoop ((const char*)sig, height, &save_32);
-
-  	char final[32];
-  	char gendata[16 + NONCE_SIZE];
   	char *xv;
 
   	SET_NONCE(gendata, accid, 0);
@@ -566,26 +572,200 @@ unsigned long long calc_dl(unsigned long long height, const unsigned char *sig,
   	memcpy(&x, &save_32, sizeof(save_32));
   	sph_shabal256(&x, (unsigned char *)gendata, 16 + NONCE_SIZE);
   	sph_shabal256_close(&x, final);
+}
 
-  // XOR with final
-  	for (int i = 0; i < NONCE_SIZE; i++)
-  		gendata[i] ^= (final[i % 32]);
+unsigned long long calc_dl(unsigned long long height, const unsigned char *sig, unsigned long long accid, unsigned long long nonce) {
+  	unsigned int scoop_nr = 0;
+  	// char sig[32 + 128];
+  	// xstr2strr(sig, 33, signature);
+  	sph_shabal_context save_32;
+  	sph_shabal256_init(&save_32);
+  	scoop_nr = calc_scoop ((const char*)sig, height, &save_32);
 
-  	sph_shabal_context deadline_sc;
-  // sph_shabal256_init(&deadline_sc);
-  	memcpy(&deadline_sc, &save_32, sizeof(save_32));
-  	sph_shabal256(&deadline_sc, (const unsigned char *)sig, HASH_SIZE);
+  	char final[32];
+  	char gendata[16 + NONCE_SIZE];
+  	generate_nonce(gendata, final, accid, nonce);
 
+  // XOR with final, only for the two scoop halves that are read back.
+  // The rest of the nonce is needed above for the final digest but its
+  // xored value is never used, so there is no point writing it.
   	uint8_t scoop[SCOOP_SIZE];
-  	memcpy(scoop, gendata + (scoop_nr * SCOOP_SIZE), 32);
-  	memcpy(scoop + 32, gendata + ((4095 - scoop_nr) * SCOOP_SIZE) + 32, 32);
-
-  	uint8_t finals2[HASH_SIZE];
-  	sph_shabal256(&deadline_sc, scoop, SCOOP_SIZE);
-  	sph_shabal256_close(&deadline_sc, (uint32_t *)finals2);
-  	unsigned long long *finals3 = (unsigned long long*)finals2;
-  // req->deadline = *(uint64_t *)finals2 / req->base_target;
-  	return *finals3;
+  	const char *lo = gendata + (scoop_nr * SCOOP_SIZE);
+  	const char *hi = gendata + ((4095 - scoop_nr) * SCOOP_SIZE) + 32;
+  	for (int i = 0; i < 32; i++) {
+  		scoop[i] = lo[i] ^ final[i];
+  		scoop[32 + i] = hi[i] ^ final[i];
+  	}
+
+  	return calc_dl_from_scoop(sig, scoop);
+}
+
+typedef void (*scoops_kernel)(unsigned int, unsigned long long, const unsigned long long *, unsigned char *,
+		unsigned char *);
+typedef void (*nonces_kernel)(unsigned long long, const unsigned long long *, unsigned char *, size_t,
+		unsigned char *);
+
+typedef struct {
+	size_t lanes;
+	const char *name;
+	scoops_kernel scoops;	// NULL for the standard one
+	nonces_kernel plot;
+} calc_dl_kernel;
+
+static const calc_dl_kernel kernel_standard = {1, "standard", NULL, NULL};
+#if defined(ENABLE_AVX512)
+static const calc_dl_kernel kernel_avx512 = {CALC_DL_AVX512_LANES, "avx512", shabal_scoops_avx512, shabal_nonces_avx512};
+#endif
+#if defined(ENABLE_AVX2)
+static const calc_dl_kernel kernel_avx2 = {CALC_DL_AVX2_LANES, "avx2", shabal_scoops_avx2, shabal_nonces_avx2};
+#endif
+#if defined(ENABLE_SSE41)
+static const calc_dl_kernel kernel_sse41 = {CALC_DL_SSE41_LANES, "sse4.1", shabal_scoops_sse41, shabal_nonces_sse41};
+#endif
+
+// Set once by the first caller, or to the standard kernel by calc_dl_self_test()
+static const calc_dl_kernel *selected_kernel = NULL;
+
+// Pick the widest lane-parallel kernel this CPU can run, or the standard one.
+static const calc_dl_kernel *detect_kernel(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+#if defined(ENABLE_AVX512)
+	if (__builtin_cpu_supports("avx512f"))
+		return &kernel_avx512;
+#endif
+#if defined(ENABLE_AVX2)
+	if (__builtin_cpu_supports("avx2"))
+		return &kernel_avx2;
+#endif
+#if defined(ENABLE_SSE41)
+	if (__builtin_cpu_supports("sse4.1"))
+		return &kernel_sse41;
+#endif
+#endif
+	return &kernel_standard;
+}
+
+static const calc_dl_kernel *select_kernel(void) {
+	const calc_dl_kernel *kernel = __atomic_load_n(&selected_kernel, __ATOMIC_ACQUIRE);
+	if (kernel)
+		return kernel;
+	// racing callers detect the same kernel, and a fallback already stored wins
+	const calc_dl_kernel *expected = NULL;
+	kernel = detect_kernel();
+	if (!__atomic_compare_exchange_n(&selected_kernel, &expected, kernel, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		kernel = expected;
+	return kernel;
+}
+
+const char *calc_dl_kernel_name(void) {
+	return select_kernel()->name;
+}
+
+size_t calc_dl_batch_lanes(void) {
+	return select_kernel()->lanes;
+}
+
+void calc_dl_batch(unsigned long long height, const unsigned char *sig, unsigned long long accid,
+		const unsigned long long *nonces, unsigned long long *deadlines, size_t count) {
+	const calc_dl_kernel *kernel = select_kernel();
+	size_t lanes = kernel->lanes, i = 0;
+
+	if (kernel->scoops && count >= lanes) {
+		// one working buffer for the whole batch, if there is no memory for it compute them one by one
+		unsigned char *work = (unsigned char *)malloc(CALC_DL_WORK_SIZE(lanes));
+		if (work) {
+			sph_shabal_context save_32;
+			sph_shabal256_init(&save_32);
+			unsigned int scoop_nr = calc_scoop((const char*)sig, height, &save_32);
+			uint8_t scoops[CALC_DL_AVX512_LANES * SCOOP_SIZE];
+
+			for (; i + lanes <= count; i += lanes) {
+				kernel->scoops(scoop_nr, accid, nonces + i, scoops, work);
+				for (size_t l = 0; l < lanes; l++)
+					deadlines[i + l] = calc_dl_from_scoop(sig, scoops + l * SCOOP_SIZE);
+			}
+			free(work);
+		}
+	}
+
+	// a partly filled vector costs as much as a full one, do the tail one by one
+	for (; i < count; i++)
+		deadlines[i] = calc_dl(height, sig, accid, nonces[i]);
+}
+
+int calc_dl_self_test(void) {
+	const calc_dl_kernel *kernel = select_kernel();
+	if (!kernel->scoops)
+		return 1;
+
+	// two full vectors of nonces spread over the whole range, for a valid plotter id
+	const unsigned long long accid = 0x00c0ffee12345678ULL;
+	const unsigned long long height = 123456;
+	unsigned char sig[HASH_SIZE];
+	unsigned long long nonces[2 * CALC_DL_AVX512_LANES];
+	unsigned long long deadlines[2 * CALC_DL_AVX512_LANES];
+	size_t count = 2 * kernel->lanes;
+	for (size_t i = 0; i < HASH_SIZE; i++)
+		sig[i] = (unsigned char)(i * 29 + 3);
+	for (size_t i = 0; i < count; i++)
+		nonces[i] = i * 0x9e3779b97f4a7c15ULL;
+
+	calc_dl_batch(height, sig, accid, nonces, deadlines, count);
+	for (size_t i = 0; i < count; i++) {
+		if (deadlines[i] != calc_dl(height, sig, accid, nonces[i])) {
+			__atomic_store_n(&selected_kernel, &kernel_standard, __ATOMIC_RELEASE);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void calc_plot_nonces(unsigned long long accid, const unsigned long long *nonces, size_t count,
+		unsigned char *out, size_t stride) {
+	const calc_dl_kernel *kernel = select_kernel();
+	size_t lanes = kernel->lanes, i = 0;
+
+	if (kernel->plot && count >= lanes) {
+		unsigned char *work = (unsigned char *)malloc(CALC_DL_WORK_SIZE(lanes));
+		if (!work)
+			abort();
+		for (; i + lanes <= count; i += lanes)
+			kernel->plot(accid, nonces + i, out + i * SCOOP_SIZE, stride, work);
+		free(work);
+	}
+
+	// the tail, or everything without a SIMD kernel, one nonce at a time
+	if (i < count) {
+		char *gendata = (char *)malloc(16 + NONCE_SIZE);
+		if (!gendata)
+			abort();
+		char final[32];
+		for (; i < count; i++) {
+			generate_nonce(gendata, final, accid, nonces[i]);
+			for (unsigned int s = 0; s < NUM_SCOOPS; s++) {
+				unsigned char *scoop = out + s * stride + i * SCOOP_SIZE;
+				const char *lo = gendata + (s * SCOOP_SIZE);
+				const char *hi = gendata + ((NUM_SCOOPS - 1 - s) * SCOOP_SIZE) + 32;
+				for (int j = 0; j < 32; j++) {
+					scoop[j] = lo[j] ^ final[j];
+					scoop[32 + j] = hi[j] ^ final[j];
+				}
+			}
+		}
+		free(gendata);
+	}
+}
+
+unsigned int calc_dl_scoop(unsigned long long height, const unsigned char *sig) {
+	sph_shabal_context save_32;
+	sph_shabal256_init(&save_32);
+	return calc_scoop((const char*)sig, height, &save_32);
+}
+
+void calc_dl_scoops(const unsigned char *sig, const unsigned char *scoops, unsigned long long *deadlines, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		deadlines[i] = calc_dl_from_scoop(sig, scoops + i * SCOOP_SIZE);
 }
 
 unsigned long long calc_dl_ex(unsigned long long height, const char *signature_hex, unsigned long long accid, unsigned long long nonce) {
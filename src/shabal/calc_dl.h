@@ -0,0 +1,60 @@
+/*
+ * Internal interface between calc_dl.c and the lane-parallel Shabal
+ * kernels (shabal_sse41.c, shabal_avx2.c, shabal_avx512.c).
+ */
+
+#ifndef SHABAL_CALC_DL_H
+#define SHABAL_CALC_DL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CALC_DL_SCOOP_SIZE 64
+#define CALC_DL_NUM_SCOOPS 4096
+#define CALC_DL_NONCE_SIZE (CALC_DL_NUM_SCOOPS * CALC_DL_SCOOP_SIZE)
+
+#define CALC_DL_HASH_SIZE 32
+#define CALC_DL_HASH_CAP 4096
+
+#define CALC_DL_SSE41_LANES 4
+#define CALC_DL_AVX2_LANES 8
+#define CALC_DL_AVX512_LANES 16
+
+/*
+ * Bytes of the working buffer a kernel of that many lanes needs: the
+ * interleaved nonce data of every lane, plus room to align it to the vector
+ * size.  The caller allocates it once and passes it to every call.
+ */
+#define CALC_DL_WORK_SIZE(lanes) ((CALC_DL_NONCE_SIZE + 16) * (lanes) + 64)
+
+/*
+ * Generate one nonce per lane for the given plotter id and copy scoop
+ * scoop_nr of each (already xored with the nonce's final hash, in the PoC2
+ * layout) to scoops, 64 bytes per lane.  work is CALC_DL_WORK_SIZE bytes.
+ */
+void shabal_scoops_sse41(unsigned int scoop_nr, unsigned long long accid, const unsigned long long *nonces,
+    unsigned char *scoops, unsigned char *work);
+void shabal_scoops_avx2(unsigned int scoop_nr, unsigned long long accid, const unsigned long long *nonces,
+    unsigned char *scoops, unsigned char *work);
+void shabal_scoops_avx512(unsigned int scoop_nr, unsigned long long accid, const unsigned long long *nonces,
+    unsigned char *scoops, unsigned char *work);
+
+/*
+ * Generate one whole nonce per lane, in the PoC2 layout, and write scoop s
+ * of lane l to out + s * stride + l * 64.  work is CALC_DL_WORK_SIZE bytes.
+ */
+void shabal_nonces_sse41(unsigned long long accid, const unsigned long long *nonces, unsigned char *out,
+    size_t stride, unsigned char *work);
+void shabal_nonces_avx2(unsigned long long accid, const unsigned long long *nonces, unsigned char *out,
+    size_t stride, unsigned char *work);
+void shabal_nonces_avx512(unsigned long long accid, const unsigned long long *nonces, unsigned char *out,
+    size_t stride, unsigned char *work);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,12 @@
+/*
+ * AVX2 build of the lane-parallel Shabal nonce kernel (8 nonces at once).
+ * Compiled with the AVX2 flags; only called after a runtime CPU check.
+ */
+
+#include "shabal/calc_dl.h"
+
+#define SHABAL_LANES CALC_DL_AVX2_LANES
+#define SHABAL_KERNEL shabal_scoops_avx2
+#define SHABAL_PLOT_KERNEL shabal_nonces_avx2
+
+#include "shabal/shabal_lanes.h"
@@ -0,0 +1,12 @@
+/*
+ * AVX-512F build of the lane-parallel Shabal nonce kernel (16 nonces at once).
+ * Compiled with the AVX-512F flags; only called after a runtime CPU check.
+ */
+
+#include "shabal/calc_dl.h"
+
+#define SHABAL_LANES CALC_DL_AVX512_LANES
+#define SHABAL_KERNEL shabal_scoops_avx512
+#define SHABAL_PLOT_KERNEL shabal_nonces_avx512
+
+#include "shabal/shabal_lanes.h"
@@ -0,0 +1,306 @@
+/*
+ * Lane-parallel Shabal-256 nonce generator.
+ *
+ * This file is a template: it is included by shabal_sse41.c, shabal_avx2.c
+ * and shabal_avx512.c, each of which defines SHABAL_LANES (4, 8 or 16),
+ * SHABAL_KERNEL and SHABAL_PLOT_KERNEL (the exported function names) and is
+ * compiled with the matching instruction set flags.  The state words are GCC/clang vector
+ * types, so every operation of the reference implementation in calc_dl.c
+ * runs on SHABAL_LANES independent nonces at once.
+ *
+ * All nonces of one call share the plotter id, so every hash in the chain
+ * has the same length in every lane and the lanes stay in lockstep.  The
+ * nonce buffer is kept interleaved by 32-bit word (word w of lane l lives in
+ * gendata[w][l]) so that a message word for all lanes is a single load.
+ */
+
+#ifndef SHABAL_LANES
+#error "SHABAL_LANES must be defined before including shabal_lanes.h"
+#endif
+#ifndef SHABAL_KERNEL
+#error "SHABAL_KERNEL must be defined before including shabal_lanes.h"
+#endif
+#ifndef SHABAL_PLOT_KERNEL
+#error "SHABAL_PLOT_KERNEL must be defined before including shabal_lanes.h"
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shabal/calc_dl.h"
+
+typedef uint32_t lane_u32 __attribute__((vector_size(SHABAL_LANES * 4)));
+
+#define LANE_BYTES (SHABAL_LANES * 4)
+
+/* nonce data plus the 16 trailing plotter id / nonce bytes, in words */
+#define GEN_WORDS ((CALC_DL_NONCE_SIZE + 16) / 4)
+#define HASH_WORDS (CALC_DL_HASH_SIZE / 4)
+#define HASH_CAP_WORDS (CALC_DL_HASH_CAP / 4)
+
+#define LROT(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define LPERM_ELT(xa0, xa1, xb0, xb1, xb2, xb3, xc, xm)                        \
+    do                                                                         \
+    {                                                                          \
+        xa0 = ((xa0 ^ (LROT(xa1, 15) * 5U) ^ xc) * 3U) ^ xb1 ^ (xb2 & ~xb3) ^ xm; \
+        xb0 = ~(LROT(xb0, 1) ^ xa0);                                           \
+    } while (0)
+
+#define LPERM_ROW(a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, aa, ab)              \
+    do                                                                         \
+    {                                                                          \
+        LPERM_ELT(a0, ab, B[0x0], B[0xD], B[0x9], B[0x6], C[0x8], M[0x0]);     \
+        LPERM_ELT(a1, a0, B[0x1], B[0xE], B[0xA], B[0x7], C[0x7], M[0x1]);     \
+        LPERM_ELT(a2, a1, B[0x2], B[0xF], B[0xB], B[0x8], C[0x6], M[0x2]);     \
+        LPERM_ELT(a3, a2, B[0x3], B[0x0], B[0xC], B[0x9], C[0x5], M[0x3]);     \
+        LPERM_ELT(a4, a3, B[0x4], B[0x1], B[0xD], B[0xA], C[0x4], M[0x4]);     \
+        LPERM_ELT(a5, a4, B[0x5], B[0x2], B[0xE], B[0xB], C[0x3], M[0x5]);     \
+        LPERM_ELT(a6, a5, B[0x6], B[0x3], B[0xF], B[0xC], C[0x2], M[0x6]);     \
+        LPERM_ELT(a7, a6, B[0x7], B[0x4], B[0x0], B[0xD], C[0x1], M[0x7]);     \
+        LPERM_ELT(a8, a7, B[0x8], B[0x5], B[0x1], B[0xE], C[0x0], M[0x8]);     \
+        LPERM_ELT(a9, a8, B[0x9], B[0x6], B[0x2], B[0xF], C[0xF], M[0x9]);     \
+        LPERM_ELT(aa, a9, B[0xA], B[0x7], B[0x3], B[0x0], C[0xE], M[0xA]);     \
+        LPERM_ELT(ab, aa, B[0xB], B[0x8], B[0x4], B[0x1], C[0xD], M[0xB]);     \
+        LPERM_ELT(a0, ab, B[0xC], B[0x9], B[0x5], B[0x2], C[0xC], M[0xC]);     \
+        LPERM_ELT(a1, a0, B[0xD], B[0xA], B[0x6], B[0x3], C[0xB], M[0xD]);     \
+        LPERM_ELT(a2, a1, B[0xE], B[0xB], B[0x7], B[0x4], C[0xA], M[0xE]);     \
+        LPERM_ELT(a3, a2, B[0xF], B[0xC], B[0x8], B[0x5], C[0x9], M[0xF]);     \
+    } while (0)
+
+typedef struct
+{
+    lane_u32 A[12], B[16], C[16];
+    uint32_t Wlow, Whigh;
+} lane_state;
+
+static const uint32_t lane_A_init[12] = {0x52F84552, 0xE54B7999, 0x2D8EE3EC, 0xB9645191, 0xE0078B86, 0xBB7C44C9,
+    0xD2B5C1CA, 0xB0D2EB8C, 0x14CE5A45, 0x22AF50DC, 0xEFFDBC6B, 0xEB21B74A};
+static const uint32_t lane_B_init[16] = {0xB555C6EE, 0x3E710596, 0xA72A652F, 0x9301515F, 0xDA28C1FA, 0x696FD868,
+    0x9CB6BF72, 0x0AFE4002, 0xA6E03615, 0x5138C1D4, 0xBE216306, 0xB38B8890, 0x3EA8B96B, 0x3299ACE4, 0x30924DD4,
+    0x55CB34A5};
+static const uint32_t lane_C_init[16] = {0xB405F031, 0xC4233EBA, 0xB3733979, 0xC0DD9D55, 0xC51C28AE, 0xA327B8E1,
+    0x56C56167, 0xED614433, 0x88B59D60, 0x60E2CEBA, 0x758B4B8B, 0x83E82A7F, 0xBC968828, 0xE6E00BF7, 0xBA839E55,
+    0x9B491C60};
+
+static inline lane_u32 lane_splat(uint32_t v)
+{
+    lane_u32 r;
+    for (int i = 0; i < SHABAL_LANES; i++)
+        r[i] = v;
+    return r;
+}
+
+static inline void lane_init(lane_state *s)
+{
+    for (int i = 0; i < 12; i++)
+        s->A[i] = lane_splat(lane_A_init[i]);
+    for (int i = 0; i < 16; i++)
+    {
+        s->B[i] = lane_splat(lane_B_init[i]);
+        s->C[i] = lane_splat(lane_C_init[i]);
+    }
+    s->Wlow = 1;
+    s->Whigh = 0;
+}
+
+/* One application of the keyed permutation P on message block M. */
+static inline void lane_apply_p(lane_state *s, const lane_u32 *M)
+{
+    lane_u32 *B = s->B;
+    const lane_u32 *C = s->C;
+    lane_u32 A0 = s->A[0], A1 = s->A[1], A2 = s->A[2], A3 = s->A[3], A4 = s->A[4], A5 = s->A[5];
+    lane_u32 A6 = s->A[6], A7 = s->A[7], A8 = s->A[8], A9 = s->A[9], AA = s->A[10], AB = s->A[11];
+
+    A0 ^= s->Wlow;
+    A1 ^= s->Whigh;
+    for (int i = 0; i < 16; i++)
+        B[i] = LROT(B[i], 17);
+
+    LPERM_ROW(A0, A1, A2, A3, A4, A5, A6, A7, A8, A9, AA, AB);
+    LPERM_ROW(A4, A5, A6, A7, A8, A9, AA, AB, A0, A1, A2, A3);
+    LPERM_ROW(A8, A9, AA, AB, A0, A1, A2, A3, A4, A5, A6, A7);
+
+    AB += C[0x6];
+    AA += C[0x5];
+    A9 += C[0x4];
+    A8 += C[0x3];
+    A7 += C[0x2];
+    A6 += C[0x1];
+    A5 += C[0x0];
+    A4 += C[0xF];
+    A3 += C[0xE];
+    A2 += C[0xD];
+    A1 += C[0xC];
+    A0 += C[0xB];
+    AB += C[0xA];
+    AA += C[0x9];
+    A9 += C[0x8];
+    A8 += C[0x7];
+    A7 += C[0x6];
+    A6 += C[0x5];
+    A5 += C[0x4];
+    A4 += C[0x3];
+    A3 += C[0x2];
+    A2 += C[0x1];
+    A1 += C[0x0];
+    A0 += C[0xF];
+    AB += C[0xE];
+    AA += C[0xD];
+    A9 += C[0xC];
+    A8 += C[0xB];
+    A7 += C[0xA];
+    A6 += C[0x9];
+    A5 += C[0x8];
+    A4 += C[0x7];
+    A3 += C[0x6];
+    A2 += C[0x5];
+    A1 += C[0x4];
+    A0 += C[0x3];
+
+    s->A[0] = A0, s->A[1] = A1, s->A[2] = A2, s->A[3] = A3, s->A[4] = A4, s->A[5] = A5;
+    s->A[6] = A6, s->A[7] = A7, s->A[8] = A8, s->A[9] = A9, s->A[10] = AA, s->A[11] = AB;
+}
+
+static inline void lane_swap_bc(lane_state *s)
+{
+    for (int i = 0; i < 16; i++)
+    {
+        lane_u32 t = s->B[i];
+        s->B[i] = s->C[i];
+        s->C[i] = t;
+    }
+}
+
+/*
+ * Hash nwords interleaved message words starting at msg and write the
+ * 8-word digest of every lane to out.  Equivalent to sph_shabal256_init,
+ * sph_shabal256 and sph_shabal256_close on each lane's byte string.
+ */
+static void lane_hash(const lane_u32 *msg, size_t nwords, lane_u32 *out)
+{
+    lane_state s;
+    lane_u32 M[16];
+    size_t i;
+
+    lane_init(&s);
+    for (; nwords >= 16; nwords -= 16, msg += 16)
+    {
+        for (i = 0; i < 16; i++)
+            s.B[i] += msg[i];
+        lane_apply_p(&s, msg);
+        for (i = 0; i < 16; i++)
+            s.C[i] -= msg[i];
+        lane_swap_bc(&s);
+        if ((s.Wlow = s.Wlow + 1) == 0)
+            s.Whigh++;
+    }
+
+    /* final block: remaining words, the 0x80 end marker, zero padding */
+    for (i = 0; i < nwords; i++)
+        M[i] = msg[i];
+    M[i++] = lane_splat(0x80);
+    for (; i < 16; i++)
+        M[i] = lane_splat(0);
+
+    for (i = 0; i < 16; i++)
+        s.B[i] += M[i];
+    lane_apply_p(&s, M);
+    for (int j = 0; j < 3; j++)
+    {
+        lane_swap_bc(&s);
+        lane_apply_p(&s, M);
+    }
+
+    for (i = 0; i < 8; i++)
+        out[i] = s.B[8 + i];
+}
+
+static inline uint32_t lane_bswap32(uint32_t x)
+{
+    return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+/*
+ * Generate the nonce of every lane: the interleaved nonce data (not yet xored)
+ * in work, aligned to the vector size, and the final hash it has to be xored
+ * with.  Returns where in work the nonce data starts.
+ */
+static lane_u32 *lane_generate(unsigned long long accid,
+    const unsigned long long *nonces,
+    unsigned char *work,
+    lane_u32 *final)
+{
+    lane_u32 *gendata = (lane_u32 *)(work + (LANE_BYTES - ((uintptr_t)work % LANE_BYTES)) % LANE_BYTES);
+    int l;
+    size_t w;
+
+    /* plotter id and nonce are appended big-endian, as in SET_NONCE */
+    lane_u32 *tail = gendata + CALC_DL_NONCE_SIZE / 4;
+    tail[0] = lane_splat(lane_bswap32((uint32_t)(accid >> 32)));
+    tail[1] = lane_splat(lane_bswap32((uint32_t)accid));
+    for (l = 0; l < SHABAL_LANES; l++)
+    {
+        tail[2][l] = lane_bswap32((uint32_t)(nonces[l] >> 32));
+        tail[3][l] = lane_bswap32((uint32_t)nonces[l]);
+    }
+
+    for (w = CALC_DL_NONCE_SIZE / 4; w > 0; w -= HASH_WORDS)
+    {
+        size_t len = GEN_WORDS - w;
+        if (len > HASH_CAP_WORDS)
+            len = HASH_CAP_WORDS;
+        lane_hash(gendata + w, len, gendata + w - HASH_WORDS);
+    }
+    lane_hash(gendata, GEN_WORDS, final);
+    return gendata;
+}
+
+/* Copy scoop scoop_nr of lane l, xored with final, in the PoC2 layout */
+static inline void lane_scoop(const lane_u32 *gendata,
+    const lane_u32 *final,
+    unsigned int scoop_nr,
+    int l,
+    unsigned char *out)
+{
+    uint32_t scoop[CALC_DL_SCOOP_SIZE / 4];
+    const lane_u32 *lo = gendata + scoop_nr * (CALC_DL_SCOOP_SIZE / 4);
+    const lane_u32 *hi = gendata + (CALC_DL_NUM_SCOOPS - 1 - scoop_nr) * (CALC_DL_SCOOP_SIZE / 4) + HASH_WORDS;
+    for (size_t w = 0; w < HASH_WORDS; w++)
+    {
+        scoop[w] = lo[w][l] ^ final[w][l];
+        scoop[HASH_WORDS + w] = hi[w][l] ^ final[w][l];
+    }
+    memcpy(out, scoop, CALC_DL_SCOOP_SIZE);
+}
+
+void SHABAL_KERNEL(unsigned int scoop_nr,
+    unsigned long long accid,
+    const unsigned long long *nonces,
+    unsigned char *scoops,
+    unsigned char *work)
+{
+    lane_u32 final[HASH_WORDS];
+    lane_u32 *gendata = lane_generate(accid, nonces, work, final);
+
+    /* only the two scoop halves are needed, so xor with final just there */
+    for (int l = 0; l < SHABAL_LANES; l++)
+        lane_scoop(gendata, final, scoop_nr, l, scoops + l * CALC_DL_SCOOP_SIZE);
+}
+
+void SHABAL_PLOT_KERNEL(unsigned long long accid,
+    const unsigned long long *nonces,
+    unsigned char *out,
+    size_t stride,
+    unsigned char *work)
+{
+    lane_u32 final[HASH_WORDS];
+    lane_u32 *gendata = lane_generate(accid, nonces, work, final);
+
+    for (unsigned int s = 0; s < CALC_DL_NUM_SCOOPS; s++)
+    {
+        for (int l = 0; l < SHABAL_LANES; l++)
+            lane_scoop(gendata, final, s, l, out + s * stride + l * CALC_DL_SCOOP_SIZE);
+    }
+}
@@ -0,0 +1,12 @@
+/*
+ * SSE4.1 build of the lane-parallel Shabal nonce kernel (4 nonces at once).
+ * Compiled with the SSE4.1 flags; only called after a runtime CPU check.
+ */
+
+#include "shabal/calc_dl.h"
+
+#define SHABAL_LANES CALC_DL_SSE41_LANES
+#define SHABAL_KERNEL shabal_scoops_sse41
+#define SHABAL_PLOT_KERNEL shabal_nonces_sse41
+
+#include "shabal/shabal_lanes.h"
@@ -123,6 +123,48 @@ void sph_shabal_openclose_fast(void* scoop_data, void* gen_sig, void* dst);
 
 unsigned long long calc_dl(unsigned long long height, const unsigned char *sig, unsigned long long accid, unsigned long long nonce);
 
+/**
+ * Compute the deadlines of count nonces of one plotter id, as calc_dl()
+ * would, using the widest SIMD Shabal kernel the CPU supports (4, 8 or 16
+ * nonces in lockstep).  Leftover nonces that do not fill a vector fall back
+ * to calc_dl().
+ */
+void calc_dl_batch(unsigned long long height, const unsigned char *sig, unsigned long long accid,
+		const unsigned long long *nonces, unsigned long long *deadlines, size_t count);
+
+/** Number of nonces calc_dl_batch() computes at once on this CPU. */
+size_t calc_dl_batch_lanes(void);
+
+/** Name of the Shabal kernel calc_dl_batch() uses on this CPU. */
+const char *calc_dl_kernel_name(void);
+
+/**
+ * Check that calc_dl_batch() gives the deadlines calc_dl() does for two full
+ * vectors of nonces.  On a mismatch the SIMD kernels are turned off for good,
+ * calc_dl_batch() and calc_plot_nonces() then compute one nonce at a time,
+ * and 0 is returned.
+ */
+int calc_dl_self_test(void);
+
+/** The scoop every nonce is read at for the block at height with generation signature sig. */
+unsigned int calc_dl_scoop(unsigned long long height, const unsigned char *sig);
+
+/**
+ * Compute the raw deadlines of count 64 byte scoops read from a PoC2 plot,
+ * as calc_dl() would for the nonces they belong to.  This is what a plot
+ * scanner does per nonce: no nonce is generated, only the scoop is hashed.
+ */
+void calc_dl_scoops(const unsigned char *sig, const unsigned char *scoops, unsigned long long *deadlines, size_t count);
+
+/**
+ * Generate count whole nonces of plotter id accid in the PoC2 layout, with
+ * the SIMD Shabal kernels where they fill a vector.  Scoop s of nonces[i] is
+ * written to out + s * stride + i * 64, so with stride = 64 * n the nonces
+ * come out already transposed the way a plot file stores them.
+ */
+void calc_plot_nonces(unsigned long long accid, const unsigned long long *nonces, size_t count,
+		unsigned char *out, size_t stride);
+
 
 #ifdef  __cplusplus
 }
@@ -1,6 +1,4 @@
 //stakedb.cpp
-#include "shabal/linux_list.h"
-#include "shabal/bpool.h"
 #include "shabal/stakedb.h"
 #include "blockstorage/blockstorage.h"
 #include "script/standard.h"
@@ -8,13 +6,33 @@
 #include "chainparams.h"
 #include "chain.h"
 #include "coins.h"
+#include "crypto/common.h"
 #include "dstencode.h"
+#include "hash.h"
 #include "main.h"
+#include "sync.h"
+#include "txdb.h"
 #include "validation/validation.h"
+#include "validationinterface.h"
+
+#include <deque>
+#include <map>
+#include <unordered_map>
 
 #define STAKE_FMAXSIZE (8*1024*1024)
-#define STAKE_BUCKET 1024
+//slots in the stake table when it is created; it doubles whenever it gets 70% full
+#define STAKE_TABLE_MIN 1024
+//version 1 records are a '\0' padded address string and the stake, version 2 ones the stakedb_key and the stake
+#define STAKE_VERSION 2
+#define STAKE_V1_ITEM_LEN (64 + 8)
+#define STAKE_ITEM_LEN (32 + 8)
 #define SAVED_ALIGN 100
+//undo records kept for reorgs. The file is saved SAVED_ALIGN blocks back, so keep more than that
+#define STAKE_UNDO_BLOCKS (2*SAVED_ALIGN)
+//stakedb_get_mined counts the miners of this many blocks up to added_height
+#define MINED_WINDOW (uPeriod - 1)
+//blocks that left the window are kept this much longer, so disconnecting back into it needs no disk read
+#define MINED_KEEP (MINED_WINDOW + STAKE_UNDO_BLOCKS)
 
 typedef struct {
 	int 			version;
@@ -22,151 +40,338 @@ typedef struct {
 	uint256 		sync_block_hash; //last block hash
 } stake_head_t;
 
+//open addressing with linear probing, the key is already a hash
 typedef struct {
-	char 				addr[64];  //force len=64.   end with '\0'
-	int64_t  			val; //hnode: stake amt； lnode: block height
-	union {
-		struct hlist_node 	hnode;
-		struct list_head 	lnode;
-	};
-} stake_addr_t;
-#define STAKE_ADDR_ITEM_LEN (sizeof(stake_addr_t) - sizeof(struct hlist_node))
+	uint256 			key; //stakedb_key, null: free slot
+	int64_t  			val; //stake amt
+} stake_slot_t;
 
 typedef struct {
 	char 				fname[1024];
 	stake_head_t 		shead;
 	int 				added_height;
 	uint256 			added_block_hash;
-	struct hlist_head 	hhead[STAKE_BUCKET];   //all sync block
-	struct hlist_head   inchead[2][STAKE_BUCKET]; //increase block.
-	struct list_head    miner_list; 				//keep block count : 1800+SAVED_ALIGN
-	int 				len_miner_list; 		
-	bpool_t 	 		bp; 						 //bpool
 } stake_t;
 
+//What one block changed, so that it can be disconnected without reading it again
+typedef struct {
+	int 				height;
+	uint256 			prev_hash;
+	std::vector<std::pair<uint256, CAmount> > deltas; //pledge changes, in block order
+} stake_undo_t;
+
+typedef struct {
+	int 				height;
+	uint256 			key; //stakedb_key of the coinbase miner output, null if there is none
+} stake_mined_t;
+
 static char *s_stake_buf;
 static stake_t s_stake;
+static std::vector<stake_slot_t> s_stake_slots; //stake at added_height, size is a power of two
+static size_t s_stake_used;
+static std::deque<stake_undo_t> s_stake_undo; //oldest first, the last one is added_height
+static std::unordered_map<uint256, CAmount, BlockHasher> s_stake_pledges; //pledges seen since startup and not unpledged
+static std::deque<stake_mined_t> s_mined; //consecutive blocks, oldest first, the last one is added_height
+static std::unordered_map<uint256, int, BlockHasher> s_mined_count; //blocks mined in the last MINED_WINDOW of s_mined
+static CCriticalSection cs_stakedb;
 
 static void stakedb_cleanup ();
-static int load_buf_to_list (const char *buf, long fsize);
-static long save_list_to_buf (char *buf, long bsize);
-static stake_addr_t *stake_find_addr (struct hlist_head *head, const char *addr);
-static CBlockIndex *find_next_block_idx (const CBlockIndex *pBlockIndex, const uint256 now_hash);
-static int stakedb_step_to (CBlockIndex *pBlockIndex);
+static int load_buf_to_table (const char *buf, long fsize);
+static long save_table_to_buf (char *buf, long bsize, const CBlockIndex *pBlockIndex);
+static size_t stake_find (const uint256 &key);
+static void stake_add (const uint256 &key, CAmount amt);
+static int stakedb_connect_block (const CBlock &block, const CBlockIndex *pBlockIndex);
+static int stakedb_disconnect_tip ();
+static int stakedb_step_to (const CBlockIndex *pBlockIndex);
+static int stakedb_reset (const char *fname);
+static bool stake_find_pledge (const uint256 &txid, CAmount &amt);
+static void stake_mined_push (int height, const uint256 &key);
+static void stake_mined_pop (int height);
+static int stake_mined_fill (const CBlockIndex *pBlockIndex);
+
+class CStakeDBListener : public CValidationInterface
+{
+protected:
+	void BlockConnected (const CBlock &block, const CBlockIndex *pindex) override;
+	void BlockDisconnected (const CBlock &block, const CBlockIndex *pindex) override;
+};
+static CStakeDBListener s_stake_listener;
 
 
 
 static void stakedb_cleanup () {
-	if (s_stake.fname[0]) {
-		bpool_cleanup (&s_stake.bp);
-
-		memset (&s_stake, 0, sizeof(s_stake));
-	}
+	memset (&s_stake, 0, sizeof(s_stake));
+	s_stake_slots.assign (STAKE_TABLE_MIN, stake_slot_t());
+	s_stake_used = 0;
+	s_stake_undo.clear();
+	s_mined.clear();
+	s_mined_count.clear();
 }
 
-static int load_buf_to_list (const char *buf, long fsize) {
+static int load_buf_to_table (const char *buf, long fsize) {
 	long off = sizeof(stake_head_t);
 	stake_head_t *shead = (stake_head_t*)buf;
-	stake_addr_t *saddr;
 
-	if (shead->version != 1) {
-		LOGAF("version error...must 1");
+	if (shead->version != 1 && shead->version != STAKE_VERSION) {
+		LOGAF("version error...%d", shead->version);
 		return -1;
 	}
 	memcpy (&s_stake.shead, buf, sizeof(stake_head_t));
 	s_stake.added_height = s_stake.shead.sync_height;
 	s_stake.added_block_hash = s_stake.shead.sync_block_hash;
 
-	stake_addr_t *paddr = (stake_addr_t*)(buf + sizeof(stake_head_t));
+	if (shead->version == 1) {
+		//migrate: the next save writes the current version
+		for (; off + STAKE_V1_ITEM_LEN <= fsize; off += STAKE_V1_ITEM_LEN) {
+			char addr[65] = {0};
+			memcpy (addr, buf+off, 64);
+			CTxDestination dest = DecodeDestination(addr);
+			if (!IsValidDestination(dest)) {
+				LOGAF("skip invalid address %s", addr);
+				continue;
+			}
+			stake_add (stakedb_key (GetScriptForDestination(dest)), (int64_t)ReadLE64((const unsigned char*)buf+off+64));
+		}
+		s_stake.shead.version = STAKE_VERSION;
+		LOGA("Migrated %u stakedb entries from version 1", s_stake_used);
+		return 0;
+	}
 
-	for (; off + STAKE_ADDR_ITEM_LEN <= fsize; off += STAKE_ADDR_ITEM_LEN) {
-		paddr = (stake_addr_t*)(buf + off);
-		saddr = (stake_addr_t*)bpool_calloc_block (&s_stake.bp);
-		memcpy (saddr, buf+off, STAKE_ADDR_ITEM_LEN);
-		//Do not think there will be duplicate keys
-		unsigned idx = hlist_str_hash (saddr->addr, STAKE_BUCKET);
-		hlist_add_head (&saddr->hnode, &s_stake.hhead[idx]);
+	for (; off + STAKE_ITEM_LEN <= fsize; off += STAKE_ITEM_LEN) {
+		uint256 key;
+		memcpy (key.begin(), buf+off, 32);
+		stake_add (key, (int64_t)ReadLE64((const unsigned char*)buf+off+32));
 	}
 	return 0;
 }
 
-static long save_list_to_buf (char *buf, long bsize) {
-	unsigned incidx, idx;
+//Write the stake at added_height - SAVED_ALIGN: the current stake with the undo records above it rolled back
+static long save_table_to_buf (char *buf, long bsize, const CBlockIndex *pBlockIndex) {
 	long off = sizeof(stake_head_t);
-	if (s_stake.added_height > chainActive.Height() + SAVED_ALIGN) {
-		LOGAF("logic failed. %d > %d + 100", s_stake.added_height, chainActive.Height());
+	int sync_height = s_stake.added_height - SAVED_ALIGN;
+
+	if (sync_height < 0 || s_stake_undo.empty() || s_stake_undo.front().height > sync_height + 1) {
+		LOGAF("no undo records down to %d, skip saving", sync_height);
 		return 0;
 	}
 
-	s_stake.shead.sync_height = s_stake.added_height - SAVED_ALIGN;
-	CBlockIndex *pblockindex = chainActive[s_stake.shead.sync_height];
-	s_stake.shead.sync_block_hash = pblockindex->GetBlockHeader().GetHash();
+	std::map<uint256, CAmount> rollback;
+	for (auto it = s_stake_undo.rbegin(); it != s_stake_undo.rend() && it->height > sync_height; ++it) {
+		for (const auto &delta : it->deltas) {
+			rollback[delta.first] -= delta.second;
+		}
+	}
+
+	s_stake.shead.sync_height = sync_height;
+	s_stake.shead.sync_block_hash = pBlockIndex->GetAncestor(sync_height)->GetBlockHash();
 	memcpy (buf, &s_stake.shead, sizeof(stake_head_t));
 
-	incidx = (s_stake.added_height / SAVED_ALIGN) % 2; //from the old list
+	for (const auto &slot : s_stake_slots) {
+		if (slot.key.IsNull()) {
+			continue;
+		}
+		int64_t val = slot.val;
+		auto it = rollback.find(slot.key);
+		if (it != rollback.end()) {
+			val += it->second;
+			rollback.erase(it);
+		}
+		if (val > 0 && off + STAKE_ITEM_LEN <= bsize) {
+			memcpy (buf+off, slot.key.begin(), 32);
+			WriteLE64 ((unsigned char*)buf+off+32, (uint64_t)val);
+			off += STAKE_ITEM_LEN;
+		}
+	}
+	//addresses whose whole stake was withdrawn since sync_height
+	for (const auto &it : rollback) {
+		if (it.second > 0 && off + STAKE_ITEM_LEN <= bsize) {
+			memcpy (buf+off, it.first.begin(), 32);
+			WriteLE64 ((unsigned char*)buf+off+32, (uint64_t)it.second);
+			off += STAKE_ITEM_LEN;
+		}
+	}
+	LOGAF("Succeed to save stakedb. h=%d size=%ld", s_stake.shead.sync_height, off);
+	return off;
+}
+
+//the slot of key, or the free slot where it would go
+static size_t stake_probe (const uint256 &key) {
+	size_t mask = s_stake_slots.size() - 1;
+	size_t i = key.GetCheapHash() & mask;
+	while (!s_stake_slots[i].key.IsNull() && s_stake_slots[i].key != key) {
+		i = (i + 1) & mask;
+	}
+	return i;
+}
 
-	for (idx = 0; idx < sizeof(s_stake.hhead)/sizeof(s_stake.hhead[0]); idx++) {
-		struct hlist_head *pinchead = &s_stake.inchead[incidx][idx];
+static size_t stake_find (const uint256 &key) {
+	size_t i = stake_probe (key);
+	return s_stake_slots[i].key.IsNull() ? s_stake_slots.size() : i;
+}
 
-		stake_addr_t *op = NULL, *op2;
-		hlist_node *tmpnode;
-		hlist_for_each_entry_safe (op, tmpnode, &s_stake.hhead[idx], hnode) {
-			op2 = stake_find_addr (pinchead, op->addr);
-			if (op2) {
-				LOGAF("synch=%d to inc %s %lld --> %lld", s_stake.shead.sync_height, op->addr, op->val, op->val + op2->val);
-				op->val += op2->val;
-				hlist_del (&op2->hnode);
-				bpool_free_block (&s_stake.bp, op2);
-			}
+static void stake_resize (size_t size) {
+	std::vector<stake_slot_t> slots (size);
+	slots.swap (s_stake_slots);
+	for (const auto &slot : slots) {
+		if (!slot.key.IsNull()) {
+			s_stake_slots[stake_probe (slot.key)] = slot;
+		}
+	}
+}
 
-			if (op->val > 0 && off + STAKE_ADDR_ITEM_LEN <= bsize) {
-				memcpy (buf+off, op, STAKE_ADDR_ITEM_LEN);
-				off += STAKE_ADDR_ITEM_LEN;
-				LOGAF("addoff -->%ld", off);
-			}
-			if (op->val <= 0) {
-				LOGAF("synch=%d to del %s", s_stake.shead.sync_height, op->addr);
-				hlist_del (&op->hnode);
-				bpool_free_block (&s_stake.bp, op);
-			} 
+//Backward shift deletion: pull later entries of the probe run into the hole so lookups need no tombstones
+static void stake_erase (size_t i) {
+	size_t mask = s_stake_slots.size() - 1;
+	size_t j = i;
+	while (true) {
+		j = (j + 1) & mask;
+		if (s_stake_slots[j].key.IsNull()) {
+			break;
 		}
-		//Collect and transfer new additions
-		hlist_for_each_entry_safe (op, tmpnode, pinchead, hnode) {
-			hlist_del (&op->hnode);
-			if (op->val != 0) {
-				hlist_add_head (&op->hnode, &s_stake.hhead[idx]);
-				LOGAF("synch=%d to move %s %lld", s_stake.shead.sync_height, op->addr, op->val);
-			}
+		size_t home = s_stake_slots[j].key.GetCheapHash() & mask;
+		//the entry at j may move to i unless its home lies cyclically in (i, j]
+		if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+			s_stake_slots[i] = s_stake_slots[j];
+			i = j;
 		}
 	}
-	LOGAF("Succeed to save stakedb. h=%d size=%ld. incidx=%d", s_stake.shead.sync_height, off, incidx);
-	return off;
+	s_stake_slots[i] = stake_slot_t();
+	s_stake_used--;
 }
 
-static stake_addr_t *stake_find_addr (struct hlist_head *head, const char *addr) {
-	stake_addr_t *op = NULL;
-	hlist_for_each_entry (op, head, hnode) {
-		if (strcmp (op->addr, addr) == 0) {
-			return op;
-		}
+static void stake_add (const uint256 &key, CAmount amt) {
+	if ((s_stake_used + 1) * 10 > s_stake_slots.size() * 7) {
+		stake_resize (s_stake_slots.size() * 2);
+	}
+	size_t i = stake_probe (key);
+	if (s_stake_slots[i].key.IsNull()) {
+		s_stake_slots[i].key = key;
+		s_stake_slots[i].val = 0;
+		s_stake_used++;
+	}
+	s_stake_slots[i].val += amt;
+	if (s_stake_slots[i].val == 0) {
+		stake_erase (i);
+	}
+}
+
+//The amount of the DCOP_PLEDGE transaction txid: from memory, else the pledge index.
+//Pledges connected before the index existed are looked up once and then added to it.
+static bool stake_find_pledge (const uint256 &txid, CAmount &amt) {
+	auto it = s_stake_pledges.find(txid);
+	if (it != s_stake_pledges.end()) {
+		amt = it->second;
+		s_stake_pledges.erase(it);
+		return true;
+	}
+
+	//GetPledgeType always puts the pledged amount in output 0
+	COutPoint outpoint(txid, 0);
+	CPledgeIndexEntry entry;
+	if (pblocktree->ReadPledgeIndex(outpoint, entry)) {
+		amt = entry.nValue;
+		return true;
+	}
+
+	CTransactionRef ptx;
+	uint256 hashBlockIn;
+	int iin, iout;
+	if (!GetTransaction (txid, ptx, Params().GetConsensus(), hashBlockIn, true, nullptr)) {
+		LOGAF("pledge %s not found", txid.GetHex());
+		return false;
+	}
+	if (ptx->GetPledgeType(iin, iout) != DCOP_PLEDGE) {
+		LOGAF("logic failed. not pledgeto");
+		return false;
+	}
+	amt = ptx->vout[iin].nValue;
+	std::vector<std::pair<COutPoint, CPledgeIndexEntry> > vPledges;
+	vPledges.emplace_back(COutPoint(txid, iin), CPledgeIndexEntry(ptx->vout[iout].scriptPubKey, amt));
+	pblocktree->WritePledgeIndex(vPledges);
+	return true;
+}
+
+static void stake_mined_count (const uint256 &key, int n) {
+	if (key.IsNull()) {
+		return;
+	}
+	int &count = s_mined_count[key];
+	count += n;
+	if (count == 0) {
+		s_mined_count.erase(key);
+	}
+}
+
+static void stake_mined_push (int height, const uint256 &key) {
+	if (!s_mined.empty() && s_mined.back().height != height - 1) {
+		//not consecutive: leave it to stake_mined_fill
+		s_mined.clear();
+		s_mined_count.clear();
+	}
+	s_mined.push_back(stake_mined_t{height, key});
+	stake_mined_count(key, 1);
+	if (s_mined.size() > MINED_WINDOW) {
+		stake_mined_count(s_mined[s_mined.size() - 1 - MINED_WINDOW].key, -1);
+	}
+	if (s_mined.size() > MINED_KEEP) {
+		s_mined.pop_front();
 	}
-	return NULL;
 }
 
-static CBlockIndex *find_next_block_idx (CBlockIndex *pBlockIndex, const uint256 now_hash) {
-	CBlockIndex *pnext = pBlockIndex;
-	if (pnext && pnext->GetBlockHeader().GetHash() == now_hash) {
-		return pnext; //not the next
+static void stake_mined_pop (int height) {
+	if (s_mined.empty() || s_mined.back().height != height) {
+		s_mined.clear();
+		s_mined_count.clear();
+		return;
+	}
+	stake_mined_count(s_mined.back().key, -1);
+	s_mined.pop_back();
+	//the block that falls back into the window
+	if (s_mined.size() >= MINED_WINDOW) {
+		stake_mined_count(s_mined[s_mined.size() - MINED_WINDOW].key, 1);
+	}
+}
+
+//whether s_mined covers the whole window up to added_height (blocks from height 1 on have miners)
+static bool stake_mined_filled () {
+	if (s_stake.added_height == 0) {
+		return true;
+	}
+	return !s_mined.empty() && s_mined.back().height == s_stake.added_height &&
+		s_mined.size() >= std::min((size_t)MINED_WINDOW, (size_t)s_stake.added_height);
+}
+
+//Read the miners of the blocks kept in the window up to pBlockIndex in one batch
+static int stake_mined_fill (const CBlockIndex *pBlockIndex) {
+	int64_t nTimeStart = GetTimeMicros();
+	std::vector<const CBlockIndex *> vIndex;
+	for (const CBlockIndex *pindex = pBlockIndex; pindex && pindex->nHeight > 0 && vIndex.size() < MINED_KEEP; pindex = pindex->pprev) {
+		vIndex.push_back(pindex);
 	}
 
-	while (pnext && pnext->pprev && pnext->pprev->GetBlockHeader().GetHash() != now_hash) {
-		pnext = pnext->pprev;
+	s_mined.clear();
+	s_mined_count.clear();
+	CBlock block;
+	for (auto it = vIndex.rbegin(); it != vIndex.rend(); ++it) {
+		if (!ReadBlockFromDisk (block, *it, Params().GetConsensus())) {
+			LOGAF("not found disk block %d", (*it)->nHeight);
+			s_mined.clear();
+			s_mined_count.clear();
+			return -1;
+		}
+		const auto &ptx = block.vtx[0];
+		stake_mined_push ((*it)->nHeight, ptx->vout.size() >= 2 ? stakedb_key (ptx->vout[1].scriptPubKey) : uint256());
 	}
+	LOG(BENCH, "stakedb: read the miners of %u blocks up to %d in %.2fms\n", vIndex.size(), pBlockIndex->nHeight,
+		(GetTimeMicros() - nTimeStart) * 0.001);
+	return 0;
+}
 
-	if (!pnext || !pnext->pprev) {
-		return NULL;
+static bool stake_is_ancestor (const CBlockIndex *pBlockIndex) {
+	if (s_stake.added_height > pBlockIndex->nHeight) {
+		return false;
 	}
-	return pnext;
+	return pBlockIndex->GetAncestor(s_stake.added_height)->GetBlockHash() == s_stake.added_block_hash;
 }
 
 
@@ -174,19 +379,11 @@ static CBlockIndex *find_next_block_idx (CBlockIndex *pBlockIndex, const uint256
 
 //return >=0 height. <0 error
 int stakedb_load (const char *fname) {
-	int i = 0;
 	long fsize = 0;
-	ssize_t ret = 0;
 
-	memset (&s_stake, 0, sizeof(s_stake));
+	LOCK(cs_stakedb);
+	stakedb_cleanup ();
 	strncpy (s_stake.fname, fname, sizeof(s_stake.fname)-1);
-	for (i=0; i<STAKE_BUCKET; i++) {
-		INIT_HLIST_HEAD(&s_stake.hhead[i]);
-		INIT_HLIST_HEAD(&s_stake.inchead[0][i]);
-		INIT_HLIST_HEAD(&s_stake.inchead[1][i]);
-	}
-	INIT_LIST_HEAD(&s_stake.miner_list);
-	bpool_init (&s_stake.bp, SIZE_AUTO_EXPAND, sizeof(stake_addr_t));
 
 	if (s_stake_buf == NULL) {
 		s_stake_buf = (char*)malloc(STAKE_FMAXSIZE);
@@ -198,9 +395,10 @@ int stakedb_load (const char *fname) {
 
 	fsize = read_filesize (fname);
 	if (fsize <= (long)sizeof(stake_head_t) || fsize > STAKE_FMAXSIZE) {
-		s_stake.shead.version = 1;
+		s_stake.shead.version = STAKE_VERSION;
 		s_stake.shead.sync_height = 0;
 		s_stake.shead.sync_block_hash = Params().GenesisBlock().GetHash();
+		s_stake.added_block_hash = s_stake.shead.sync_block_hash;
 		write_bin_file (fname, (const char*)&s_stake.shead, sizeof(s_stake.shead));
 		LOGAF("init stakedb. fsize=%d", fsize);
 	} else {
@@ -209,7 +407,7 @@ int stakedb_load (const char *fname) {
 			goto _Failed;
 		}
 
-		if (load_buf_to_list (s_stake_buf, fsize) == -1) {
+		if (load_buf_to_table (s_stake_buf, fsize) == -1) {
 			LOGAF("Failed to load stakedb. fsize=%d", fsize);
 			goto _Failed;
 		}
@@ -224,16 +422,12 @@ _Failed:
 	return -1;
 }
 
-static int stakedb_step_to (CBlockIndex *pBlockIndex) {
-	unsigned incidx;
-	struct hlist_head *head;
-	struct hlist_head *pinchead;
-	stake_addr_t *r;
-	std::string addrstr;
-	const char *addr = NULL;
-	CAmount amt;
-	CBlock block;
-	const Consensus::Params &consensusParams = Params().GetConsensus();
+void stakedb_register_signals () {
+	RegisterValidationInterface (&s_stake_listener);
+}
+
+static int stakedb_connect_block (const CBlock &block, const CBlockIndex *pBlockIndex) {
+	stake_undo_t undo;
 
 	if (pBlockIndex->nHeight != s_stake.added_height + 1) {
 		LOGAF("Failed to step_to %d. now is %d", pBlockIndex->nHeight, s_stake.added_height);
@@ -244,218 +438,246 @@ static int stakedb_step_to (CBlockIndex *pBlockIndex) {
 		LOGAF("Failed to step_to %d. hash not equ.", pBlockIndex->nHeight);
 		return -1;
 	}
-	//find out all : coinbase stakein, unstake
-	if (!ReadBlockFromDisk (block, pBlockIndex, consensusParams)) {
-		LOGAF("Failed to step to %d. read block failed.", pBlockIndex->nHeight);
-		return -1;
-	}
-	incidx = (pBlockIndex->nHeight / SAVED_ALIGN) % 2;
+	undo.height = pBlockIndex->nHeight;
+	undo.prev_hash = s_stake.added_block_hash;
 
+	//find out all : coinbase stakein, unstake. Collect them first so a failure leaves nothing half applied
+	uint256 miner;
+	std::vector<std::pair<uint256, CAmount> > vPledged;
 	for (const auto &ptx : block.vtx) {
 		if (ptx->IsCoinBase()) {
-			r = (stake_addr_t*)bpool_calloc_block (&s_stake.bp);
-			addrstr = EncodeScriptPubKey (ptx->vout[1].scriptPubKey);
-			strncpy (r->addr, addrstr.c_str(), sizeof(r->addr)-1);
-			r->val = pBlockIndex->nHeight;
-			list_add_tail (&r->lnode, &s_stake.miner_list);
-			LOGAF("found h=%d coinbase %s, len=%d", pBlockIndex->nHeight, addrstr.c_str(), s_stake.len_miner_list);
-			//remove first
-			if (s_stake.len_miner_list >= uPeriod + SAVED_ALIGN) {
-				r = (stake_addr_t*)list_first_entry(&s_stake.miner_list, stake_addr_t, lnode);
-				list_del (&r->lnode);
-				bpool_free_block (&s_stake.bp, r);
-			} else {
-				s_stake.len_miner_list++;
+			if (ptx->vout.size() >= 2) {
+				miner = stakedb_key (ptx->vout[1].scriptPubKey);
 			}
 			continue;
 		}
 		int iin, iout;
+		CAmount amt;
 		auto ptype = ptx->GetPledgeType(iin, iout);
 		if (ptype == DCOP_NONE) {
 			continue;
 		}
 		//get addr
-		addrstr = EncodeScriptPubKey (ptx->vout[iout].scriptPubKey);
-		if (!IsValidDestinationString (addrstr)) {
-			LOGAF("not valid addr ? %s", addrstr);
+		uint256 key = stakedb_key (ptx->vout[iout].scriptPubKey);
+		if (key.IsNull()) {
+			LOGAF("not valid addr ? %s", HexStr(ptx->vout[iout].scriptPubKey));
 			continue;
 		}
-		addr = addrstr.c_str();
-		
+
 		if (ptype == DCOP_PLEDGE) {
 			amt = ptx->vout[iin].nValue;
+			vPledged.emplace_back(ptx->GetHash(), amt);
 		} else {
 			const COutPoint &cop = ptx->vin[0].prevout;
-			CTransactionRef ptx2;
-			uint256 hashBlockIn;
-			if (!GetTransaction (cop.hash, ptx2, consensusParams, hashBlockIn, true, nullptr)) {
-				LOGAF("logic failed....");
-				return -1;
-			}
-			if (ptx2->GetPledgeType(iin, iout) != DCOP_PLEDGE) {
-				LOGAF("logic failed. not pledgeto");
+			if (!stake_find_pledge (cop.hash, amt)) {
 				return -1;
 			}
-			amt = - ptx2->vout[iin].nValue;
-
-			// LOGAF("==== %lld, %lld", amt, ptx2->vout[iin].nValue);
-		}
-
-		pinchead = &s_stake.inchead[incidx][hlist_str_hash(addr, STAKE_BUCKET)];
-		r = stake_find_addr (pinchead, addr);
-		if (r == NULL) {
-			r = (stake_addr_t*)bpool_calloc_block (&s_stake.bp);
-			strncpy (r->addr, addr, sizeof(r->addr)-1);
-			hlist_add_head (&r->hnode, pinchead);
+			amt = -amt;
 		}
+		LOGAF("Found %sstake in block %d. %s. inc=%lld", ((ptype==DCOP_PLEDGE)?"":"un"), pBlockIndex->nHeight,
+			EncodeScriptPubKey (ptx->vout[iout].scriptPubKey), amt);
+		undo.deltas.emplace_back(key, amt);
+	}
 
-		LOGAF("Found %sstake in block %d. %s. origin=%lld, inc=%lld", ((ptype==DCOP_PLEDGE)?"":"un"), pBlockIndex->nHeight, addr, r->val, amt);
+	for (const auto &delta : undo.deltas) {
+		stake_add (delta.first, delta.second);
+	}
+	for (const auto &pledge : vPledged) {
+		s_stake_pledges[pledge.first] = pledge.second;
+	}
+	stake_mined_push (pBlockIndex->nHeight, miner);
 
-		r->val += amt;
+	s_stake_undo.push_back (std::move(undo));
+	if (s_stake_undo.size() > STAKE_UNDO_BLOCKS) {
+		s_stake_undo.pop_front ();
 	}
 
 	LOGAF("added %d", pBlockIndex->nHeight);
 	s_stake.added_height = pBlockIndex->nHeight;
-	s_stake.added_block_hash = pBlockIndex->GetBlockHeader().GetHash();
+	s_stake.added_block_hash = pBlockIndex->GetBlockHash();
 
 	if (s_stake.added_height % SAVED_ALIGN == 0) {
 		//sync to file.
-		long fsize = save_list_to_buf (s_stake_buf, STAKE_FMAXSIZE);
-		write_bin_file (s_stake.fname, s_stake_buf, fsize);
+		long fsize = save_table_to_buf (s_stake_buf, STAKE_FMAXSIZE, pBlockIndex);
+		if (fsize > 0) {
+			write_bin_file (s_stake.fname, s_stake_buf, fsize);
+		}
 	}
 	return 0;
 }
 
-int stakedb_restep_to (CBlockIndex *pBlockIndex) {
-	unsigned i;
-	uint256 now_hash;
-	if (pBlockIndex->nHeight < s_stake.shead.sync_height) {
-		return -1; //cancel
+//Undo added_height from its undo record. <0 when there is none left
+static int stakedb_disconnect_tip () {
+	if (s_stake_undo.empty() || s_stake_undo.back().height != s_stake.added_height) {
+		return -1;
 	}
+	const stake_undo_t &undo = s_stake_undo.back();
+	for (auto it = undo.deltas.rbegin(); it != undo.deltas.rend(); ++it) {
+		stake_add (it->first, -it->second);
+	}
+	stake_mined_pop (undo.height);
+	LOGAF("removed %d", undo.height);
+	s_stake.added_height = undo.height - 1;
+	s_stake.added_block_hash = undo.prev_hash;
+	s_stake_undo.pop_back ();
+	return 0;
+}
 
-	CBlockIndex *pnext = find_next_block_idx (pBlockIndex, s_stake.added_block_hash);
-	if (pnext) {
-		if (pnext == pBlockIndex && s_stake.added_block_hash == pBlockIndex->GetBlockHeader().GetHash()) {
-			LOG(COINDB, "return: %d", s_stake.added_height);
-			return s_stake.added_height;
-		}
-		now_hash = s_stake.added_block_hash;
-		LOG(COINDB, "found next height: %d", pnext->nHeight);
-	} else {
-		LOG(COINDB, "not found next height, reto %d", s_stake.shead.sync_height);
-		stake_addr_t *op, *op2;
-		hlist_node *tmp_hnode;
-		//Drop the incremental part
-		now_hash = s_stake.shead.sync_block_hash;
-
-		s_stake.added_height = s_stake.shead.sync_height;
-		s_stake.added_block_hash = s_stake.shead.sync_block_hash;
+static int stakedb_step_to (const CBlockIndex *pBlockIndex) {
+	CBlock block;
+	if (!ReadBlockFromDisk (block, pBlockIndex, Params().GetConsensus())) {
+		LOGAF("Failed to step to %d. read block failed.", pBlockIndex->nHeight);
+		return -1;
+	}
+	return stakedb_connect_block (block, pBlockIndex);
+}
 
-		for (i=0; i<STAKE_BUCKET; i++) {
+int stakedb_restep_to (CBlockIndex *pBlockIndex) {
+	LOCK(cs_stakedb);
+	if (!s_stake.fname[0]) {
+		return -1;
+	}
+	if (s_stake.added_block_hash == pBlockIndex->GetBlockHash()) {
+		LOG(COINDB, "return: %d", s_stake.added_height);
+		return s_stake.added_height;
+	}
 
-			hlist_for_each_entry_safe (op, tmp_hnode, &s_stake.inchead[0][i], hnode) {
-				hlist_del (&op->hnode);
-				bpool_free_block (&s_stake.bp, op);
-			}
-			hlist_for_each_entry_safe (op, tmp_hnode, &s_stake.inchead[1][i], hnode) {
-				hlist_del (&op->hnode);
-				bpool_free_block (&s_stake.bp, op);
-			}
+	//roll back to the fork point with the undo records
+	while (!stake_is_ancestor (pBlockIndex)) {
+		if (stakedb_disconnect_tip () != 0) {
+			break;
 		}
-
-		list_for_each_entry_safe_reverse (op, op2, &s_stake.miner_list, lnode) {
-			if (op->val <= s_stake.shead.sync_height) {
-				break;
+	}
+	if (!stake_is_ancestor (pBlockIndex)) {
+		//deeper than the undo records: start over from the file, or from genesis
+		char fname[sizeof(s_stake.fname)] = {0};
+		strncpy (fname, s_stake.fname, sizeof(fname)-1);
+		LOG(COINDB, "not found next height, reload %s", fname);
+		stakedb_cleanup ();
+		if (stakedb_load (fname) != 0 || !stake_is_ancestor (pBlockIndex)) {
+			if (stakedb_reset (fname) != 0) {
+				return -1;
 			}
-			list_del (&op->lnode);
-			bpool_free_block (&s_stake.bp, op);
-			s_stake.len_miner_list--;
 		}
 	}
 
-	for (; (pnext = find_next_block_idx(pBlockIndex, now_hash)) != NULL; 
-		now_hash = pnext->GetBlockHeader().GetHash()) 
-	{
-		if ( pnext == pBlockIndex && now_hash == pBlockIndex->GetBlockHeader().GetHash()) {
-			LOG(COINDB, "skip break");
-			break;
-		}
-
-		if (stakedb_step_to (pnext) != 0) {
-			LOGAF("Failed to stepto next. %d --> --> %d", pnext->nHeight, pBlockIndex->nHeight);
+	for (int h = s_stake.added_height + 1; h <= pBlockIndex->nHeight; h++) {
+		if (stakedb_step_to (pBlockIndex->GetAncestor(h)) != 0) {
+			LOGAF("Failed to stepto next. %d --> --> %d", h, pBlockIndex->nHeight);
 			return -1;
 		}
 	}
+	if (!stake_mined_filled () && stake_mined_fill (pBlockIndex) != 0) {
+		return -1;
+	}
 	return s_stake.added_height;
 }
 
+void CStakeDBListener::BlockConnected (const CBlock &block, const CBlockIndex *pindex) {
+	LOCK(cs_stakedb);
+	if (!s_stake.fname[0] || !pindex->pprev) {
+		return;
+	}
+	if (s_stake.added_block_hash != pindex->pprev->GetBlockHash()) {
+		//behind or on another branch; restep_to catches up the next time it is needed
+		LOG(COINDB, "stakedb at %d, not connecting %d", s_stake.added_height, pindex->nHeight);
+		return;
+	}
+	if (stakedb_connect_block (block, pindex) != 0) {
+		LOGAF("Failed to connect %d", pindex->nHeight);
+	}
+}
+
+void CStakeDBListener::BlockDisconnected (const CBlock &block, const CBlockIndex *pindex) {
+	LOCK(cs_stakedb);
+	if (!s_stake.fname[0] || s_stake.added_block_hash != pindex->GetBlockHash()) {
+		return;
+	}
+	if (stakedb_disconnect_tip () != 0) {
+		LOG(COINDB, "no undo record for %d", pindex->nHeight);
+	}
+}
+
+uint64_t stakedb_get_stake (const CScript &script) {
+	uint256 key = stakedb_key (script);
+	if (key.IsNull()) {
+		return 0;
+	}
+	LOCK(cs_stakedb);
+	size_t i = stake_find (key);
+	return i < s_stake_slots.size() ? s_stake_slots[i].val : 0;
+}
+
 uint64_t stakedb_get_stake (const char* addr) {
-	unsigned idx = hlist_str_hash(addr, STAKE_BUCKET);
-	stake_addr_t *op = stake_find_addr (&s_stake.hhead[idx], addr);
-	stake_addr_t *op2 = stake_find_addr (&s_stake.inchead[0][idx], addr);
-	stake_addr_t *op3 = stake_find_addr (&s_stake.inchead[1][idx], addr);
-	return (op ? op->val : 0) + (op2 ? op2->val : 0) + (op3 ? op3->val : 0);
+	CTxDestination dest = DecodeDestination(addr);
+	if (!IsValidDestination(dest)) {
+		return 0;
+	}
+	return stakedb_get_stake (GetScriptForDestination(dest));
 }
 
-int stakedb_get_mined (const char *addr)
-{
-	int nblock = 0;
-	int npre = 0;
-	stake_addr_t *r;
-	while (s_stake.len_miner_list < uPeriod) {
-		r = (stake_addr_t*)list_first_entry (&s_stake.miner_list, stake_addr_t, lnode);
-		if (!r) {
+uint256 stakedb_key (const CScript &script) {
+	CTxDestination dest;
+	if (!ExtractDestination(script, dest)) {
+		return uint256();
+	}
+	CScript standard = GetScriptForDestination(dest);
+	return Hash(standard.begin(), standard.end());
+}
+
+static uint256 stakedb_key (const char *addr) {
+	CTxDestination dest = DecodeDestination(addr);
+	if (!IsValidDestination(dest)) {
+		return uint256();
+	}
+	return stakedb_key(GetScriptForDestination(dest));
+}
+
+//blocks mined by key in the window, -1 if the window could not be read. cs_stakedb must be held
+static int stake_get_mined (const uint256 &key) {
+	if (!stake_mined_filled ()) {
+		const CBlockIndex *pBlockIndex = LookupBlockIndex (s_stake.added_block_hash);
+		if (!pBlockIndex || stake_mined_fill (pBlockIndex) != 0) {
 			LOGAF("logic failed.");
 			return -1;
 		}
-		if (r->val <= 1) {
-			break;
-		}
-		if (r->val > chainActive.Height()) {
-			LOGAF("need height: %ld > %ld", r->val, chainActive.Height());
-			return -1;
-		}
-		CBlockIndex *pBlockIndex = chainActive[r->val - 1];
-		if (pBlockIndex->nHeight == 0) {
-			break;
-		}
-		CBlock block;
-		const Consensus::Params &consensusParams = Params().GetConsensus();
-		if (!ReadBlockFromDisk (block, pBlockIndex, consensusParams)) {
-			LOGAF("not found disk block %d", pBlockIndex->nHeight);
-			return -1;
-		}
-		const auto &ptx = block.vtx[0];
-		if (!ptx->IsCoinBase() || ptx->vout.size() != 2){
-			LOGAF("not found coin base. height=%d, nvout=%d", pBlockIndex->nHeight, ptx->vout.size());
-			return -1;
-		}
+	}
+	if (key.IsNull()) {
+		return 0;
+	}
+	auto it = s_mined_count.find(key);
+	return it == s_mined_count.end() ? 0 : it->second;
+}
 
-		r = (stake_addr_t*)bpool_calloc_block (&s_stake.bp);
-		std::string addrstr = EncodeScriptPubKey (ptx->vout[1].scriptPubKey);
-		strncpy (r->addr, addrstr.c_str(), sizeof(r->addr)-1);
-		r->val = pBlockIndex->nHeight;
-		list_add_first (&r->lnode, &s_stake.miner_list);
-		LOGAF("found 2 h=%d coinbase %s, len=%d", pBlockIndex->nHeight, addrstr.c_str(), s_stake.len_miner_list);
-		s_stake.len_miner_list++;
-	}
-	list_for_each_entry_reverse (r, &s_stake.miner_list, lnode) {
-		// if (r->val > height) {
-		// 	continue;
-		// }
-
-		if (strcmp (addr, r->addr) == 0) {
-			nblock++;
-		}
+int stakedb_get_mined (const CScript &script) {
+	uint256 key = stakedb_key (script);
+	LOCK(cs_stakedb);
+	return stake_get_mined (key);
+}
 
-		if (++npre >= uPeriod - 1) { //1799
-			break;
-		}
+bool stakedb_get_stake_mined (const CScript &script, uint64_t &stake, int &mined) {
+	uint256 key = stakedb_key (script);
+	LOCK(cs_stakedb);
+	mined = stake_get_mined (key);
+	if (key.IsNull()) {
+		stake = 0;
+	} else {
+		size_t i = stake_find (key);
+		stake = i < s_stake_slots.size() ? s_stake_slots[i].val : 0;
+	}
+	return mined >= 0;
+}
+
+int stakedb_get_mined (const char *addr) {
+	CTxDestination dest = DecodeDestination(addr);
+	if (!IsValidDestination(dest)) {
+		return 0;
 	}
-	return nblock;
+	return stakedb_get_mined (GetScriptForDestination(dest));
 }
 
 int stakedb_get_height () {
+	LOCK(cs_stakedb);
 	if (s_stake.fname[0]) {
 		return s_stake.added_height;
 	}
@@ -464,41 +686,48 @@ int stakedb_get_height () {
 
 void stakedb_debug_print(const char *addr) {
 	int nblock = 0;
-	int npre = 0;
-	int print = 0;
+	uint256 key;
 
-	stake_addr_t *r = (stake_addr_t*)list_first_entry(&s_stake.miner_list, stake_addr_t, lnode);
-	if (!r) {
+	if (addr && addr[0]) {
+		key = stakedb_key (addr);
+	}
+	LOCK(cs_stakedb);
+	if (s_mined.empty()) {
 		LOGA("stakedb_debug no miner_list.");
 		return;
 	}
-	list_for_each_entry_reverse (r, &s_stake.miner_list, lnode) {
-		print = 0;
-		if (addr && strcmp(addr, r->addr) == 0) {
-			print = 1;
-			nblock ++;
-		} else if (!addr || addr[0]=='\0') {
-			print = 1;
-		}
-		if (print) {
-			LOG(COINDB, "stakedb_debug %s : %d[%d]", r->addr, r->val, nblock);
-		}
-		if (++npre >= uPeriod - 1) { //1799
-			break;
+	size_t nwindow = std::min(s_mined.size(), (size_t)MINED_WINDOW);
+	for (auto it = s_mined.rbegin(); it != s_mined.rbegin() + nwindow; ++it) {
+		if (key.IsNull() || it->key == key) {
+			if (!key.IsNull()) {
+				nblock ++;
+			}
+			LOG(COINDB, "stakedb_debug %s : %d[%d]", it->key.GetHex(), it->height, nblock);
 		}
 	}
 	LOGA( "print %s sync=%d --> %d End PRINT stakedb_debug_print", addr?addr:"NULL", s_stake.shead.sync_height, s_stake.added_height);
 }
 
-int stakedb_reinit () {
-	char fname[sizeof(s_stake.fname)] = {0};
-	strncpy (fname, s_stake.fname, sizeof(fname)-1);
-
-	LOGAF("???");
-	
-	write_bin_file (fname, (const char*)&s_stake.shead, sizeof(s_stake.shead));
+//Throw away the stake and start again from genesis
+static int stakedb_reset (const char *fname) {
+	stake_head_t shead;
+	LOGAF("reinit %s", fname);
 
 	stakedb_cleanup();
+	shead.version = STAKE_VERSION;
+	shead.sync_height = 0;
+	shead.sync_block_hash = Params().GenesisBlock().GetHash();
+	write_bin_file (fname, (const char*)&shead, sizeof(shead));
 
-	stakedb_load (fname);
-}
\ No newline at end of file
+	return stakedb_load (fname);
+}
+
+int stakedb_reinit () {
+	LOCK(cs_stakedb);
+	char fname[sizeof(s_stake.fname)] = {0};
+	strncpy (fname, s_stake.fname, sizeof(fname)-1);
+	if (!fname[0]) {
+		return -1;
+	}
+	return stakedb_reset (fname);
+}
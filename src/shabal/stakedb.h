@@ -3,16 +3,31 @@
 
 #include "chain.h"
 
+class CScript;
+
 int stakedb_load (const char *fname);
 
+//follow ConnectTip/DisconnectTip through the validation interface signals
+void stakedb_register_signals ();
+
 int stakedb_reinit ();
 
 int stakedb_restep_to (CBlockIndex *pBlockIndex);
 
+/** Stake pledged to the address a script pays to, at the stakedb height */
+uint64_t stakedb_get_stake (const CScript &script);
 uint64_t stakedb_get_stake (const char* addr);
 
+/** Binary key of the address a script pays to: scripts that encode to the same address share it */
+uint256 stakedb_key (const CScript &script);
+
+/** Blocks mined by an address in the last uPeriod - 1 blocks */
+int stakedb_get_mined (const CScript &script);
 int stakedb_get_mined (const char *addr);
 
+/** Both of the above under one lookup of the address. Returns false if the mined blocks could not be counted */
+bool stakedb_get_stake_mined (const CScript &script, uint64_t &stake, int &mined);
+
 int stakedb_get_height ();
 
 void stakedb_debug_print(const char *addr);
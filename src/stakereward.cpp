@@ -0,0 +1,93 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stakereward.h"
+
+#include "consensus/params.h"
+#include "script/script.h"
+#include "shabal/stakedb.h"
+#include "sync.h"
+#include "util.h"
+#include "validation/validation.h"
+
+#include <math.h>
+
+// The total only changes once per period, and nearly every caller asks about the current one
+static CCriticalSection cs_periodtotal;
+static int nTotalInterval GUARDED_BY(cs_periodtotal) = 0;
+static int nTotalPeriodStart GUARDED_BY(cs_periodtotal) = -1;
+static CAmount nTotalCoins GUARDED_BY(cs_periodtotal) = 0;
+
+CAmount GetTotalCoinByHeight(int nHeight, const Consensus::Params &consensusParams)
+{
+    // nHeight &= ~(uPeriod-1); //align 1800
+    nHeight -= (nHeight % uPeriod);
+
+    LOCK(cs_periodtotal);
+    if (nTotalPeriodStart == nHeight && nTotalInterval == consensusParams.nSubsidyHalvingInterval)
+        return nTotalCoins;
+
+    int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
+    CAmount nTotal = 0;
+    CAmount nSubsidy = 20 * COIN;
+    for (int i = 0; i < halvings; ++i)
+    {
+        nSubsidy >>= 1;
+        nTotal += nSubsidy * consensusParams.nSubsidyHalvingInterval;
+    }
+    nTotal += nSubsidy * (nHeight % consensusParams.nSubsidyHalvingInterval);
+
+    nTotalInterval = consensusParams.nSubsidyHalvingInterval;
+    nTotalPeriodStart = nHeight;
+    nTotalCoins = nTotal;
+    return nTotal;
+}
+
+CAmount GetBlockMinerSubsidy(int nHeight,
+    const Consensus::Params &consensusParams,
+    uint64_t uPledge,
+    uint32_t uMinedBlockNum)
+{
+    CAmount nSubsidy = GetBlockSubsidy(nHeight, consensusParams);
+    if (nHeight <= (int)uPeriod)
+    {
+        return nSubsidy * 0.4;
+    }
+
+    // This is consensus: the value has to match the one every node has computed for the blocks already in
+    // the chain, rounding included, so it stays in floating point.  2^ceil(dCF) is exact either way.
+    CAmount uMinedCoins = GetTotalCoinByHeight(nHeight, consensusParams);
+    double dCF = (uPledge * uPeriod * 1.0) / (uMinedCoins * uMinedBlockNum);
+    double dDR = 0.4 + 0.6 * (pow(2, ceil(dCF)) - ceil(dCF) - 1 + dCF) / (pow(2, ceil(dCF)));
+    CAmount nMinerSubsidy = nSubsidy * dDR;
+    if (nMinerSubsidy + 1e+6 > nSubsidy)
+    {
+        nMinerSubsidy = nSubsidy - 1e+6;
+    }
+    LOG(COINDB, "nHeight(%d) uMinedCoins(%llu) uMinedBlockNum(%d) uPledge(%llu) dCF(%.20lf), dDR(%.20lf), "
+                "nMinerSubsidy(%llu)\n",
+        nHeight, uMinedCoins, uMinedBlockNum, uPledge, dCF, dDR, nMinerSubsidy);
+
+    return nMinerSubsidy;
+}
+
+bool GetStakeReward(int nHeight,
+    const CScript &scriptPubKey,
+    const Consensus::Params &consensusParams,
+    CStakeReward &reward)
+{
+    uint64_t nPledge = 0;
+    int nMined = 0;
+    if (!stakedb_get_stake_mined(scriptPubKey, nPledge, nMined))
+        return false;
+
+    reward.nHeight = nHeight;
+    reward.nSubsidy = GetBlockSubsidy(nHeight, consensusParams);
+    reward.nMinedCoins = GetTotalCoinByHeight(nHeight, consensusParams);
+    reward.nPledge = nPledge;
+    reward.nMinedBlocks = nMined + 1;
+    reward.nMinerValue = GetBlockMinerSubsidy(nHeight, consensusParams, reward.nPledge, reward.nMinedBlocks);
+    reward.nFundValue = reward.nSubsidy - reward.nMinerValue;
+    return true;
+}
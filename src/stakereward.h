@@ -0,0 +1,59 @@
+// Copyright (c) 2019 The Diskcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_STAKEREWARD_H
+#define BITCOIN_STAKEREWARD_H
+
+#include "amount.h"
+
+#include <stdint.h>
+
+class CScript;
+
+namespace Consensus
+{
+struct Params;
+}
+
+/**
+ * How the subsidy of one block is split between its miner and the fund under
+ * DES (Dynamic Equilibrium Staking): the more an address pledged relative to
+ * the coins mined before the current period and to the blocks it mined in the
+ * last period, the larger its part.
+ */
+struct CStakeReward
+{
+    int nHeight;
+    CAmount nSubsidy; //! the whole block subsidy
+    CAmount nMinedCoins; //! coins mined before the period nHeight is in
+    uint64_t nPledge; //! stake pledged to the miner's address
+    uint32_t nMinedBlocks; //! blocks the address mined in the last period, this one included
+    CAmount nMinerValue;
+    CAmount nFundValue;
+
+    CStakeReward()
+        : nHeight(0), nSubsidy(0), nMinedCoins(0), nPledge(0), nMinedBlocks(0), nMinerValue(0), nFundValue(0)
+    {
+    }
+};
+
+/** Coins mined before the period nHeight is in. Cached per period. */
+CAmount GetTotalCoinByHeight(int nHeight, const Consensus::Params &consensusParams);
+/** The miner's part of the subsidy at nHeight */
+CAmount GetBlockMinerSubsidy(int nHeight,
+    const Consensus::Params &consensusParams,
+    uint64_t uPledge,
+    uint32_t uMinedBlockNum);
+
+/**
+ * The reward split of a block at nHeight mined to scriptPubKey, with the pledge
+ * and mined blocks of its address taken from the stakedb in one lookup.
+ * Returns false if the script does not pay to an address or the stakedb failed.
+ */
+bool GetStakeReward(int nHeight,
+    const CScript &scriptPubKey,
+    const Consensus::Params &consensusParams,
+    CStakeReward &reward);
+
+#endif // BITCOIN_STAKEREWARD_H
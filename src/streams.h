@@ -324,6 +324,54 @@ public:
 };
 
 
+/** Minimal stream for reading serialized data in place, from memory the caller owns.
+ *
+ * Unlike CDataStream nothing is copied in first, so objects can be deserialized straight out
+ * of a mapped file or a buffer that is shared with another thread.
+ */
+class CSpanReader
+{
+private:
+    const int nType;
+    const int nVersion;
+    const char *pcur;
+    const char *pend;
+
+public:
+    CSpanReader(int nTypeIn, int nVersionIn, const char *pbegin, const char *pendIn)
+        : nType(nTypeIn), nVersion(nVersionIn), pcur(pbegin), pend(pendIn)
+    {
+    }
+
+    int GetType() const { return nType; }
+    int GetVersion() const { return nVersion; }
+    size_t size() const { return pend - pcur; }
+    bool empty() const { return pcur == pend; }
+    void read(char *pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::read(): end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+    }
+
+    void ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::ignore(): end of data");
+        pcur += nSize;
+    }
+
+    template <typename T>
+    CSpanReader &operator>>(T &obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+};
+
+
 /** Non-refcounted RAII wrapper for FILE*
  *
  * Will automatically close the file when it goes out of scope if not null.
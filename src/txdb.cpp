@@ -8,12 +8,19 @@
 #include "blockstorage/blockstorage.h"
 #include "chainparams.h"
 #include "hash.h"
+#include "pocverify.h"
 #include "pow.h"
+#include "sync.h"
 #include "ui_interface.h"
 #include "uint256.h"
+#include "util.h"
+#include "utiltime.h"
 #include "validation/validation.h"
 
+#include <algorithm>
+#include <deque>
 #include <stdint.h>
+#include <thread>
 
 CCoinsViewDB *pcoinsdbview = nullptr;
 
@@ -23,6 +30,10 @@ static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
+static const char DB_PLEDGEINDEX = 'p';
+static const char DB_PLEDGEADDRESS = 'P';
+static const char DB_UNPLEDGED = 'u';
+static const char DB_PLEDGEADDRESS_BEST = 'q';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -360,6 +371,83 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadPledgeIndex(const COutPoint &outpoint, CPledgeIndexEntry &entry)
+{
+    return Read(make_pair(DB_PLEDGEINDEX, outpoint), entry);
+}
+
+bool CBlockTreeDB::WritePledgeIndex(const std::vector<std::pair<COutPoint, CPledgeIndexEntry> > &vect)
+{
+    CDBBatch batch(*this);
+    for (const auto &item : vect)
+        batch.Write(make_pair(DB_PLEDGEINDEX, item.first), item.second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadPledgeAddressIndex(const uint256 &addressKey,
+    std::vector<std::pair<COutPoint, CPledgeAddressEntry> > &vEntries)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    // a null COutPoint has n = -1, which would sort after every output of the null txid
+    pcursor->Seek(std::make_pair(DB_PLEDGEADDRESS, std::make_pair(addressKey, COutPoint(uint256(), 0))));
+    while (pcursor->Valid())
+    {
+        std::pair<char, std::pair<uint256, COutPoint> > key;
+        if (!pcursor->GetKey(key) || key.first != DB_PLEDGEADDRESS || key.second.first != addressKey)
+            break;
+        CPledgeAddressEntry entry;
+        if (!pcursor->GetValue(entry))
+            return error("%s: failed to read value", __func__);
+        vEntries.emplace_back(key.second.second, entry);
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadPledgeAddressEntry(const uint256 &addressKey,
+    const COutPoint &outpoint,
+    CPledgeAddressEntry &entry)
+{
+    return Read(std::make_pair(DB_PLEDGEADDRESS, std::make_pair(addressKey, outpoint)), entry);
+}
+
+bool CBlockTreeDB::ReadUnpledgedEntry(const COutPoint &outpoint, uint256 &addressKey, CPledgeAddressEntry &entry)
+{
+    std::pair<uint256, CPledgeAddressEntry> value;
+    if (!Read(std::make_pair(DB_UNPLEDGED, outpoint), value))
+        return false;
+    addressKey = value.first;
+    entry = value.second;
+    return true;
+}
+
+bool CBlockTreeDB::ReadPledgeAddressBest(uint256 &hashBest) { return Read(DB_PLEDGEADDRESS_BEST, hashBest); }
+bool CBlockTreeDB::WritePledgeAddressIndex(const std::vector<CPledgeAddressChange> &vChanges, const uint256 &hashBest)
+{
+    CDBBatch batch(*this);
+    batch.Write(DB_PLEDGEADDRESS_BEST, hashBest);
+    for (const CPledgeAddressChange &change : vChanges)
+    {
+        auto key = std::make_pair(DB_PLEDGEADDRESS, std::make_pair(change.addressKey, change.outpoint));
+        switch (change.type)
+        {
+        case CPledgeAddressChange::ADD:
+            batch.Write(key, change.entry);
+            batch.Erase(std::make_pair(DB_UNPLEDGED, change.outpoint));
+            break;
+        case CPledgeAddressChange::UNPLEDGE:
+            batch.Erase(key);
+            batch.Write(std::make_pair(DB_UNPLEDGED, change.outpoint), std::make_pair(change.addressKey, change.entry));
+            break;
+        case CPledgeAddressChange::ERASE:
+            batch.Erase(key);
+            batch.Erase(std::make_pair(DB_UNPLEDGED, change.outpoint));
+            break;
+        }
+    }
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue)
 {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
@@ -417,63 +505,281 @@ bool CBlockTreeDB::FindBlockIndex(uint256 blockhash, CDiskBlockIndex *pindex)
     return error("FindBlockIndex(): couldnt find index with requested hash %s", blockhash.GetHex().c_str());
 }
 
+/** Entries decoded from the database and handed to a builder thread at a time */
+static const size_t BLOCK_INDEX_LOAD_CHUNK = 4096;
+/** Chunks that may wait for a builder before the reading thread blocks */
+static const size_t BLOCK_INDEX_LOAD_QUEUE = 16;
+/** Most threads building block index entries */
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
+
+namespace
+{
+//! A block index entry built off the database, before it is moved into blockIndexArena
+struct CLoadedIndex
+{
+    uint256 hash;
+    uint256 hashPrev;
+    CBlockIndex index;
+    CBlockIndex *pindex; //! where it ended up in mapBlockIndex
+    bool fRecent; //! its deadline gets checked again
+};
+
+/**
+ * Takes the chunks of entries decoded by the thread reading the block index
+ * database and builds their CBlockIndex entries on a few threads: hashing the
+ * headers and the checks that need no deadline computation run there, off
+ * cs_mapBlockIndex.  The entries are only moved to blockIndexArena once they
+ * can be laid out in height order.
+ */
+class CBlockIndexBuilder
+{
+private:
+    CWaitableCriticalSection cs;
+    CConditionVariable cvWork;
+    CConditionVariable cvSpace;
+    std::deque<std::vector<CDiskBlockIndex> > queue;
+    bool fDone;
+    bool fFailed;
+    int64_t nTimeBuild; //! summed over the threads
+
+    const Consensus::Params &params;
+    const int64_t nRecentTime;
+    std::vector<std::thread> threads;
+    std::vector<std::deque<CLoadedIndex> > vBuilt; //! one per thread
+
+    bool Build(const CDiskBlockIndex &diskindex, std::deque<CLoadedIndex> &built)
+    {
+        CBlockHeader header = diskindex.GetBlockHeader();
+        uint256 hash = header.GetHash();
+        if (!CheckProofOfCapacityFormat(header, hash, diskindex.nHeight, params))
+            return error("LoadBlockIndex(): CheckProofOfCapacity failed: %s", diskindex.ToString());
+
+        built.emplace_back();
+        CLoadedIndex &entry = built.back();
+        entry.hash = hash;
+        entry.hashPrev = diskindex.hashPrev;
+        entry.pindex = nullptr;
+        entry.fRecent = diskindex.nHeight > 0 && (int64_t)diskindex.nTime >= nRecentTime;
+
+        CBlockIndex *pindexNew = &entry.index;
+        pindexNew->nHeight = diskindex.nHeight;
+        pindexNew->nFile = diskindex.nFile;
+        pindexNew->nDataPos = diskindex.nDataPos;
+        pindexNew->nUndoPos = diskindex.nUndoPos;
+        pindexNew->nVersion = diskindex.nVersion;
+        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+        pindexNew->nTime = diskindex.nTime;
+        pindexNew->nBits = diskindex.nBits;
+        pindexNew->nNonce = diskindex.nNonce;
+        pindexNew->nStatus = diskindex.nStatus;
+        pindexNew->nTx = diskindex.nTx;
+        //add for diskcoin -->
+        pindexNew->nBaseTarget = diskindex.nBaseTarget;
+        pindexNew->nPlotterId = diskindex.nPlotterId;
+        pindexNew->nDeadline = diskindex.nDeadline;
+        memcpy(pindexNew->sig, diskindex.sig, sizeof(diskindex.sig));
+        pindexNew->nNextBaseTarget = diskindex.nNextBaseTarget;
+        memcpy(pindexNew->nextGenSig, diskindex.nextGenSig, sizeof(diskindex.nextGenSig));
+        //<--
+
+        return true;
+    }
+
+    void Thread(int i)
+    {
+        RenameThread(strprintf("loadindex%d", i).c_str());
+        std::vector<CDiskBlockIndex> chunk;
+        int64_t nTime = 0;
+        bool fOk = true;
+        while (fOk)
+        {
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (queue.empty() && !fDone && !fFailed)
+                    cvWork.wait(lock);
+                if (queue.empty() || fFailed)
+                    break;
+                chunk.swap(queue.front());
+                queue.pop_front();
+            }
+            cvSpace.notify_one();
+
+            int64_t nStart = GetTimeMicros();
+            for (const CDiskBlockIndex &diskindex : chunk)
+            {
+                if (!Build(diskindex, vBuilt[i]))
+                {
+                    fOk = false;
+                    break;
+                }
+            }
+            nTime += GetTimeMicros() - nStart;
+            chunk.clear();
+        }
+
+        boost::unique_lock<boost::mutex> lock(cs);
+        nTimeBuild += nTime;
+        if (!fOk)
+        {
+            fFailed = true;
+            cvWork.notify_all();
+            cvSpace.notify_all();
+        }
+    }
+
+public:
+    CBlockIndexBuilder(const Consensus::Params &paramsIn, int nThreads)
+        : fDone(false), fFailed(false), nTimeBuild(0), params(paramsIn), nRecentTime(GetTime() - POC_CHECK_MAX_AGE),
+          vBuilt(nThreads)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threads.emplace_back(&CBlockIndexBuilder::Thread, this, i);
+    }
+
+    ~CBlockIndexBuilder() { Finish(); }
+
+    //! Queue a chunk; false if a builder failed and nothing more should be read
+    bool Add(std::vector<CDiskBlockIndex> &chunk)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (queue.size() >= BLOCK_INDEX_LOAD_QUEUE && !fFailed)
+            cvSpace.wait(lock);
+        if (fFailed)
+            return false;
+        queue.emplace_back();
+        queue.back().swap(chunk);
+        cvWork.notify_one();
+        return true;
+    }
+
+    //! Wait for the queued chunks to be built; false if any entry failed
+    bool Finish()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            fDone = true;
+            cvWork.notify_all();
+        }
+        for (std::thread &thread : threads)
+            thread.join();
+        threads.clear();
+        return !fFailed;
+    }
+
+    int64_t GetBuildTime() const { return nTimeBuild; }
+    std::vector<std::deque<CLoadedIndex> > &GetBuilt() { return vBuilt; }
+};
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    int64_t nTimeStart = GetTimeMicros();
+    int nThreads = std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    CBlockIndexBuilder builder(Params().GetConsensus(), nThreads);
 
+    // This thread only walks the database and decodes the entries
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
     pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
 
-    // Load mapBlockIndex
+    size_t nEntries = 0;
+    std::vector<CDiskBlockIndex> chunk;
+    chunk.reserve(BLOCK_INDEX_LOAD_CHUNK);
+    bool fOk = true;
     while (pcursor->Valid())
     {
         if (shutdown_threads.load() == true)
         {
-            return false;
+            fOk = false;
+            break;
         }
         std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX)
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX)
+            break;
+        chunk.emplace_back();
+        if (!pcursor->GetValue(chunk.back()))
         {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex))
-            {
-                // Construct block index object
-                CBlockIndex *pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-                //add for diskcoin -->
-				pindexNew->nBaseTarget = diskindex.nBaseTarget;
-				pindexNew->nPlotterId = diskindex.nPlotterId;
-				pindexNew->nDeadline = diskindex.nDeadline;
-				memcpy(pindexNew->sig, diskindex.sig, sizeof(diskindex.sig));
-                //<--
-
-                // if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-               	if (!CheckProofOfCapacity(pindexNew->GetBlockHash(), Params().GetConsensus()))
-                    return error("LoadBlockIndex(): CheckProofOfWork failed: %s.   %s != %s", 
-                        pindexNew->ToString(), diskindex.GetBlockHash().GetHex(), pindexNew->GetBlockHash().GetHex());
+            fOk = error("LoadBlockIndex() : failed to read value");
+            break;
+        }
+        nEntries++;
+        if (chunk.size() >= BLOCK_INDEX_LOAD_CHUNK)
+        {
+            if (!builder.Add(chunk))
+                break;
+            chunk.reserve(BLOCK_INDEX_LOAD_CHUNK);
+        }
+        pcursor->Next();
+    }
+    if (fOk && !chunk.empty())
+        builder.Add(chunk);
+    int64_t nTimeRead = GetTimeMicros();
+    if (!builder.Finish() || !fOk)
+        return false;
+    int64_t nTimeBuilt = GetTimeMicros();
 
-                pcursor->Next();
-            }
-            else
-            {
-                return error("LoadBlockIndex() : failed to read value");
-            }
+    // Lay the entries out in height order in one run of the arena, so that walking back along
+    // the chain goes through memory in order rather than hopping between separate allocations
+    std::vector<CLoadedIndex *> vSorted;
+    vSorted.reserve(nEntries);
+    for (std::deque<CLoadedIndex> &built : builder.GetBuilt())
+    {
+        for (CLoadedIndex &entry : built)
+            vSorted.push_back(&entry);
+    }
+    std::sort(vSorted.begin(), vSorted.end(),
+        [](const CLoadedIndex *a, const CLoadedIndex *b) { return a->index.nHeight < b->index.nHeight; });
+    CBlockIndex *pslab = vSorted.empty() ? nullptr : blockIndexArena.Allocate(vSorted.size());
+    int64_t nTimeSorted = GetTimeMicros();
+
+    // Put everything in mapBlockIndex and link it under one lock, rather than two lookups per entry
+    size_t nPlaceholders = 0;
+    std::vector<const CBlockIndex *> vRecent;
+    int64_t nTimeInserted;
+    {
+        WRITELOCK(cs_mapBlockIndex);
+        mapBlockIndex.reserve(mapBlockIndex.size() + nEntries);
+        for (size_t i = 0; i < vSorted.size(); i++)
+        {
+            CLoadedIndex &entry = *vSorted[i];
+            std::pair<BlockMap::iterator, bool> ret = mapBlockIndex.insert(std::make_pair(entry.hash, &pslab[i]));
+            // Already there as the parent of an entry loaded before: fill that one in
+            entry.pindex = ret.first->second;
+            *entry.pindex = entry.index;
+            entry.pindex->phashBlock = &ret.first->first;
         }
-        else
+        nTimeInserted = GetTimeMicros();
+
+        for (const CLoadedIndex *entry : vSorted)
         {
-            break;
+            if (entry->fRecent)
+                vRecent.push_back(entry->pindex);
+            if (entry->hashPrev.IsNull())
+                continue;
+            BlockMap::iterator mi = mapBlockIndex.find(entry->hashPrev);
+            if (mi == mapBlockIndex.end())
+            {
+                CBlockIndex *pindexPrev = blockIndexArena.Allocate();
+                mi = mapBlockIndex.insert(std::make_pair(entry->hashPrev, pindexPrev)).first;
+                pindexPrev->phashBlock = &mi->first;
+                nPlaceholders++;
+            }
+            entry->pindex->pprev = mi->second;
         }
     }
+    int64_t nTimeLinked = GetTimeMicros();
+
+    // Only the recent headers get their deadline computed again, all in one batch
+    if (!CheckBlockIndexProofOfCapacityBatch(vRecent))
+        return error("LoadBlockIndex(): CheckProofOfCapacity failed for a recent block index entry");
+    int64_t nTimeChecked = GetTimeMicros();
+
+    LOGA("Loaded %u block index entries in %.2fs: read %.2fs, built %.2fs later (%.2fs cpu on %d threads), "
+         "sort %.2fs, insert %.2fs, link %.2fs (%u missing parents), PoC check of %u recent headers %.2fs; "
+         "index arena %.1fMiB\n",
+        nEntries, 0.000001 * (nTimeChecked - nTimeStart), 0.000001 * (nTimeRead - nTimeStart),
+        0.000001 * (nTimeBuilt - nTimeRead), 0.000001 * builder.GetBuildTime(), nThreads,
+        0.000001 * (nTimeSorted - nTimeBuilt), 0.000001 * (nTimeInserted - nTimeSorted), 0.000001 * (nTimeLinked - nTimeInserted), nPlaceholders,
+        vRecent.size(), 0.000001 * (nTimeChecked - nTimeLinked), blockIndexArena.DynamicMemoryUsage() / 1048576.0);
     return true;
 }
 
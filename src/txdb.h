@@ -22,6 +22,7 @@ class CBlockIndex;
 class uint256;
 
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_PLEDGEINDEX = false;
 
 //! -dbcache default (MiB)
 static const int64_t nDefaultDbCache = 500;
@@ -99,6 +100,75 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+/** The pledge index entry for the pledged output of a DCOP_PLEDGE transaction */
+struct CPledgeIndexEntry
+{
+    CScript scriptPubKey; // the address pledged to
+    CAmount nValue; // the amount pledged
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(*(CScriptBase *)(&scriptPubKey));
+        READWRITE(nValue);
+    }
+
+    CPledgeIndexEntry(const CScript &scriptPubKeyIn, CAmount nValueIn) : scriptPubKey(scriptPubKeyIn), nValue(nValueIn)
+    {
+    }
+    CPledgeIndexEntry() : nValue(0) {}
+};
+
+/** A pledge in the address pledge index (-pledgeindex), listed under the address it pledges to */
+struct CPledgeAddressEntry
+{
+    CScript scriptPubKey; // the pledged output
+    CAmount nValue; // the amount pledged
+    int nHeight; // height of the block that confirmed the pledge
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(*(CScriptBase *)(&scriptPubKey));
+        READWRITE(nValue);
+        READWRITE(nHeight);
+    }
+
+    CPledgeAddressEntry(const CScript &scriptPubKeyIn, CAmount nValueIn, int nHeightIn)
+        : scriptPubKey(scriptPubKeyIn), nValue(nValueIn), nHeight(nHeightIn)
+    {
+    }
+    CPledgeAddressEntry() : nValue(0), nHeight(0) {}
+};
+
+/** One change to the address pledge index, written in order */
+struct CPledgeAddressChange
+{
+    enum Type
+    {
+        ADD, //! list the pledge under its address
+        UNPLEDGE, //! unlist it, but keep it by outpoint so that disconnecting the unpledge can list it again
+        ERASE //! forget it
+    };
+
+    Type type;
+    uint256 addressKey; // stakedb_key of the address pledged to
+    COutPoint outpoint; // the pledged output
+    CPledgeAddressEntry entry;
+
+    CPledgeAddressChange(Type typeIn,
+        const uint256 &addressKeyIn,
+        const COutPoint &outpointIn,
+        const CPledgeAddressEntry &entryIn = CPledgeAddressEntry())
+        : type(typeIn), addressKey(addressKeyIn), outpoint(outpointIn), entry(entryIn)
+    {
+    }
+};
+
 class CCoinsViewDBCursor;
 
 /** CCoinsView backed by the coin database (chainstate/) */
@@ -177,6 +247,18 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool ReadPledgeIndex(const COutPoint &outpoint, CPledgeIndexEntry &entry);
+    bool WritePledgeIndex(const std::vector<std::pair<COutPoint, CPledgeIndexEntry> > &list);
+    /** The pledges listed under an address, in outpoint order */
+    bool ReadPledgeAddressIndex(const uint256 &addressKey,
+        std::vector<std::pair<COutPoint, CPledgeAddressEntry> > &vEntries);
+    bool ReadPledgeAddressEntry(const uint256 &addressKey, const COutPoint &outpoint, CPledgeAddressEntry &entry);
+    /** A pledge unlisted by an unpledge, with the address it was listed under */
+    bool ReadUnpledgedEntry(const COutPoint &outpoint, uint256 &addressKey, CPledgeAddressEntry &entry);
+    /** The block the pledge address index was last brought to, which the chainstate may not have reached */
+    bool ReadPledgeAddressBest(uint256 &hashBest);
+    /** Apply vChanges and record hashBest as the block the index is at, in one batch */
+    bool WritePledgeAddressIndex(const std::vector<CPledgeAddressChange> &vChanges, const uint256 &hashBest);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool FindBlockIndex(uint256 blockhash, CDiskBlockIndex *index);
@@ -8,6 +8,7 @@
 #include "blockrelay/graphene.h"
 #include "blockrelay/thinblock.h"
 #include "blockstorage/blockstorage.h"
+#include "blockstorage/blockwriter.h"
 #include "cashaddrenc.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -24,6 +25,7 @@
 #include "hash.h"
 #include "leakybucket.h"
 #include "miner.h"
+#include "mininginfo.h"
 #include "net.h"
 #include "parallel.h"
 #include "policy/policy.h"
@@ -604,6 +606,10 @@ void UnlimitedCleanup()
         LOCK(cs_blockvalidationtime);
         nBlockValidationTime.Stop();
     }
+    nMinerTemplateTime.Stop();
+    nMinerReleaseDelay.Stop();
+    nBlockWriteQueueDepth.Stop();
+    nBlockWriteLatency.Stop();
 
     CStatBase *obj = nullptr;
     while (!mallocedStats.empty())
@@ -756,68 +762,139 @@ void AddBlacklist(uint64_t plotter_id)
 	blacklist_s.insert(plotter_id);
 }
 
-static CSharedCriticalSection cs_submit;
+// The best submissions for the next block, lowest deadline first. The miner waits on cvSubmit
+// and is woken whenever they change or the tip moves; nSubmitSeq tells it whether anything did.
+static CWaitableCriticalSection cs_submit;
+static CConditionVariable cvSubmit;
+static std::vector<CSubmit> vSubmits;
+static uint64_t nSubmitSeq = 0;
 
-static CSubmit submit_t;
+static void NotifySubmitCache()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_submit);
+        nSubmitSeq++;
+    }
+    cvSubmit.notify_all();
+}
+
+class CSubmitTipListener : public CValidationInterface
+{
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindex) override { NotifySubmitCache(); }
+};
+static CSubmitTipListener submitTipListener;
+
+void RegisterSubmitCache() { RegisterValidationInterface(&submitTipListener); }
+void UnregisterSubmitCache() { UnregisterValidationInterface(&submitTipListener); }
 
 void ReinitSubmitCache(uint64_t height)
 {
-	WRITELOCK(cs_submit);
-	if (height > 0 && height >= submit_t.height)
-	{
-		submit_t.height = 0;
-	}
+    {
+        boost::unique_lock<boost::mutex> lock(cs_submit);
+        if (height == 0 || vSubmits.empty() || height < vSubmits[0].height)
+            return;
+        vSubmits.clear();
+        nSubmitSeq++;
+    }
+    cvSubmit.notify_all();
 }
 
-void GetSubmitCache(CSubmit *pSubmit)
+void PopSubmitCache(uint64_t height)
 {
-	READLOCK(cs_submit);
-	pSubmit->height 		= submit_t.height;
-	pSubmit->nonce 		= submit_t.nonce;
-	pSubmit->plotter_id 	= submit_t.plotter_id;
-	pSubmit->deadline 	= submit_t.deadline;
-	pSubmit->base_target = submit_t.base_target;
-    
-	memcpy(pSubmit->gensig, submit_t.gensig, sizeof(submit_t.gensig));
+    {
+        boost::unique_lock<boost::mutex> lock(cs_submit);
+        if (vSubmits.empty() || vSubmits[0].height != height)
+            return;
+        vSubmits.erase(vSubmits.begin());
+        nSubmitSeq++;
+    }
+    cvSubmit.notify_all();
 }
 
-bool FastCheckSubmitCache(uint64_t height, uint64_t deadline) {
-    READLOCK(cs_submit);
-    return (height == submit_t.height && deadline >= submit_t.deadline);
+uint64_t GetSubmitCache(CSubmit *pSubmit)
+{
+    boost::unique_lock<boost::mutex> lock(cs_submit);
+    *pSubmit = vSubmits.empty() ? CSubmit() : vSubmits[0];
+    return nSubmitSeq;
 }
 
-bool SetSubmitCache(uint64_t height, uint64_t nonce, uint64_t plotter_id, uint64_t deadline)
+bool WaitSubmitCache(uint64_t nSeq, int64_t nWaitMs)
 {
-	WRITELOCK(cs_submit);
-	if (height < submit_t.height || -1 == chainActive.Height() || height != chainActive.Height()+1)
-	{
-		return false;
-	}
+    boost::unique_lock<boost::mutex> lock(cs_submit);
+    boost::system_time until = boost::get_system_time() + boost::posix_time::milliseconds(nWaitMs);
+    while (nSubmitSeq == nSeq)
+    {
+        if (!cvSubmit.timed_wait(lock, until))
+            return nSubmitSeq != nSeq;
+    }
+    return true;
+}
 
-	// check deadline again here
+bool FastCheckSubmitCache(uint64_t height, uint64_t deadline)
+{
+    boost::unique_lock<boost::mutex> lock(cs_submit);
+    // it could not even become a fallback
+    return vSubmits.size() >= SUBMIT_CACHE_SIZE && height == vSubmits[0].height && deadline >= vSubmits.back().deadline;
+}
 
-	// save
-	bool set = false;
-	if (submit_t.IsInitStatus())
-	{
-		set = true;
-	}
-	else
-	{
-		if (height > submit_t.height || submit_t.deadline > deadline)
-		{
-			set = true;
-		}
-	}
+bool SetSubmitCache(uint64_t height, uint64_t nonce, uint64_t plotter_id, uint64_t deadline)
+{
+    // the published mining info follows the tip without taking cs_main, as the shares were verified against it
+    std::shared_ptr<const CMiningInfo> info = GetMiningInfo();
+    if (!info || height != (uint64_t)info->nHeight)
+        return false;
 
-	if (set)
-	{
-		submit_t.Update(height, nonce, plotter_id, deadline);
-	}
+    CSubmit submit;
+    {
+        boost::unique_lock<boost::mutex> lock(cs_submit);
+        if (!vSubmits.empty() && height < vSubmits[0].height)
+        {
+            return false;
+        }
+        if (!vSubmits.empty() && height > vSubmits[0].height)
+        {
+            vSubmits.clear();
+        }
+        if (vSubmits.size() >= SUBMIT_CACHE_SIZE && deadline >= vSubmits.back().deadline)
+        {
+            return false;
+        }
+        for (const CSubmit &s : vSubmits)
+        {
+            if (s.plotter_id == plotter_id && s.nonce == nonce)
+                return false;
+        }
 
-	return set;
+        submit.Update(height, nonce, plotter_id, deadline);
+        if (submit.IsInitStatus())
+        {
+            return false;
+        }
+        auto it = std::upper_bound(vSubmits.begin(), vSubmits.end(), submit,
+            [](const CSubmit &a, const CSubmit &b) { return a.deadline < b.deadline; });
+        bool fBest = (it == vSubmits.begin());
+        vSubmits.insert(it, submit);
+        if (vSubmits.size() > SUBMIT_CACHE_SIZE)
+        {
+            vSubmits.pop_back();
+        }
+        if (!fBest)
+        {
+            // a fallback only, the miner does not care yet
+            return false;
+        }
+        nSubmitSeq++;
+    }
+    cvSubmit.notify_all();
+    return true;
 }
 
+// diskcoin: seconds between rebuilding the block template for new mempool transactions
+static const int64_t MINER_TEMPLATE_REFRESH = 5;
+// and no rebuild for them this many ms before a release
+static const int64_t MINER_TEMPLATE_GUARD = 2000;
+
 void static BitcoinMiner(const CChainParams &chainparams)
 {
     LOGA("BitcoinMiner started\n");
@@ -856,128 +933,137 @@ void static BitcoinMiner(const CChainParams &chainparams)
         // if (!coinbaseScript || coinbaseScript->reserveScript.empty())
         //     throw std::runtime_error("No coinbase script available (mining requires a wallet)");
 
+        // The block template is kept on top of the tip ahead of time, so that once a submission's
+        // deadline passes only the PoC fields and the coinbase nonce have to be filled in.
+        unique_ptr<CBlockTemplate> pblocktemplate;
+        const CBlockIndex *pindexTemplate = nullptr;
+        unsigned int nTransactionsUpdatedLast = 0;
+        int64_t nTemplateTime = 0;
+
         while (true)
         {
-            /*if (chainparams.MiningRequiresPeers())
-            {
-                // Busy-wait for the network to come online so we don't waste time mining
-                // on an obsolete chain. In regtest mode we expect to fly solo.
-                do
-                {
-                    bool fvNodesEmpty;
-                    {
-                        LOCK(cs_vNodes);
-                        fvNodesEmpty = vNodes.empty();
-                    }
-                    if (!fvNodesEmpty && !IsInitialBlockDownload())
-                        break;
-                    MilliSleep(1000);
-                    LOGA("==== do while %d %d\n", !fvNodesEmpty, !IsInitialBlockDownload());
-                } while (true);
-            }*/
-
-			// diskcoin may be using pre-build block 
+            // read the sequence first: any later submission or tip change ends the next wait at once
 			CSubmit submit;
-            while (true)
+			uint64_t nSeq = GetSubmitCache(&submit);
+
+            CBlockIndex *pindexPrev;
             {
-				GetSubmitCache( &submit);
-				if (submit.IsInitStatus())
-				{
-                    if (Params().NetworkIDString() == "regtest") {
-                        MilliSleep(1);
-                        continue;
-                    }
-					MilliSleep(1000);
-					continue;
-				}
+                LOCK(cs_main);
+                pindexPrev = chainActive.Tip();
+            }
 
-				auto next_height = chainActive.Height()+1;
-				if (submit.height == next_height)
-				{
-                    //--->fast test-->
-                    if (Params().NetworkIDString() == "regtest") {
-                        break;
-                    }
-                    //<--
-
-					auto last = chainActive.Height();
-					auto prev = chainActive[last];
-					if (prev->nTime+submit.deadline < GetTime())
-					{
-						break;
-					}
-					MilliSleep(500);
-				}
-				else
+			auto next_height = pindexPrev->nHeight+1;
+			if (!submit.IsInitStatus() && submit.height != (uint64_t)next_height)
+			{
+				if (submit.height < (uint64_t)next_height)
 				{
 					ReinitSubmitCache(next_height);
+					continue;
 				}
+				// the tip is about to catch up
+				WaitSubmitCache(nSeq, 1000);
+				continue;
+			}
+
+            // ms at which the submitted block may be released
+            int64_t nReleaseTime = 0;
+            if (!submit.IsInitStatus() && Params().NetworkIDString() != "regtest") {
+                nReleaseTime = (pindexPrev->nTime + submit.deadline + 1) * 1000;
             }
-            LOGA("Get mined %d sig %s, dl %llu, nonce %llu, pid %llu, base_target %llu", 
-                submit.height, HexEncode(submit.gensig, 32), submit.deadline, submit.nonce, submit.plotter_id, submit.base_target);
 
-            //
-            // Create new block
-            //
-            unsigned int nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-            CBlockIndex *pindexPrev;
+            // Rebuild for a new tip, or for new transactions unless the release is too close
+            bool fRebuild = !pblocktemplate || pindexTemplate != pindexPrev;
+            if (!fRebuild && mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast &&
+                GetTime() - nTemplateTime >= MINER_TEMPLATE_REFRESH &&
+                (submit.IsInitStatus() || nReleaseTime - GetTimeMillis() > MINER_TEMPLATE_GUARD))
             {
-                LOCK(cs_main);
-                pindexPrev = chainActive.Tip();
+                fRebuild = true;
+            }
+            if (fRebuild)
+            {
+                int64_t nStart = GetTimeMillis();
+                nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+                pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(scriptFundPubKey, coinbaseScript->reserveScript, -1, nullptr);
+                if (!pblocktemplate.get())
+                {
+                    LOGA("Error in BitcoinMiner: Keypool ran out, please call keypoolrefill before restarting the "
+                         "mining thread\n");
+                    return;
+                }
+                pindexTemplate = LookupBlockIndex(pblocktemplate->block.hashPrevBlock);
+                nTemplateTime = GetTime();
+                nMinerTemplateTime << (GetTimeMillis() - nStart);
+                LOG(BENCH, "Block template for %d with %u transactions (%u bytes) in %dms\n", next_height,
+                    pblocktemplate->block.vtx.size(), pblocktemplate->block.GetBlockSize(), GetTimeMillis() - nStart);
+                // the tip may have moved while building
+                continue;
             }
 
-            unique_ptr<CBlockTemplate> pblocktemplate(
-                BlockAssembler(chainparams).CreateNewBlock(scriptFundPubKey, coinbaseScript->reserveScript, -1, &submit));
-            if (!pblocktemplate.get())
+			if (submit.IsInitStatus())
+			{
+				WaitSubmitCache(nSeq, MINER_TEMPLATE_REFRESH * 1000);
+				continue;
+			}
+
+            // Sleep until exactly the release time, or until a better submission or a new tip arrives
+            int64_t nWait = nReleaseTime - GetTimeMillis();
+            if (nWait > 0)
             {
-                LOGA("Error in BitcoinMiner: Keypool ran out, please call keypoolrefill before restarting the "
-                     "mining thread\n");
-                return;
+                WaitSubmitCache(nSeq, std::min(nWait, MINER_TEMPLATE_REFRESH * 1000));
+                continue;
             }
+
             CBlock *pblock = &pblocktemplate->block;
+            if (memcmp(submit.gensig, pblock->sig, 32) != 0)
+            {
+                // submitted for a block at this height that is no longer the tip
+                ReinitSubmitCache(submit.height);
+                continue;
+            }
+
+            LOGA("Get mined %d sig %s, dl %llu, nonce %llu, pid %llu, base_target %llu", 
+                submit.height, HexEncode(submit.gensig, 32), submit.deadline, submit.nonce, submit.plotter_id, submit.base_target);
+
+            pblock->nNonce = submit.nonce;
+            pblock->nPlotterId = submit.plotter_id;
+            pblock->nDeadline = submit.deadline;
+            UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
             IncrementExtraNonce(pblock, submit.nonce);
 
             LOGA("Running Miner with %u transactions in block (%u bytes)\n", pblock->vtx.size(),
                 pblock->GetBlockSize());
 
-            int64_t nStart = GetTime();
-
 			SetThreadPriority(THREAD_PRIORITY_NORMAL);
-			ProcessBlockFound(pblock, chainparams);
+			bool fFound = ProcessBlockFound(pblock, chainparams);
             SetThreadPriority(THREAD_PRIORITY_LOWEST);
 
+            if (nReleaseTime)
+            {
+                int64_t nDelay = std::max(GetTimeMillis() - (nReleaseTime - 1000), (int64_t)0);
+                nMinerReleaseDelay << nDelay;
+                LOGA("Block %d processed %dms after its deadline\n", submit.height, nDelay);
+            }
+
             //update immd
+            bool fTipMoved;
             {
+                LOCK(cs_main);
                 CBlockIndex *pindex = chainActive.Tip();
                 if (pindex)
                     stakedb_restep_to (pindex);
+                fTipMoved = pindex != pindexPrev;
             }
 
             coinbaseScript->KeepScript();
 
-            // In regression test mode, stop mining after a block is found.
-            // if (chainparams.MineBlocksOnDemand())
-            //    throw boost::thread_interrupted();
-                
-	        // Check for stop or if block needs to be rebuilt
-	        // boost::this_thread::interruption_point();
-	        // Regtest mode doesn't require peers
-	        // if (vNodes.empty() && chainparams.MiningRequiresPeers())
-	        //    break;
-
-	        if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60)
-	            break;
-	        /*{
-	            LOCK(cs_main);
-	            if (pindexPrev != chainActive.Tip())
-	                break;
-	        }*/
-
-	        // Update nTime every few seconds
-	        if (UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev) < 0)
-	            break; // Recreate the block if the clock has run backwards,
-	        // so that we can use the correct time.
-
+            // the coinbase has been patched, start from a fresh template
+            pblocktemplate.reset();
+            if (!fFound && !fTipMoved)
+            {
+                // rejected: fall back on the next best submission for this height
+                PopSubmitCache(submit.height);
+                continue;
+            }
 	       	ReinitSubmitCache(submit.height);
         }
     }
@@ -251,6 +251,9 @@ extern CStatHistory<uint64_t> recvAmt;
 extern CStatHistory<uint64_t> sendAmt;
 extern CStatHistory<uint64_t> nTxValidationTime;
 extern CStatHistory<uint64_t> nBlockValidationTime;
+// diskcoin: ms spent building the internal miner's block template, and from a deadline to the block being processed
+extern CStatHistory<uint64_t> nMinerTemplateTime;
+extern CStatHistory<uint64_t> nMinerReleaseDelay;
 extern CCriticalSection cs_blockvalidationtime;
 
 // Connection Slot mitigation - used to track connection attempts and evictions
@@ -322,9 +325,21 @@ extern std::map<int64_t, CMiningCandidate> miningCandidatesMap;
 
 // diskcoin
 #include "miner.h"
-void GetSubmitCache(CSubmit *pSubmit);
+/** Submissions kept for the next block, so an invalid best one can fall back on the others */
+static const unsigned int SUBMIT_CACHE_SIZE = 4;
+/** Copy the best submission, or an empty one. Returns the change sequence number to pass to WaitSubmitCache */
+uint64_t GetSubmitCache(CSubmit *pSubmit);
+/** Wait up to nWaitMs for the best submission or the tip to change after nSeq. Returns whether it did */
+bool WaitSubmitCache(uint64_t nSeq, int64_t nWaitMs);
+/** Add a verified submission. Returns whether it is the new best */
 bool SetSubmitCache(uint64_t height, uint64_t nonce, uint64_t plotter_id, uint64_t deadline);
+/** Whether a claimed deadline is too high to enter the cache, so it need not be verified */
 bool FastCheckSubmitCache(uint64_t height, uint64_t deadline);
+/** Drop the best submission for height, after its block was rejected */
+void PopSubmitCache(uint64_t height);
+/** Wake submit cache waiters on every new tip, from startup until shutdown */
+void RegisterSubmitCache();
+void UnregisterSubmitCache();
 
 void UpdateBlacklist(const std::vector<uint64_t>& data);
 
@@ -332,5 +347,7 @@ std::vector<uint64_t> GetBlacklist();
 
 void AddBlacklist(uint64_t plotter_id);
 
+bool InBlacklist(uint64_t plotter_id);
+
 
 #endif
@@ -16,10 +16,10 @@
 #include "dosman.h"
 #include "expedited.h"
 #include "init.h"
+#include "mininginfo.h"
 #include "requestManager.h"
+#include "stakereward.h"
 #include "sync.h"
-#include "wallet/wallet.h"
-#include "wallet/rpcwallet.h"
 #include "dstencode.h"
 #include "timedata.h"
 #include "txadmission.h"
@@ -171,7 +171,7 @@ bool ContextualCheckBlockHeader(const CBlockHeader &block, CValidationState &sta
 
     //add for diskcoin -->
     //1. check basetarget
-    uint64_t basetarget = CalculateBaseTarget(pindexPrev);
+    uint64_t basetarget = pindexPrev->nNextBaseTarget;
     if (basetarget > 0 && basetarget != block.nBaseTarget) {
         return state.DoS(100, error("%s: incorrect poc. Height %d, Block basetarget 0x%x, expected 0x%x", __func__,
                               nHeight, block.nBaseTarget, basetarget),
@@ -179,8 +179,7 @@ bool ContextualCheckBlockHeader(const CBlockHeader &block, CValidationState &sta
     }
 
     //2. check sig
-    unsigned char gen_sig[32] = {};
-    CalculateSignature (pindexPrev, gen_sig);
+    const unsigned char *gen_sig = pindexPrev->nextGenSig;
     if (memcmp (gen_sig, block.sig, 32) != 0) {
             return state.DoS(100, error("%s: incorrect sig. Height %d, %s!=%s", __func__,
                                   nHeight, HexEncode(gen_sig,32), HexEncode(block.sig, 32)),
@@ -287,8 +286,8 @@ CBlockIndex *AddToBlockIndex(const CBlockHeader &block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex *pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex *pindexNew = blockIndexArena.Allocate();
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -309,6 +308,8 @@ CBlockIndex *AddToBlockIndex(const CBlockHeader &block)
         }
     }
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
+    pindexNew->BuildMedianTimePast();
+    pindexNew->BuildPocNext();
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
 
     if ((!(pindexNew->nStatus & BLOCK_FAILED_MASK)) &&
@@ -341,9 +342,7 @@ CBlockIndex *InsertBlockIndex(const uint256 &hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex *pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error("LoadBlockIndex(): new CBlockIndex failed");
+    CBlockIndex *pindexNew = blockIndexArena.Allocate();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -415,6 +414,13 @@ bool LoadBlockIndexDB()
     {
         CBlockIndex *pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        pindex->BuildMedianTimePast();
+        // diskcoin: indexes written before the PoC values were stored get them once, then are rewritten
+        if (!(pindex->nStatus & BLOCK_HAVE_POC_NEXT))
+        {
+            pindex->BuildPocNext();
+            setDirtyBlockIndex.insert(pindex);
+        }
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0)
@@ -513,6 +519,10 @@ bool LoadBlockIndexDB()
     pblocktree->ReadFlag("txindex", fTxIndex);
     LOGA("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have an address pledge index
+    pblocktree->ReadFlag("pledgeindex", fPledgeIndex);
+    LOGA("%s: pledge address index %s\n", __func__, fPledgeIndex ? "enabled" : "disabled");
+
     // Load pointer to end of best chain
     uint256 bestblockhash = pcoinsdbview->GetBestBlock();
     BlockMap::iterator it = mapBlockIndex.find(bestblockhash);
@@ -570,12 +580,8 @@ void UnloadBlockIndex()
 
     {
         WRITELOCK(cs_mapBlockIndex);
-
-        for (BlockMap::value_type &entry : mapBlockIndex)
-        {
-            delete entry.second;
-        }
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
     }
 
     fHavePruned = false;
@@ -603,6 +609,8 @@ bool InitBlockIndex(const CChainParams &chainparams)
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fPledgeIndex = GetBoolArg("-pledgeindex", DEFAULT_PLEDGEINDEX);
+    pblocktree->WriteFlag("pledgeindex", fPledgeIndex);
     LOGA("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -1132,20 +1140,6 @@ CAmount GetBlockSubsidy(int nHeight, const Consensus::Params &consensusParams)
     return nSubsidy;
 }
 
-CAmount GetTotalCoinByHeight(int nHeight, const Consensus::Params &consensusParams) {
-    // nHeight &= ~(uPeriod-1); //align 1800
-    nHeight -= (nHeight%uPeriod);
-    int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
-    CAmount nTotal = 0;
-    CAmount nSubsidy = 20 * COIN;
-    for (int i = 0; i < halvings; ++i) {
-        nSubsidy >>= 1;
-        nTotal += nSubsidy * consensusParams.nSubsidyHalvingInterval;
-    }
-    nTotal += nSubsidy * (nHeight%consensusParams.nSubsidyHalvingInterval);
-    return nTotal;
-}
-
 // CAmount GetBlockFundSubsidy(int nHeight, const Consensus::Params &consensusParams, uint64_t uPledge)
 // {
     
@@ -1161,79 +1155,6 @@ CAmount GetTotalCoinByHeight(int nHeight, const Consensus::Params &consensusPara
 //     return nFundSubsidy;
 // }
 
-CAmount GetBlockMinerSubsidy(int nHeight, const Consensus::Params &consensusParams, uint64_t uPledge, uint32_t uMinedBlockNum)
-{
-    CAmount nSubsidy = GetBlockSubsidy(nHeight, consensusParams);
-    if (nHeight <= uPeriod) {
-        return nSubsidy * 0.4;
-    }
-
-    CAmount uMinedCoins = GetTotalCoinByHeight(nHeight, consensusParams);
-    double dCF = (uPledge * uPeriod * 1.0)/(uMinedCoins*uMinedBlockNum);
-    double dDR = 0.4 + 0.6* (pow(2, ceil(dCF)) - ceil(dCF) - 1 + dCF)/(pow(2, ceil(dCF))) ;
-    CAmount nMinerSubsidy = nSubsidy * dDR;
-    if (nMinerSubsidy + 1e+6 > nSubsidy) {
-        nMinerSubsidy = nSubsidy - 1e+6;
-    }
-    LOGAF("nHeight(%d) uMinedCoins(%llu) uMinedBlockNum(%d) uPledge(%llu) dCF(%.20lf), dDR(%.20lf), nMinerSubsidy(%llu)\n", 
-        nHeight, uMinedCoins, uMinedBlockNum, uPledge, dCF, dDR, nMinerSubsidy);
-
-    return nMinerSubsidy;
-}
-
-CAmount GetWalletAddressPledge(const CScript &scriptPubKeyIn)
-{
-    CTxDestination firstAddress;
-    if (!ExtractDestination(scriptPubKeyIn, firstAddress)) {
-        LOGAF("Failed to ExtractDestination scriptPubKeyIn");
-        return 0;
-    }
-
-    UniValue params(UniValue::VARR);
-    params.push_back(1);
-    params.push_back(99999999);
-
-    UniValue address(UniValue::VARR);
-    address.push_back(EncodeDestination(firstAddress));
-    params.push_back(address);
-    UniValue uvRet = liststakein(params, false);
-    UniValue uvArr = uvRet.get_array();
-    
-    CAmount amount = 0;
-    for (unsigned int idx = 0; idx < uvArr.size(); idx++) {
-        const UniValue &uvItem = uvArr[idx];
-        UniValue uvObj = uvItem.get_obj();
-        CAmount satoshi = uvObj["satoshi"].get_uint64();
-        LOGAF("+satoshi(%d)", satoshi);
-        amount += satoshi;
-    }
-    
-    LOGAF("amount(%d)", amount);
-    return amount;
-}
-
-uint32_t GetWalletAddressMinedBlock(const CScript &scriptPubKeyIn)
-{
-    CTxDestination firstAddress;
-    if (!ExtractDestination(scriptPubKeyIn, firstAddress)) {
-        LOGAF("Failed to ExtractDestination scriptPubKeyIn");
-        return 0;
-    }
-
-    //auto sets = pwalletMain -> GetAddressGroupings();
-
-    UniValue params(UniValue::VARR);
-    params.push_back(1);
-    params.push_back(1799);
-
-    UniValue address(UniValue::VARR);
-    address.push_back(EncodeDestination(firstAddress));
-    params.push_back(address);
-    UniValue uvRet = listminedblock(params, false);
-
-    return uvRet.size();
-}
-
 int32_t ComputeBlockVersion(const CBlockIndex *pindexPrev, const Consensus::Params &params)
 {
     LOCK(cs_main);
@@ -1391,9 +1312,25 @@ CBlockIndex *FindMostWorkChain()
     DbgAssert(0, return NULL); // should never get here
 }
 
+/**
+ * Publishes the mining info of the tip when it goes out of scope.  UpdatedBlockTip only fires for blocks
+ * connected outside of IBD, this also covers disconnects and whatever else changed the tip meanwhile.
+ */
+class CMiningInfoRepublisher
+{
+public:
+    ~CMiningInfoRepublisher()
+    {
+        AssertLockHeld(cs_main);
+        if (chainActive.Tip())
+            UpdateMiningInfo(chainActive.Tip());
+    }
+};
+
 bool InvalidateBlock(CValidationState &state, const Consensus::Params &consensusParams, CBlockIndex *pindex)
 {
     AssertLockHeld(cs_main);
+    CMiningInfoRepublisher republisher;
 
     // Mark the block itself as invalid.
                 LOGAF("back===");
@@ -2597,6 +2534,111 @@ bool ConnectBlockCanonicalOrdering(const CBlock &block,
     return true;
 }
 
+/**
+ * Keep the address pledge index (-pledgeindex) in step with the active chain.  Connecting lists the
+ * block's pledges under their address and unlists the pledges its unpledges spend; disconnecting undoes
+ * that in reverse.  Unpledged entries are kept by outpoint, so the index needs no undo data of its own.
+ * The block the index is then at is written with the changes, see SyncPledgeAddressIndex().
+ */
+static bool UpdatePledgeAddressIndex(const CBlock &block, const CBlockIndex *pindex, bool fConnect)
+{
+    const int nHeight = pindex->nHeight;
+    std::vector<CPledgeAddressChange> vChanges;
+    // pledges listed by this block, which an unpledge later in the block may already spend
+    std::map<COutPoint, CPledgeAddressEntry> mapAdded;
+    for (size_t i = 0; i < block.vtx.size(); i++)
+    {
+        const CTransaction &tx = *block.vtx[fConnect ? i : block.vtx.size() - 1 - i];
+        int iin, iout;
+        uint32_t nType = tx.GetPledgeType(iin, iout);
+        if (nType == DCOP_PLEDGE)
+        {
+            COutPoint outpoint(tx.GetHash(), iin);
+            uint256 addressKey = stakedb_key(tx.vout[iout].scriptPubKey);
+            if (!fConnect)
+            {
+                vChanges.emplace_back(CPledgeAddressChange::ERASE, addressKey, outpoint);
+                continue;
+            }
+            CPledgeAddressEntry entry(tx.vout[iin].scriptPubKey, tx.vout[iin].nValue, nHeight);
+            mapAdded[outpoint] = entry;
+            vChanges.emplace_back(CPledgeAddressChange::ADD, addressKey, outpoint, entry);
+        }
+        else if (nType == DCOP_UNPLEDGE && (size_t)iin < tx.vin.size())
+        {
+            const COutPoint &outpoint = tx.vin[iin].prevout;
+            uint256 addressKey;
+            CPledgeAddressEntry entry;
+            if (!fConnect)
+            {
+                if (pblocktree->ReadUnpledgedEntry(outpoint, addressKey, entry))
+                    vChanges.emplace_back(CPledgeAddressChange::ADD, addressKey, outpoint, entry);
+                continue;
+            }
+            CPledgeIndexEntry pledge;
+            if (!pblocktree->ReadPledgeIndex(outpoint, pledge))
+                continue; // not spending a pledge
+            addressKey = stakedb_key(pledge.scriptPubKey);
+            std::map<COutPoint, CPledgeAddressEntry>::const_iterator it = mapAdded.find(outpoint);
+            if (it != mapAdded.end())
+                entry = it->second;
+            else if (!pblocktree->ReadPledgeAddressEntry(addressKey, outpoint, entry))
+                continue; // already unlisted, e.g. the block is connected again by -checklevel 4
+            vChanges.emplace_back(CPledgeAddressChange::UNPLEDGE, addressKey, outpoint, entry);
+        }
+    }
+    if (!vChanges.empty())
+        LOG(COINDB, "Pledge address index: %u changes at height %d (%s)\n", vChanges.size(), nHeight,
+            fConnect ? "connect" : "disconnect");
+    const uint256 hashBest = fConnect ? pindex->GetBlockHash() : pindex->pprev->GetBlockHash();
+    return pblocktree->WritePledgeAddressIndex(vChanges, hashBest);
+}
+
+bool SyncPledgeAddressIndex(const Consensus::Params &consensusParams)
+{
+    if (!fPledgeIndex)
+        return true;
+    LOCK(cs_main);
+    const CBlockIndex *pindexTip = chainActive.Tip();
+    if (!pindexTip)
+        return true;
+
+    uint256 hashBest;
+    if (!pblocktree->ReadPledgeAddressBest(hashBest))
+    {
+        // an index written before the block it is at was recorded, take it as matching the chainstate
+        return pblocktree->WritePledgeAddressIndex(std::vector<CPledgeAddressChange>(), pindexTip->GetBlockHash());
+    }
+    const CBlockIndex *pindex = LookupBlockIndex(hashBest);
+    if (!pindex)
+        return error("%s: pledge address index is at unknown block %s", __func__, hashBest.ToString());
+    if (pindex == pindexTip)
+        return true;
+
+    LOGA("Pledge address index is at height %d, bringing it to the chain tip at height %d\n", pindex->nHeight,
+        pindexTip->nHeight);
+    // undo the blocks connected, but not flushed to the chainstate, before the node stopped
+    while (!chainActive.Contains(pindex))
+    {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensusParams))
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        if (!UpdatePledgeAddressIndex(block, pindex, false))
+            return false;
+        pindex = pindex->pprev;
+    }
+    // and replay the ones the chainstate has, those disconnected before it was flushed included
+    while (pindex != pindexTip)
+    {
+        pindex = chainActive.Next(pindex);
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensusParams))
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        if (!UpdatePledgeAddressIndex(block, pindex, true))
+            return false;
+    }
+    return true;
+}
 
 bool ConnectBlock(const CBlock &block,
     CValidationState &state,
@@ -2730,6 +2772,20 @@ bool ConnectBlock(const CBlock &block,
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
+    // Entries only depend on the pledge transaction itself, so they stay valid across reorgs
+    std::vector<std::pair<COutPoint, CPledgeIndexEntry> > vPledges;
+    for (const auto &ptx : block.vtx)
+    {
+        int iin, iout;
+        if (ptx->GetPledgeType(iin, iout) == DCOP_PLEDGE)
+            vPledges.emplace_back(COutPoint(ptx->GetHash(), iin),
+                CPledgeIndexEntry(ptx->vout[iout].scriptPubKey, ptx->vout[iin].nValue));
+    }
+    if (!vPledges.empty() && !pblocktree->WritePledgeIndex(vPledges))
+        return AbortNode(state, "Failed to write pledge index");
+    if (fPledgeIndex && !UpdatePledgeAddressIndex(block, pindex, true))
+        return AbortNode(state, "Failed to write pledge address index");
+
     // add this block to the view's block chain (the main UTXO in memory cache)
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -3006,6 +3062,9 @@ bool DisconnectTip(CValidationState &state, const Consensus::Params &consensusPa
         bool result = view.Flush();
         assert(result);
     }
+    // Not in DisconnectBlock, which also runs against scratch views when verifying the database
+    if (fPledgeIndex && !UpdatePledgeAddressIndex(block, pindexDelete, false))
+        return AbortNode(state, "Failed to update pledge address index");
     LOG(BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
@@ -3030,6 +3089,7 @@ bool DisconnectTip(CValidationState &state, const Consensus::Params &consensusPa
 
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
+    GetMainSignals().BlockDisconnected(block, pindexDelete);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     for (const auto &ptx : block.vtx)
@@ -3082,6 +3142,8 @@ bool ConnectTip(CValidationState &state,
     // assert(pindexNew->pprev == chainActive.Tip());
     if (pindexNew->pprev != chainActive.Tip())
         return false;
+    // Miners keep reading the mining info of the current tip while this block is connected
+    MarkMiningInfoStale(pindexNew->nHeight);
 
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
@@ -3097,30 +3159,8 @@ bool ConnectTip(CValidationState &state,
     nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LOG(BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
-    {
-        CCoinsViewCache view(pcoinsTip);
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view, chainparams, false, fParallel);
-        GetMainSignals().BlockChecked(*pblock, state);
-        if (!rv)
-        {
-            if (state.IsInvalid())
-            {
-                // DbgPause();
-                InvalidBlockFound(pindexNew, state);
-                return error("ConnectTip(): ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
-            }
-            return false;
-        }
-        int64_t nStart = GetTimeMicros();
-        bool result = view.Flush();
-        assert(result);
-        LOG(BENCH, "      - Update Coins %.3fms\n", GetTimeMicros() - nStart);
-
-        mapBlockSource.erase(pindexNew->GetBlockHash());
-        nTime3 = GetTimeMicros();
-        nTimeConnectTotal += nTime3 - nTime2;
-        LOG(BENCH, "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
-    }
+    // The coinbase is checked against the stake before anything of the block is applied, so that a failure
+    // leaves the coins and the active chain at the same tip
     //add for diskcoin -->
     //add to stakedb
     int nStakeHeight = -1;
@@ -3141,13 +3181,15 @@ bool ConnectTip(CValidationState &state,
         }
         int nHeight = pindexNew->nHeight;
         std::string addr = EncodeDestination(addrDest);
-        uint64_t uPledge = stakedb_get_stake (addr.c_str());
-        int uMinedBlockNum = stakedb_get_mined (addr.c_str()) + 1;
+        CStakeReward reward;
+        if (!GetStakeReward(nHeight, tx->vout[1].scriptPubKey, chainparams.GetConsensus(), reward)) {
+            // Nothing of the block has been applied yet, so the tip stays where it is
+            return error("%s: failed to read the stake of %s at %d", __func__, addr, nHeight);
+        }
 
-        CAmount nMinerValue = GetBlockMinerSubsidy(nHeight, chainparams.GetConsensus(), uPledge, uMinedBlockNum);
-        CAmount nFundValue = GetBlockSubsidy(nHeight, chainparams.GetConsensus()) - nMinerValue;
+        CAmount nFundValue = reward.nFundValue;
         LOGAF("nHeight %d, uPledge %lu, uMined %d, Fund get %lld ? real %lld, addr %s", nHeight, 
-            uPledge, uMinedBlockNum, nFundValue, tx->vout[0].nValue, addr);
+            reward.nPledge, reward.nMinedBlocks, nFundValue, tx->vout[0].nValue, addr);
         if (tx->vout[0].nValue /*+ (CAmount)1e+6*/ < nFundValue) {
             bool ret_dos = false;
             switch (chainparams.NetworkIDString().c_str()[0]) {
@@ -3169,6 +3211,31 @@ bool ConnectTip(CValidationState &state,
 
     }
 
+    {
+        CCoinsViewCache view(pcoinsTip);
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, chainparams, false, fParallel);
+        GetMainSignals().BlockChecked(*pblock, state);
+        if (!rv)
+        {
+            if (state.IsInvalid())
+            {
+                // DbgPause();
+                InvalidBlockFound(pindexNew, state);
+                return error("ConnectTip(): ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
+            }
+            return false;
+        }
+        int64_t nStart = GetTimeMicros();
+        bool result = view.Flush();
+        assert(result);
+        LOG(BENCH, "      - Update Coins %.3fms\n", GetTimeMicros() - nStart);
+
+        mapBlockSource.erase(pindexNew->GetBlockHash());
+        nTime3 = GetTimeMicros();
+        nTimeConnectTotal += nTime3 - nTime2;
+        LOG(BENCH, "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+    }
+
     int64_t nTime4 = GetTimeMicros();
     nTimeFlush += nTime4 - nTime3;
     LOG(BENCH, "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
@@ -3185,6 +3252,7 @@ bool ConnectTip(CValidationState &state,
     mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted, !IsInitialBlockDownload());
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
+    GetMainSignals().BlockConnected(*pblock, pindexNew);
     // Tell wallet about transactions that went from mempool
     // to conflicted:
     for (const auto &ptx : txConflicted)
@@ -3478,6 +3546,7 @@ bool ActivateBestChain(CValidationState &returnedState,
 
     TxAdmissionPause txlock;
     LOCK(cs_main);
+    CMiningInfoRepublisher republisher;
 
     bool fOneDone = false;
     do
@@ -53,6 +53,13 @@ bool InitBlockIndex(const CChainParams &chainparams);
 
 void CheckBlockIndex(const Consensus::Params &consensusParams);
 
+/**
+ * The pledge address index is written as blocks are connected and disconnected, the chainstate only
+ * when it is flushed, so after a crash they can be at different blocks.  Undo or replay the blocks
+ * the index has that the chainstate tip does not, or misses.  Call once the tip is loaded.
+ */
+bool SyncPledgeAddressIndex(const Consensus::Params &consensusParams);
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
@@ -82,24 +89,17 @@ bool TestBlockValidity(CValidationState &state,
     bool fCheckMerkleRoot = true);
 
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params &consensusParams);
-//add for diskcoin -->
-CAmount GetTotalCoinByHeight(int nHeight, const Consensus::Params &consensusParams);
-//<--
 
-//diskcoin 1800 cycle
+//diskcoin 1800 cycle, the DES reward split is in stakereward.h
 const uint32_t uPeriod = 1800;
 // static uint64_t uBlockPeriod = 0;
-CAmount GetBlockSubsidy(int nHeight, const Consensus::Params &consensusParams);
 // CAmount GetBlockFundSubsidy(int nHeight, const Consensus::Params &consensusParams, uint64_t uPledge);
-CAmount GetBlockMinerSubsidy(int nHeight, const Consensus::Params &consensusParams, uint64_t uPledge, uint32_t uMinedBlockNum);
 // double GetNetColFactor(uint64_t nHeight, const Consensus::Params &consensusParams, uint64_t uCap);
 // double GetMinerColFactor(uint64_t uMinerCap, uint64_t uPledge);
 // double GetColFactor(double dNC, double dMC);
 // double GetSimpleColFactor(uint64_t nHeight, const Consensus::Params &consensusParams, uint64_t uPledge);
 // double GetGainFactor(uint64_t nHeight, const Consensus::Params &consensusParams, uint64_t uPledge);
 // CAmount GetLastMinedCoins(uint64_t nHeight, const Consensus::Params &consensusParams);
-CAmount GetWalletAddressPledge(const CScript &scriptPubKeyIn);
-uint32_t GetWalletAddressMinedBlock(const CScript &scriptPubKeyIn);
 
 /**
  * Determine what nVersion a new block should use.
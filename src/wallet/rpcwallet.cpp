@@ -13,6 +13,7 @@
 #include "net.h"
 #include "rpc/server.h"
 #include "script/sign.h"
+#include "stakereward.h"
 #include "timedata.h"
 #include "txadmission.h"
 #include "util.h"
@@ -2944,6 +2945,38 @@ UniValue fundrawtransaction(const UniValue &params, bool fHelp)
 }
 
 //add for diskcoin -->
+static UniValue StakeInEntry(const uint256 &txid, int n, const CTxOut &txout, int nDepth)
+{
+    const CScript &pk = txout.scriptPubKey;
+    UniValue entry(UniValue::VOBJ);
+    entry.pushKV("txid", txid.GetHex());
+    entry.pushKV("vout", n);
+    CTxDestination address;
+    if (ExtractDestination(pk, address))
+    {
+        entry.pushKV("address", EncodeDestination(address));
+        if (pwalletMain->mapAddressBook.count(address))
+            entry.pushKV("account", pwalletMain->mapAddressBook[address].name);
+    }
+    entry.pushKV("scriptPubKey", HexStr(pk.begin(), pk.end()));
+    if (pk.IsPayToScriptHash())
+    {
+        CTxDestination address2;
+        if (ExtractDestination(pk, address2))
+        {
+            const CScriptID &hash = boost::get<CScriptID>(address2);
+            CScript redeemScript;
+            if (pwalletMain->GetCScript(hash, redeemScript))
+                entry.pushKV("redeemScript", HexStr(redeemScript.begin(), redeemScript.end()));
+        }
+    }
+    entry.pushKV("satoshi", UniValue(txout.nValue));
+    entry.pushKV("amount", ValueFromAmount(txout.nValue));
+    entry.pushKV("confirmations", nDepth);
+    // entry.pushKV("spendable", out.fSpendable);
+    return entry;
+}
+
 UniValue liststakein(const UniValue &params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp))
@@ -2955,6 +2988,8 @@ UniValue liststakein(const UniValue &params, bool fHelp)
             "\nReturns array of unspent transaction outputs\n"
             "with between minconf and maxconf (inclusive) confirmations.\n"
             "Optionally filter to only include txouts paid to specified addresses.\n"
+            "With -pledgeindex and addresses given, the active pledges to those addresses are\n"
+            "read from the index instead of the wallet, whether or not the wallet holds them.\n"
             "Results are an array of Objects, each of which has:\n"
             "{txid, vout, scriptPubKey, amount, confirmations}\n"
             "\nArguments:\n"
@@ -3018,6 +3053,30 @@ UniValue liststakein(const UniValue &params, bool fHelp)
     vector<COutput> vecOutputs;
     assert(pwalletMain != nullptr);
     LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    if (fPledgeIndex && !destinations.empty())
+    {
+        // Only the pledges to the given addresses are looked at, instead of every coin in the wallet
+        for (const CTxDestination &dest : destinations)
+        {
+            vector<pair<COutPoint, CPledgeAddressEntry> > vEntries;
+            if (!pblocktree->ReadPledgeAddressIndex(stakedb_key(GetScriptForDestination(dest)), vEntries))
+                throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the pledge index");
+            for (const auto &item : vEntries)
+            {
+                int nDepth = chainActive.Height() - item.second.nHeight + 1;
+                if (nDepth < nMinDepth || nDepth > nMaxDepth)
+                    continue;
+                // only unpledges unlist a pledge, one spent by an ordinary transaction is gone all the same
+                if (!pcoinsTip->HaveCoin(item.first))
+                    continue;
+                results.push_back(StakeInEntry(item.first.hash, item.first.n,
+                    CTxOut(item.second.nValue, item.second.scriptPubKey), nDepth));
+            }
+        }
+        return results;
+    }
+
     pwalletMain->AvailableCoins(vecOutputs, false, nullptr, true);
 
     vector<uint256> vecUnPledge;
@@ -3080,35 +3139,7 @@ UniValue liststakein(const UniValue &params, bool fHelp)
         // if (!get_tx_pledge(*out.tx, iin, iout) || iout != out.i) {
         //     continue;
         // }
-        CAmount nValue = out.tx->vout[iin].nValue;
-        const CScript &pk = out.tx->vout[iin].scriptPubKey;
-        UniValue entry(UniValue::VOBJ);
-        entry.pushKV("txid", out.tx->GetHash().GetHex());
-        entry.pushKV("vout", iin);
-        CTxDestination address;
-        if (ExtractDestination(out.tx->vout[iin].scriptPubKey, address))
-        {
-            entry.pushKV("address", EncodeDestination(address));
-            if (pwalletMain->mapAddressBook.count(address))
-                entry.pushKV("account", pwalletMain->mapAddressBook[address].name);
-        }
-        entry.pushKV("scriptPubKey", HexStr(pk.begin(), pk.end()));
-        if (pk.IsPayToScriptHash())
-        {
-            CTxDestination address2;
-            if (ExtractDestination(pk, address2))
-            {
-                const CScriptID &hash = boost::get<CScriptID>(address2);
-                CScript redeemScript;
-                if (pwalletMain->GetCScript(hash, redeemScript))
-                    entry.pushKV("redeemScript", HexStr(redeemScript.begin(), redeemScript.end()));
-            }
-        }
-        entry.pushKV("satoshi", UniValue(nValue));
-        entry.pushKV("amount", ValueFromAmount(nValue));
-        entry.pushKV("confirmations", out.nDepth);
-        // entry.pushKV("spendable", out.fSpendable);
-        results.push_back(entry);
+        results.push_back(StakeInEntry(out.tx->GetHash(), iin, out.tx->vout[iin], out.nDepth));
     }
 
     return results;
@@ -7,6 +7,7 @@
 #include "blockstorage/blockstorage.h"
 #include "chainparams.h"
 #include "main.h"
+#include "mininginfo.h"
 #include "util.h"
 
 static std::multimap<std::string, CZMQAbstractPublishNotifier *> mapPublishNotifiers;
@@ -175,3 +176,11 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransactionRef
     int rc = zmq_send_multipart(psocket, "rawtx", 5, &(*ss.begin()), ss.size(), 0);
     return rc == 0;
 }
+
+bool CZMQPublishMiningNotifyNotifier::NotifyBlock(const CBlockIndex *pindex)
+{
+    std::shared_ptr<const CMiningInfo> info = UpdateMiningInfo(pindex);
+    LOG(ZMQ, "zmq: Publish miningnotify %d\n", info->nHeight);
+    int rc = zmq_send_multipart(psocket, "miningnotify", 12, info->strJSON.data(), info->strJSON.size(), 0);
+    return rc == 0;
+}
@@ -41,4 +41,11 @@ public:
     bool NotifyTransaction(const CTransactionRef &ptx);
 };
 
+// diskcoin: the getMiningInfo JSON of the next block, for plot scanners
+class CZMQPublishMiningNotifyNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlock(const CBlockIndex *pindex);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H